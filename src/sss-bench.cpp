@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ftw.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include "sss-block.hpp"
+#include "sss-cgroup.hpp"
+#include "sss-collect.hpp"
+#include "sss-cpu.hpp"
+#include "sss-format.hpp"
+#include "sss-proc.hpp"
+
+using sss::Int;
+using sss::Sample;
+
+// Set sensible default values for the number of samples per measurement
+constexpr const Int DEFAULT_SAMPLES = 2000;
+
+namespace {
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    Int samples = DEFAULT_SAMPLES;
+    std::string fixture_dir;
+  };
+
+  /// Size of a synthetic host
+  struct Scenario {
+    const char* name;
+    int cpus;
+    int interfaces;
+    int meminfo_lines;
+    int disks;
+    int processes;
+    int cgroups;
+  };
+
+  /// Synthetic hosts from small virtual machines to huge servers
+  const Scenario scenarios[] = {
+    {"small", 4, 1, 50, 1, 100, 10},
+    {"medium", 64, 16, 200, 8, 1000, 100},
+    {"large", 256, 500, 1000, 64, 10000, 1000},
+    {"huge", 1024, 5000, 5000, 256, 50000, 4000},
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-bench [-h] [-n SAMPLES] [-d FIXTURE_DIR]\n"
+     << "\n"
+     << "sss-bench measures the time that sss-mon needs per sample for each\n"
+     << "collector and for writing samples in each format. The collectors\n"
+     << "read generated proc files of synthetic hosts with 4 to 1024 CPUs,\n"
+     << "1 to 5000 network interfaces, up to 5000 lines of meminfo, 1 to 256\n"
+     << "disks with 4 partitions each, 100 to 50000 processes, and 10 to\n"
+     << "4000 cgroups, such that results do not depend on the host the\n"
+     << "benchmark is run on.\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  -d, --fixture-dir FIXTURE_DIR\n"
+     << "                        Generate the proc files in FIXTURE_DIR and\n"
+     << "                        keep them (e.g., for 'sss-mon --proc-root').\n"
+     << "                        By default, a temporary directory is used.\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  -n, --samples SAMPLES\n"
+     << "                        Number of samples per measurement (default:\n"
+     << "                        " << DEFAULT_SAMPLES << ").\n";
+  os.flush();
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"fixture-dir", required_argument, nullptr, 'd'},
+      {"help", no_argument, nullptr, 'h'},
+      {"samples", required_argument, nullptr, 'n'},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "d:hn:", long_options, nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Set fixture directory
+      case 'd':
+        {
+          args.fixture_dir = optarg;
+          break;
+        }
+
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Set number of samples
+      case 'n':
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.samples;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.samples < 1) {
+            std::cerr << "error: argument to '-n|--samples' (" << optarg
+                      << ") is not a positive integer" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // No positional arguments are accepted
+  if (optind < argc) {
+    print_usage();
+    exit(2);
+  }
+
+  return args;
+}
+
+
+/// Create directory (including missing parents), exit on error
+static void make_directory(const std::string& path) {
+  for (auto slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+    const auto parent = path.substr(0, slash);
+    if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "error: could not create directory '" << parent << "'"
+                << std::endl;
+      std::exit(1);
+    }
+    if (slash == std::string::npos) {
+      return;
+    }
+  }
+}
+
+
+/// Write file, exit on error
+static void write_file(const std::string& path, const std::string& contents) {
+  std::ofstream out(path);
+  out << contents;
+  if (!out) {
+    std::cerr << "error: could not write fixture file '" << path << "'"
+              << std::endl;
+    std::exit(1);
+  }
+}
+
+
+/// Generate proc files of a scenario in `root/proc` (and the CPU topology in
+/// `root/sys`) in the format of recent Linux kernels
+static void generate_fixture(const Scenario& scenario,
+                             const std::string& root) {
+  make_directory(root + "/proc/net");
+  make_directory(root + "/sys/cpu");
+
+  // CPU load averages
+  write_file(root + "/proc/loadavg", "1.25 0.98 0.71 3/1234 56789\n");
+
+  // Aggregate and per-CPU times, followed by the (long) interrupt counters
+  const Int cpus = scenario.cpus;
+  std::ostringstream stat;
+  stat << "cpu  " << 123456 * cpus << " 789 " << 45678 * cpus << " "
+       << 9876543 * cpus << " 12345 0 6789 0 0 0\n";
+  for (int i = 0; i < scenario.cpus; i++) {
+    stat << "cpu" << i << " " << 123456 + i << " 789 " << 45678 + i << " "
+         << 9876543 + i << " 12345 0 6789 0 0 0\n";
+  }
+  stat << "intr 123456789";
+  for (int i = 0; i < 256 + 4 * scenario.cpus; i++) {
+    stat << " " << (i % 7) * 1234;
+  }
+  stat << "\nctxt 987654321\nbtime 1700000000\nprocesses 123456\n"
+       << "procs_running 3\nprocs_blocked 0\n"
+       << "softirq 12345678 0 1234 5 678 90 0 12 345 6 7890\n";
+  write_file(root + "/proc/stat", stat.str());
+
+  // Memory usage with filler lines (e.g., per-size huge page counters)
+  // between the keys of interest
+  std::ostringstream meminfo;
+  meminfo << "MemTotal:       263855424 kB\n"
+          << "MemFree:        123456789 kB\n"
+          << "MemAvailable:   200000000 kB\n"
+          << "Buffers:          1234567 kB\n"
+          << "Cached:          45678901 kB\n";
+  for (int i = 0; i < scenario.meminfo_lines - 7; i++) {
+    meminfo << "Filler" << i << ":" << std::setw(20) << i << " kB\n";
+  }
+  meminfo << "SwapTotal:       8388604 kB\n"
+          << "SwapFree:        8000000 kB\n";
+  write_file(root + "/proc/meminfo", meminfo.str());
+
+  // Network interfaces, the last one is sampled
+  std::ostringstream net_dev;
+  net_dev << "Inter-|   Receive                                            "
+          << "    |  Transmit\n"
+          << " face |bytes    packets errs drop fifo frame compressed "
+          << "multicast|bytes    packets errs drop fifo colls carrier "
+          << "compressed\n";
+  for (int i = 0; i < scenario.interfaces; i++) {
+    net_dev << std::setw(7) << ("eth" + std::to_string(i)) << ": "
+            << 123456789 + i << " 123456 0 0 0 0 0 0 " << 987654321 + i
+            << " 654321 0 0 0 0 0 0\n";
+  }
+  write_file(root + "/proc/net/dev", net_dev.str());
+
+  // Block devices: loop devices, then disks with 4 partitions each
+  std::ostringstream diskstats;
+  for (int i = 0; i < 8; i++) {
+    diskstats << "   7       " << i << " loop" << i
+              << " 12 0 34 5 0 0 0 0 0 8 5 0 0 0 0 0 0\n";
+  }
+  for (int i = 0; i < scenario.disks; i++) {
+    const auto disk = "nvme" + std::to_string(i) + "n1";
+    for (int part = 0; part <= 4; part++) {
+      diskstats << " 259 " << std::setw(7) << 5 * i + part << " " << disk
+                << (part > 0 ? "p" + std::to_string(part) : "") << " "
+                << 1234567 + i << " 2345 98765432 345678 " << 7654321 + i
+                << " 6543 87654321 456789 0 1234567 802467 0 0 0 0 12 34\n";
+    }
+  }
+  write_file(root + "/proc/diskstats", diskstats.str());
+
+  // Processes with stat files (pids start at 1000 as for a booted host)
+  for (int i = 0; i < scenario.processes; i++) {
+    const auto pid = std::to_string(1000 + i);
+    make_directory(root + "/proc/" + pid);
+    write_file(root + "/proc/" + pid + "/stat",
+               pid + " (worker " + std::to_string(i % 97) + ") S 1 " + pid
+               + " " + pid + " 0 -1 4194560 1234 0 5 0 " + std::to_string(i)
+               + " " + std::to_string(i % 13) + " 0 0 20 0 4 0 "
+               + std::to_string(12345 + i) + " 123456789 "
+               + std::to_string(i % 5000) + " 18446744073709551615 1 1 0 0 "
+               "0 0 0 4096 17663 0 0 0 17 3 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  }
+
+  // Cgroup v2 tree with up to 50 containers per slice
+  const auto cgroup_root = root + "/cgroup";
+  make_directory(cgroup_root);
+  write_file(cgroup_root + "/cgroup.controllers", "cpu io memory pids\n");
+  std::ostringstream memory_stat;
+  memory_stat << "anon 123456789\nfile 987654321\n";
+  for (int i = 0; i < 40; i++) {
+    memory_stat << "counter_" << i << " " << 1000 * i << "\n";
+  }
+  for (int i = 0; i < scenario.cgroups; i++) {
+    const auto slice = cgroup_root + "/slice" + std::to_string(i / 50);
+    if (i % 50 == 0) {
+      make_directory(slice);
+    }
+    const auto dir = slice + "/container" + std::to_string(i);
+    make_directory(dir);
+    write_file(dir + "/cpu.stat",
+               "usage_usec " + std::to_string(123456789 + i)
+               + "\nuser_usec 100000000\nsystem_usec 23456789\n"
+               "nr_periods 1000\nnr_throttled 12\nthrottled_usec 34567\n"
+               "nr_bursts 0\nburst_usec 0\n");
+    write_file(dir + "/memory.current", std::to_string(1111111111 + i) + "\n");
+    write_file(dir + "/memory.stat", memory_stat.str());
+    write_file(dir + "/io.stat",
+               "259:0 rbytes=123456789 wbytes=987654321 rios=1234 wios=5678 "
+               "dbytes=0 dios=0\n259:5 rbytes=1 wbytes=2 rios=3 wios=4 "
+               "dbytes=0 dios=0\n");
+    const std::string pressure =
+        "some avg10=0.12 avg60=0.34 avg300=0.56 total=" + std::to_string(i)
+        + "\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    write_file(dir + "/cpu.pressure", pressure);
+    write_file(dir + "/memory.pressure", pressure);
+  }
+
+  // CPU topology with 64 CPUs per NUMA node
+  write_file(root + "/sys/cpu/possible",
+             "0-" + std::to_string(scenario.cpus - 1) + "\n");
+  for (int node = 0; node * 64 < scenario.cpus; node++) {
+    const auto dir = root + "/sys/node/node" + std::to_string(node);
+    make_directory(dir);
+    write_file(dir + "/cpulist",
+               std::to_string(node * 64) + "-"
+               + std::to_string(std::min(scenario.cpus, node * 64 + 64) - 1)
+               + "\n");
+  }
+}
+
+
+/// Remove directory tree
+static void remove_tree(const std::string& path) {
+  nftw(path.c_str(),
+       [](const char* p, const struct stat*, int, struct FTW*) {
+         return std::remove(p);
+       },
+       16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+/// Return mean time in nanoseconds per call of `f`
+template <typename F>
+static double time_per_call(Int calls, F f) {
+  const auto begin = std::chrono::steady_clock::now();
+  for (Int i = 0; i < calls; i++) {
+    f();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return static_cast<double>(std::chrono::duration_cast<
+      std::chrono::nanoseconds>(end - begin).count()) / calls;
+}
+
+
+/// Print result line
+static void report(const std::string& scenario, const std::string& step,
+                   double ns) {
+  std::cout << std::left << std::setw(10) << scenario << std::setw(16) << step
+            << std::right << std::setw(14) << std::fixed
+            << std::setprecision(0) << ns << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  const auto args = parse_arguments(argc, argv);
+
+  // Create fixture directory
+  std::string fixture_dir = args.fixture_dir;
+  if (fixture_dir.empty()) {
+    char name[] = "/tmp/sss-bench-XXXXXX";
+    if (mkdtemp(name) == nullptr) {
+      std::cerr << "error: could not create temporary directory"
+                << std::endl;
+      std::exit(1);
+    }
+    fixture_dir = name;
+  }
+
+  std::cout << "scenario  step                ns/sample" << std::endl;
+  Sample sample{};
+  for (const auto& scenario : scenarios) {
+    const auto root = fixture_dir + "/" + scenario.name;
+    generate_fixture(scenario, root);
+
+    // Collectors one by one, reading the fixture files
+    sss::CollectorContext context;
+    context.proc_root = root + "/proc";
+    context.network_interfaces.push_back(
+        "eth" + std::to_string(scenario.interfaces - 1));
+    context.stat_paths.push_back(root);
+    for (const auto& info : sss::collector_registry()) {
+      auto collector = info.create();
+      std::string error;
+      if (!collector->open(context, error)) {
+        std::cerr << "error: " << error << std::endl;
+        std::exit(1);
+      }
+      report(scenario.name, info.name, time_per_call(args.samples, [&] {
+        collector->collect(sample);
+      }));
+    }
+
+    // All collectors with their files read one by one and in one batch
+    sss::FieldSelection all;
+    std::string error;
+    sss::select_fields("", "", all, error);
+    for (const bool batch_reads : {false, true}) {
+      context.batch_reads = batch_reads;
+      sss::Sampler sampler(context, all);
+      if (!sampler.open(error)) {
+        std::cerr << "error: " << error << std::endl;
+        std::exit(1);
+      }
+      report(scenario.name, batch_reads ? "sampler-uring" : "sampler",
+             time_per_call(args.samples, [&] { sample = sampler.sample(); }));
+    }
+    context.batch_reads = false;
+
+    // CPU collector with per-CPU statistics and writing them
+    sss::CpuTable cpus(root + "/sys", true);
+    context.cpus = &cpus;
+    auto collector = sss::make_collector<sss::CpuCollector>();
+    if (!collector->open(context, error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    report(scenario.name, "cpu+per-cpu", time_per_call(args.samples, [&] {
+      collector->collect(sample);
+    }));
+    std::FILE* null = std::fopen("/dev/null", "w");
+    report(scenario.name, "per-cpu-write", time_per_call(args.samples, [&] {
+      cpus.write(null, sample.timestamp, false);
+    }));
+
+    // Network collector with all interfaces and writing them
+    sss::NetworkTable networks({"all"});
+    context.networks = &networks;
+    collector = sss::make_collector<sss::NetworkCollector>();
+    if (!collector->open(context, error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    report(scenario.name, "network-all", time_per_call(args.samples, [&] {
+      collector->collect(sample);
+    }));
+    report(scenario.name, "per-if-write", time_per_call(args.samples, [&] {
+      networks.write(null, sample.timestamp, false);
+    }));
+
+    // I/O collector with all disks and writing them (partitions are
+    // recognized by name, since there is no sysfs for the synthetic files)
+    sss::DiskTable disks({}, "");
+    context.disks = &disks;
+    collector = sss::make_collector<sss::IoCollector>();
+    if (!collector->open(context, error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    report(scenario.name, "io+per-disk", time_per_call(args.samples, [&] {
+      collector->collect(sample);
+    }));
+    report(scenario.name, "per-disk-write", time_per_call(args.samples, [&] {
+      disks.write(null, sample.timestamp, false);
+    }));
+
+    // Process scans with stat files kept open and re-opened for each scan
+    // (fewer samples, since each scan reads all stat files)
+    const auto scans = std::max<Int>(1, args.samples / 200);
+    for (const bool keep_open : {true, false}) {
+      sss::ProcessTable processes(10, keep_open
+                                      ? sss::raise_open_file_limit(256) : 0);
+      if (!processes.open(context.proc_root, error)) {
+        std::cerr << "error: " << error << std::endl;
+        std::exit(1);
+      }
+      processes.update();
+      report(scenario.name, keep_open ? "processes" : "processes-reopen",
+             time_per_call(scans, [&] { processes.update(); }));
+      if (keep_open) {
+        report(scenario.name, "top-publish", time_per_call(args.samples, [&] {
+          processes.publish();
+        }));
+        report(scenario.name, "top-write", time_per_call(args.samples, [&] {
+          processes.write(null, sample.timestamp, false);
+        }));
+      }
+    }
+
+    // Cgroup tree with files kept open and re-opened for each sample, and
+    // kept open and read in one batch
+    for (const char* step : {"cgroups", "cgroups-reopen", "cgroups-uring"}) {
+      const bool keep_open = std::strcmp(step, "cgroups-reopen") != 0;
+      sss::CgroupTable cgroups(root + "/cgroup",
+                               keep_open ? sss::raise_open_file_limit(256)
+                                         : 0,
+                               std::strcmp(step, "cgroups-uring") == 0);
+      if (!cgroups.open(error)) {
+        std::cerr << "error: " << error << std::endl;
+        std::exit(1);
+      }
+      cgroups.update();
+      report(scenario.name, step,
+             time_per_call(scans, [&] { cgroups.update(); }));
+      if (std::strcmp(step, "cgroups") == 0) {
+        report(scenario.name, "cgroup-publish", time_per_call(scans, [&] {
+          cgroups.publish();
+        }));
+        report(scenario.name, "cgroup-write", time_per_call(scans, [&] {
+          cgroups.write(null, sample.timestamp, false);
+        }));
+      }
+    }
+    std::fclose(null);
+  }
+
+  // Writers do not depend on the host size, the sample is from the last
+  // scenario
+  std::ostringstream text;
+  report("-", "text-write", time_per_call(args.samples, [&] {
+    text.str(std::string());
+    sss::write_text(text, sample);
+    text << '\n';
+    return text.str();
+  }));
+  const sss::BinaryLayout layout;
+  std::vector<char> record(layout.record_size());
+  report("-", "binary-write", time_per_call(args.samples, [&] {
+    layout.encode(sample, &record[0]);
+  }));
+  sss::BlockEncoder encoder(sss::default_block_samples);
+  std::string block;
+  report("-", "compressed-write", time_per_call(args.samples, [&] {
+    sample.timestamp += 1000;
+    sample.cpu_time_user += 100;
+    if (encoder.add(sample)) {
+      block.clear();
+      encoder.finish(block);
+    }
+  }));
+
+  // Remove temporary fixtures
+  if (args.fixture_dir.empty()) {
+    remove_tree(fixture_dir);
+  }
+}
@@ -0,0 +1,367 @@
+#ifndef SSS_BLOCK_HPP
+#define SSS_BLOCK_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Compressed log files consist of independently decodable blocks, each of
+/// which holds a number of consecutive samples:
+///
+///   offset  size  content
+///        0     8  magic bytes "SSS-BLK\0"
+///        8     4  format version
+///       12     4  block size in bytes (including this header)
+///       16     4  number of samples
+///       20     4  reserved (zero)
+///       24     -  binary log file header (see BinaryLayout)
+///        -     -  one column per field of the binary log file header
+///
+/// Each column starts with a codec byte, followed by the values of the field
+/// for all samples of the block (N = number of samples; varints are LEB128
+/// encoded, signed values are zig-zag encoded first):
+///
+///   codec  content
+///       1  delta-of-delta (for timestamps): first value, first delta, then
+///          N-2 differences between consecutive deltas (signed varints)
+///       2  scaled delta (for integer counters and gauges): first value
+///          (signed varint), greatest common divisor G of all deltas
+///          (varint), then N-1 deltas divided by G (signed varints). If G is
+///          zero, all values are equal and no deltas follow.
+///       3  XOR (for floating point values): first value (8 bytes, little
+///          endian), then for each further value the XOR with its predecessor
+///          as a single zero byte if equal, or as control byte
+///          `0x80 | (L << 3) | T` followed by the 8 - L - T bytes left after
+///          removing L leading and T trailing zero bytes (little endian)
+constexpr char block_magic[8] = {'S', 'S', 'S', '-', 'B', 'L', 'K', '\0'};
+constexpr std::uint32_t block_version = 1;
+constexpr std::size_t block_fixed_header_size = 24;
+
+/// Default number of samples per block
+constexpr std::size_t default_block_samples = 600;
+
+/// Column codecs
+enum BlockCodec : char {
+  codec_delta_of_delta = 1,
+  codec_scaled_delta = 2,
+  codec_xor = 3,
+};
+
+/// Return true if the data starts with the block magic bytes
+inline bool is_block_file(const char* data, std::size_t size) {
+  return size >= sizeof(block_magic)
+         && std::memcmp(data, block_magic, sizeof(block_magic)) == 0;
+}
+
+/// Return the size of a block from its header, or zero if the data is too
+/// short or does not start with a block
+inline std::size_t block_size(const char* data, std::size_t size) {
+  if (size < block_fixed_header_size || !is_block_file(data, size)) {
+    return 0;
+  }
+  return load_le32(data + 12);
+}
+
+
+/// Append unsigned LEB128 varint
+inline void put_varint(std::string& out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+/// Append signed value as zig-zag encoded varint
+inline void put_signed_varint(std::string& out, std::int64_t value) {
+  put_varint(out, (static_cast<std::uint64_t>(value) << 1)
+                  ^ static_cast<std::uint64_t>(value >> 63));
+}
+
+/// Bounds-checked reading of encoded block data
+class BlockScanner {
+ public:
+  BlockScanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool good() const { return good_; }
+
+  std::uint8_t byte() {
+    if (p_ >= end_) {
+      good_ = false;
+      return 0;
+    }
+    return static_cast<std::uint8_t>(*p_++);
+  }
+
+  std::uint64_t varint() {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      const auto b = byte();
+      value |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        return value;
+      }
+    }
+    good_ = false;
+    return 0;
+  }
+
+  std::int64_t signed_varint() {
+    const auto v = varint();
+    return static_cast<std::int64_t>(v >> 1)
+           ^ -static_cast<std::int64_t>(v & 1);
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool good_ = true;
+};
+
+
+/// Collects samples and encodes them as a compressed block
+class BlockEncoder {
+ public:
+  /// Blocks hold at most `max_samples` samples with the fields of `layout`
+  explicit BlockEncoder(std::size_t max_samples,
+                        const BinaryLayout& layout = BinaryLayout())
+    : max_samples_(max_samples), layout_(layout), header_(layout_.header()),
+      record_size_(layout_.record_size()) {
+    records_.reserve(max_samples_ * record_size_);
+    values_.reserve(max_samples_);
+  }
+
+  /// Add sample, return true if the block is full
+  bool add(const Sample& s) {
+    records_.resize(records_.size() + record_size_);
+    layout_.encode(s, &records_[records_.size() - record_size_]);
+    return size() >= max_samples_;
+  }
+
+  /// Number of buffered samples
+  std::size_t size() const { return records_.size() / record_size_; }
+
+  bool empty() const { return records_.empty(); }
+
+  /// Append block with all buffered samples to `out` (unless there are none)
+  /// and start a new block
+  void finish(std::string& out) {
+    if (empty()) {
+      return;
+    }
+    const auto n = size();
+    const auto begin = out.size();
+    out.append(block_magic, sizeof(block_magic));
+    out.resize(begin + block_fixed_header_size, '\0');
+    store_le32(block_version, &out[begin + 8]);
+    store_le32(static_cast<std::uint32_t>(n), &out[begin + 16]);
+    out += header_;
+
+    // Encode columns
+    const auto& names = layout_.names();
+    const auto& types = layout_.types();
+    for (std::size_t c = 0; c < names.size(); c++) {
+      values_.clear();
+      for (std::size_t i = 0; i < n; i++) {
+        values_.push_back(load_le64(&records_[i * record_size_ + 8 * c]));
+      }
+      if (types[c] == 'f') {
+        encode_xor(out);
+      } else if (names[c] == "timestamp") {
+        encode_delta_of_delta(out);
+      } else {
+        encode_scaled_delta(out);
+      }
+    }
+
+    store_le32(static_cast<std::uint32_t>(out.size() - begin),
+               &out[begin + 12]);
+    records_.clear();
+  }
+
+ private:
+  void encode_delta_of_delta(std::string& out) const {
+    out.push_back(codec_delta_of_delta);
+    std::int64_t previous_delta = 0;
+    for (std::size_t i = 0; i < values_.size(); i++) {
+      if (i == 0) {
+        put_signed_varint(out, static_cast<std::int64_t>(values_[0]));
+        continue;
+      }
+      const auto delta =
+          static_cast<std::int64_t>(values_[i] - values_[i - 1]);
+      put_signed_varint(out, (i == 1) ? delta : delta - previous_delta);
+      previous_delta = delta;
+    }
+  }
+
+  void encode_scaled_delta(std::string& out) const {
+    out.push_back(codec_scaled_delta);
+    put_signed_varint(out, static_cast<std::int64_t>(values_[0]));
+    std::uint64_t divisor = 0;
+    for (std::size_t i = 1; i < values_.size(); i++) {
+      const auto delta = values_[i] - values_[i - 1];
+      divisor = gcd(divisor, (static_cast<std::int64_t>(delta) < 0)
+                             ? 0 - delta : delta);
+    }
+    put_varint(out, divisor);
+    if (divisor == 0) {
+      return;
+    }
+    for (std::size_t i = 1; i < values_.size(); i++) {
+      const auto delta = values_[i] - values_[i - 1];
+      const bool negative = static_cast<std::int64_t>(delta) < 0;
+      const auto scaled = (negative ? 0 - delta : delta) / divisor;
+      put_signed_varint(out, negative ? -static_cast<std::int64_t>(scaled)
+                                      : static_cast<std::int64_t>(scaled));
+    }
+  }
+
+  void encode_xor(std::string& out) const {
+    out.push_back(codec_xor);
+    char raw[8];
+    store_le64(values_[0], raw);
+    out.append(raw, sizeof(raw));
+    for (std::size_t i = 1; i < values_.size(); i++) {
+      auto x = values_[i] ^ values_[i - 1];
+      if (x == 0) {
+        out.push_back('\0');
+        continue;
+      }
+      const int leading = __builtin_clzll(x) / 8;
+      const int trailing = __builtin_ctzll(x) / 8;
+      out.push_back(static_cast<char>(0x80 | (leading << 3) | trailing));
+      x >>= 8 * trailing;
+      for (int b = 0; b < 8 - leading - trailing; b++, x >>= 8) {
+        out.push_back(static_cast<char>(x & 0xff));
+      }
+    }
+  }
+
+  static std::uint64_t gcd(std::uint64_t a, std::uint64_t b) {
+    while (b != 0) {
+      const auto r = a % b;
+      a = b;
+      b = r;
+    }
+    return a;
+  }
+
+  const std::size_t max_samples_;
+  const BinaryLayout layout_;
+  const std::string header_;
+  const std::size_t record_size_;
+  std::vector<char> records_;
+  std::vector<std::uint64_t> values_;
+};
+
+
+/// Decode a complete block into binary records (see BinaryLayout) and set
+/// `layout` to the layout of the records. Return false if the block is
+/// invalid.
+inline bool decode_block(const char* data, std::size_t size,
+                         BinaryLayout& layout, std::vector<char>& records,
+                         std::string& error) {
+  const auto total_size = block_size(data, size);
+  if (total_size < block_fixed_header_size + binary_fixed_header_size
+      || total_size > size) {
+    error = "corrupt or truncated block";
+    return false;
+  }
+  if (load_le32(data + 8) != block_version) {
+    error = "unsupported block format version "
+            + std::to_string(load_le32(data + 8));
+    return false;
+  }
+  const char* const header = data + block_fixed_header_size;
+  const auto header_size = BinaryLayout::header_size(
+      header, total_size - block_fixed_header_size);
+  if (header_size > total_size - block_fixed_header_size
+      || !layout.parse(header, header_size, error)) {
+    error = "corrupt block header";
+    return false;
+  }
+
+  // Decode columns
+  const std::size_t n = load_le32(data + 16);
+  const std::size_t record_size = layout.record_size();
+  if (n > total_size) {
+    error = "corrupt block header";
+    return false;
+  }
+  records.assign(n * record_size, '\0');
+  BlockScanner in(header + header_size, data + total_size);
+  for (std::size_t c = 0; c < layout.names().size() && n > 0; c++) {
+    char* const column = records.data() + 8 * c;
+    std::uint64_t value = 0;
+    switch (in.byte()) {
+      case codec_delta_of_delta:
+        {
+          std::int64_t delta = 0;
+          for (std::size_t i = 0; i < n; i++) {
+            if (i == 0) {
+              value = static_cast<std::uint64_t>(in.signed_varint());
+            } else {
+              delta = (i == 1) ? in.signed_varint()
+                               : delta + in.signed_varint();
+              value += static_cast<std::uint64_t>(delta);
+            }
+            store_le64(value, column + i * record_size);
+          }
+          break;
+        }
+      case codec_scaled_delta:
+        {
+          value = static_cast<std::uint64_t>(in.signed_varint());
+          const auto divisor = in.varint();
+          for (std::size_t i = 0; i < n; i++) {
+            if (i > 0 && divisor != 0) {
+              value += static_cast<std::uint64_t>(in.signed_varint())
+                       * divisor;
+            }
+            store_le64(value, column + i * record_size);
+          }
+          break;
+        }
+      case codec_xor:
+        {
+          for (int b = 0; b < 8; b++) {
+            value |= static_cast<std::uint64_t>(in.byte()) << (8 * b);
+          }
+          for (std::size_t i = 0; i < n; i++) {
+            if (i > 0) {
+              const auto control = in.byte();
+              if (control != 0) {
+                const int leading = (control >> 3) & 7;
+                const int trailing = control & 7;
+                std::uint64_t x = 0;
+                for (int b = 0; b < 8 - leading - trailing; b++) {
+                  x |= static_cast<std::uint64_t>(in.byte()) << (8 * b);
+                }
+                value ^= x << (8 * trailing);
+              }
+            }
+            store_le64(value, column + i * record_size);
+          }
+          break;
+        }
+      default:
+        error = "unknown column codec in block";
+        return false;
+    }
+    if (!in.good()) {
+      error = "corrupt block data";
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace sss
+
+#endif // SSS_BLOCK_HPP
@@ -0,0 +1,112 @@
+#ifndef SSS_BURST_HPP
+#define SSS_BURST_HPP
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sss-derive.hpp"
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Condition on a derived value that starts or extends a burst, given as
+/// '[+]FIELD>VALUE' or '[+]FIELD<VALUE' (e.g., 'cpu_iowait>0.2'). With a
+/// leading '+', the increase of the value since the previous sample is
+/// compared instead (e.g., '+swap_used>0' while swap usage grows).
+struct BurstCondition {
+  std::size_t field = 0;    // index into derived_fields()
+  bool increase = false;
+  bool greater = true;
+  Float threshold = 0.0;
+};
+
+/// Parse burst condition, return false if it is invalid
+inline bool parse_burst_condition(const std::string& text,
+                                  BurstCondition& condition) {
+  const auto op = text.find_first_of("<>");
+  if (op == std::string::npos) {
+    return false;
+  }
+  std::string name = text.substr(0, op);
+  condition.increase = !name.empty() && name[0] == '+';
+  if (condition.increase) {
+    name.erase(0, 1);
+  }
+  condition.greater = (text[op] == '>');
+  std::istringstream in(text.substr(op + 1));
+  in >> condition.threshold;
+  return find_derived_field(name, condition.field) && !in.fail()
+         && in.get() == std::istringstream::traits_type::eof();
+}
+
+
+/// Switches between a base period and a shorter burst period. Each sample is
+/// checked against the burst conditions, using the values derived from it
+/// and its predecessor. A burst starts as soon as any condition holds and
+/// ends once none has held for the cooldown time (on the steady clock).
+class BurstControl {
+ public:
+  BurstControl(Int base_period, Int burst_period, Int cooldown,
+               const std::vector<BurstCondition>& conditions)
+    : base_period_(base_period), burst_period_(burst_period),
+      cooldown_(cooldown), conditions_(conditions), period_(base_period) {}
+
+  /// Period in effect (in milliseconds)
+  Int period() const { return period_; }
+
+  /// Check conditions for the next sample, return true if the period changes
+  bool update(const Sample& s) {
+    bool triggered = false;
+    if (has_previous_ && s.time_delta > 0) {
+      const auto d = derive(previous_, s, s.time_delta);
+      for (const auto& c : conditions_) {
+        Float value = derived_value(d, c.field);
+        if (c.increase) {
+          if (!has_derived_) {
+            continue;
+          }
+          value -= derived_value(derived_, c.field);
+        }
+        if (c.greater ? value > c.threshold : value < c.threshold) {
+          triggered = true;
+        }
+      }
+      derived_ = d;
+      has_derived_ = true;
+    } else {
+      has_derived_ = false;
+    }
+    previous_ = s;
+    has_previous_ = true;
+
+    if (triggered) {
+      last_trigger_ = s.steady;
+    }
+    const Int period = (triggered || (period_ == burst_period_
+                                      && s.steady - last_trigger_ < cooldown_))
+                       ? burst_period_ : base_period_;
+    if (period == period_) {
+      return false;
+    }
+    period_ = period;
+    return true;
+  }
+
+ private:
+  const Int base_period_;
+  const Int burst_period_;
+  const Int cooldown_;
+  const std::vector<BurstCondition> conditions_;
+  Int period_;
+  Int last_trigger_ = 0;
+  Sample previous_;
+  bool has_previous_ = false;
+  Derived derived_;
+  bool has_derived_ = false;
+};
+
+} // namespace sss
+
+#endif // SSS_BURST_HPP
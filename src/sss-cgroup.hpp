@@ -0,0 +1,515 @@
+#ifndef SSS_CGROUP_HPP
+#define SSS_CGROUP_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "sss-collect.hpp"
+#include "sss-format.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Resource usage of all cgroups in a cgroup v2 subtree (including its root)
+/// from their cpu.stat, memory.current, memory.stat, io.stat, and, where they
+/// exist, cpu.pressure and memory.pressure files. The list of cgroups is
+/// cached and only re-read when inotify reports that a cgroup was created or
+/// removed (or, if inotify is not available, every `rescan_interval`
+/// updates). The files of up to `max_open_files` are kept open between
+/// updates and re-read with pread(), or, with `batch_reads`, all in one batch
+/// with io_uring (see ReadBatch).
+class CgroupTable {
+ public:
+  /// Indices of values per cgroup
+  enum Value {
+    cpu_usage, cpu_user, cpu_system, cpu_throttled, cpu_throttled_time,
+    memory_current, memory_anon, memory_file,
+    io_read_bytes, io_write_bytes, io_reads, io_writes,
+    cpu_some, cpu_full, memory_some, memory_full,
+    num_values
+  };
+
+  /// Updates between re-reading the list of cgroups without inotify
+  static constexpr Int rescan_interval = 60;
+
+  /// Reads in flight at once with `batch_reads`
+  static constexpr unsigned batch_entries = 256;
+
+  CgroupTable(const std::string& root, std::size_t max_open_files,
+              bool batch_reads = false)
+    : root_(root), max_open_files_(max_open_files),
+      batch_reads_(batch_reads) {}
+
+  ~CgroupTable() {
+    if (inotify_ >= 0) {
+      ::close(inotify_);
+    }
+  }
+
+  CgroupTable(const CgroupTable&) = delete;
+  CgroupTable& operator=(const CgroupTable&) = delete;
+
+  /// Read list of cgroups, return false if the root is not a directory of
+  /// a cgroup v2 hierarchy
+  bool open(std::string& error) {
+    DIR* const dir = opendir(root_.c_str());
+    if (dir == nullptr) {
+      error = "could not open cgroup directory '" + root_ + "'";
+      return false;
+    }
+    closedir(dir);
+
+    // Only cgroup v2 directories have a list of available controllers
+    if (access((root_ + "/cgroup.controllers").c_str(), F_OK) != 0) {
+      error = "'" + root_ + "' is not a cgroup v2 directory (on hosts with "
+              "cgroup v1, it may be mounted at '/sys/fs/cgroup/unified')";
+      return false;
+    }
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    rescan();
+
+    // Without io_uring, the batches are read with pread()
+    std::string ignored;
+    if (batch_reads_) {
+      batch_.open(batch_entries, ignored);
+    }
+    return true;
+  }
+
+  /// Read all files of all cgroups, re-reading the list of cgroups first if
+  /// it has changed
+  void update() {
+    if (changed()) {
+      rescan();
+    }
+    if (batch_reads_) {
+      read_batch();
+      return;
+    }
+    for (auto& c : cgroups_) {
+      read(*c);
+    }
+  }
+
+  /// Number of cgroups
+  std::size_t size() const { return cgroups_.size(); }
+
+  /// Copy the values of the last update (and the names of the cgroups, if
+  /// they have changed) for `write()`
+  void publish() {
+    if (!names_published_) {
+      published_names_.clear();
+      for (const auto& c : cgroups_) {
+        published_names_.push_back(c->name);
+      }
+      names_published_ = true;
+    }
+    published_values_.resize(cgroups_.size() * num_values);
+    for (std::size_t i = 0; i < cgroups_.size(); i++) {
+      std::memcpy(&published_values_[i * num_values], cgroups_[i]->values,
+                  sizeof(cgroups_[i]->values));
+    }
+  }
+
+  /// Write one line per cgroup with the published values and optionally
+  /// flush the file. Return false on write errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) {
+    std::size_t length = 0;
+    for (const auto& name : published_names_) {
+      length += name.size() + max_values_length;
+    }
+    output_.resize(length);
+    char* p = &output_[0];
+    for (std::size_t i = 0; i < published_names_.size(); i++) {
+      const auto& name = published_names_[i];
+      p = append_int(p, timestamp);
+      *p++ = ' ';
+      std::memcpy(p, name.data(), name.size());
+      p += name.size();
+      for (int k = 0; k < num_values; k++) {
+        *p++ = ' ';
+        p = append_int(p, published_values_[i * num_values + k]);
+      }
+      *p++ = '\n';
+    }
+    const auto size = static_cast<std::size_t>(p - output_.data());
+    return std::fwrite(output_.data(), 1, size, file) == size
+           && (!flush || std::fflush(file) == 0);
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp cgroup cpu_usage_us cpu_user_us cpu_system_us "
+           "cpu_throttled cpu_throttled_us memory_current memory_anon "
+           "memory_file io_read_bytes io_write_bytes io_reads io_writes "
+           "cpu_some_us cpu_full_us memory_some_us memory_full_us\n";
+  }
+
+ private:
+  /// Length of a line without the cgroup name (up to 21 characters for the
+  /// timestamp and for each value, including the separator)
+  static constexpr std::size_t max_values_length = 22 * (num_values + 1);
+
+  /// Files per cgroup
+  enum File {
+    cpu_stat_file, memory_current_file, memory_stat_file, io_stat_file,
+    cpu_pressure_file, memory_pressure_file, num_files
+  };
+
+  struct Cgroup {
+    std::string name;     // path relative to the root, '.' for the root
+    std::string path;
+    ProcFile files[num_files];
+    bool missing[num_files] = {};
+    bool pending[num_files] = {};   // not read yet by the current batch
+    int open_files = 0;
+    Int values[num_values] = {};
+  };
+
+  static const char* file_name(int f) {
+    static const char* const names[num_files] = {
+      "cpu.stat", "memory.current", "memory.stat", "io.stat", "cpu.pressure",
+      "memory.pressure"};
+    return names[f];
+  }
+
+  /// Return true if inotify reported a change, which also drains all pending
+  /// events
+  bool changed() {
+    if (inotify_ < 0 || !watching_) {
+      return ++updates_since_rescan_ >= rescan_interval;
+    }
+    bool result = false;
+    char events[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (::read(inotify_, events, sizeof(events)) > 0) {
+      result = true;
+    }
+    return result;
+  }
+
+  /// Re-read list of cgroups, keeping the open files of known cgroups
+  void rescan() {
+    std::map<std::string, std::unique_ptr<Cgroup>> known;
+    for (auto& c : cgroups_) {
+      known[c->name] = std::move(c);
+    }
+    cgroups_.clear();
+    watching_ = inotify_ >= 0;
+    walk(root_, ".", known);
+    for (const auto& c : known) {
+      open_files_ -= c.second->open_files;
+    }
+    registered_ = registered_ && known.empty();
+    names_published_ = false;
+    updates_since_rescan_ = 0;
+  }
+
+  void walk(const std::string& path, const std::string& name,
+            std::map<std::string, std::unique_ptr<Cgroup>>& known) {
+    // Watch directory for created and removed cgroups before reading it,
+    // such that no change is missed
+    if (watching_
+        && inotify_add_watch(inotify_, path.c_str(),
+                             IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                             | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+      watching_ = false;
+    }
+    DIR* const dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      return;
+    }
+    auto it = known.find(name);
+    if (it != known.end()) {
+      cgroups_.push_back(std::move(it->second));
+      known.erase(it);
+    } else {
+      cgroups_.emplace_back(new Cgroup());
+      cgroups_.back()->name = name;
+      cgroups_.back()->path = path;
+    }
+    std::vector<std::string> children;
+    while (const dirent* entry = readdir(dir)) {
+      if (entry->d_type == DT_DIR && std::strcmp(entry->d_name, ".") != 0
+          && std::strcmp(entry->d_name, "..") != 0) {
+        children.push_back(entry->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(children.begin(), children.end());
+    for (const auto& child : children) {
+      walk(path + "/" + child, (name == ".") ? child : name + "/" + child,
+           known);
+    }
+  }
+
+  /// Read file of cgroup and return it, or nullptr if it does not exist.
+  /// Files are kept open as long as the budget of open files allows.
+  const ProcFile* read_file(Cgroup& c, int f) {
+    if (c.missing[f]) {
+      return nullptr;
+    }
+    auto& file = c.files[f];
+    if (file.is_open()) {
+      if (refresh(file)) {
+        return &file;
+      }
+
+      // The cgroup may have been removed and re-created under the same name
+      // since the last rescan, which leaves a stale handle
+      file.close();
+      c.open_files--;
+      open_files_--;
+      registered_ = false;
+    }
+    const auto path = c.path + "/" + file_name(f);
+    if (open_files_ < max_open_files_) {
+      if (!file.open(path, 4096)) {
+        c.missing[f] = true;
+        return nullptr;
+      }
+      c.open_files++;
+      open_files_++;
+      registered_ = false;
+      return refresh(file) ? &file : nullptr;
+    }
+    // The scratch file stays open until the next file is read through it,
+    // since closing it would discard its contents
+    if (!scratch_.open(path, 4096)) {
+      c.missing[f] = true;
+      return nullptr;
+    }
+    return refresh(scratch_) ? &scratch_ : nullptr;
+  }
+
+  /// Re-read file. A read that does not fill the buffer got the whole file,
+  /// which saves the second pread() that would return end of file.
+  static bool refresh(ProcFile& file) {
+    return file.read(false)
+           && (static_cast<std::size_t>(file.end() - file.begin())
+                   < file.capacity()
+               || file.read());
+  }
+
+  /// Call `f(key, value)` for each 'KEY VALUE' line
+  template <typename F>
+  static void for_each_key(const ProcFile& file, F f) {
+    Scanner l(file.begin(), file.end());
+    while (!l.at_end()) {
+      const char* const key = l.position();
+      l.skip_word();
+      const auto length = static_cast<std::size_t>(l.position() - key);
+      const Int value = l.parse_int();
+      f(key, length, value);
+      l.skip_line();
+    }
+  }
+
+  /// Call `f(first_word, key, value)` for each 'KEY=VALUE' word
+  template <typename F>
+  static void for_each_assignment(const ProcFile& file, F f) {
+    const char* p = file.begin();
+    const char* const end = file.end();
+    while (p < end) {
+      const char* eol = static_cast<const char*>(
+          std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+      eol = (eol == nullptr) ? end : eol;
+      Scanner l(p, eol);
+      l.skip_spaces();
+      const char* const first = l.position();
+      while (!l.at_end()) {
+        l.skip_spaces();
+        const char* const word = l.position();
+        l.skip_word();
+        const char* const equals = static_cast<const char*>(std::memchr(
+            word, '=', static_cast<std::size_t>(l.position() - word)));
+        if (equals != nullptr) {
+          Scanner v(equals + 1, l.position());
+          f(first, word, static_cast<std::size_t>(equals - word),
+            v.parse_int());
+        }
+      }
+      p = eol + 1;
+    }
+  }
+
+  static bool is(const char* key, std::size_t length, const char* name) {
+    return std::strlen(name) == length && std::memcmp(key, name, length) == 0;
+  }
+
+  /// Read all files of a cgroup into its values
+  void read(Cgroup& c) {
+    clear(c);
+    for (int f = 0; f < num_files; f++) {
+      if (const auto* file = read_file(c, f)) {
+        parse(c, f, *file);
+      }
+    }
+  }
+
+  /// Read the files of all cgroups that are kept open in one batch, parsing
+  /// each as soon as it has been read. The other files, and those whose read
+  /// failed (e.g., since the cgroup was re-created), are read afterwards.
+  void read_batch() {
+    if (!registered_) {
+      std::vector<int> fds;
+      for (const auto& c : cgroups_) {
+        for (const auto& file : c->files) {
+          if (file.is_open()) {
+            fds.push_back(file.fd());
+          }
+        }
+      }
+      batch_.register_files(fds);
+      registered_ = true;
+    }
+    for (std::size_t i = 0; i < cgroups_.size(); i++) {
+      Cgroup& c = *cgroups_[i];
+      clear(c);
+      for (int f = 0; f < num_files; f++) {
+        c.pending[f] = !c.missing[f];
+        if (c.pending[f] && c.files[f].is_open()) {
+          c.files[f].add_to(batch_, i * num_files + f);
+        }
+      }
+    }
+    batch_.run([this](std::uint64_t tag, long result) {
+      Cgroup& c = *cgroups_[tag / num_files];
+      const int f = static_cast<int>(tag % num_files);
+      if (c.files[f].complete(result)) {
+        parse(c, f, c.files[f]);
+        c.pending[f] = false;
+      }
+    });
+    for (auto& c : cgroups_) {
+      for (int f = 0; f < num_files; f++) {
+        if (!c->pending[f]) {
+          continue;
+        }
+        if (const auto* file = read_file(*c, f)) {
+          parse(*c, f, *file);
+        }
+      }
+    }
+  }
+
+  static void clear(Cgroup& c) {
+    for (auto& v : c.values) {
+      v = 0;
+    }
+  }
+
+  /// Add the values of a file of a cgroup
+  static void parse(Cgroup& c, int f, const ProcFile& file) {
+    Int* const v = c.values;
+    switch (f) {
+      case cpu_stat_file:
+        {
+          for_each_key(file, [v](const char* key, std::size_t n, Int value) {
+            if (is(key, n, "usage_usec")) {
+              v[cpu_usage] = value;
+            } else if (is(key, n, "user_usec")) {
+              v[cpu_user] = value;
+            } else if (is(key, n, "system_usec")) {
+              v[cpu_system] = value;
+            } else if (is(key, n, "nr_throttled")) {
+              v[cpu_throttled] = value;
+            } else if (is(key, n, "throttled_usec")) {
+              v[cpu_throttled_time] = value;
+            }
+          });
+          break;
+        }
+
+      case memory_current_file:
+        {
+          Scanner l(file.begin(), file.end());
+          v[memory_current] = l.parse_int();
+          break;
+        }
+
+      case memory_stat_file:
+        {
+          for_each_key(file, [v](const char* key, std::size_t n, Int value) {
+            if (is(key, n, "anon")) {
+              v[memory_anon] = value;
+            } else if (is(key, n, "file")) {
+              v[memory_file] = value;
+            }
+          });
+          break;
+        }
+
+      // Lines have the form 'MAJOR:MINOR rbytes=N wbytes=N rios=N wios=N
+      // ...' and are added up over all devices
+      case io_stat_file:
+        {
+          for_each_assignment(file, [v](const char*, const char* key,
+                                        std::size_t n, Int value) {
+            if (is(key, n, "rbytes")) {
+              v[io_read_bytes] += value;
+            } else if (is(key, n, "wbytes")) {
+              v[io_write_bytes] += value;
+            } else if (is(key, n, "rios")) {
+              v[io_reads] += value;
+            } else if (is(key, n, "wios")) {
+              v[io_writes] += value;
+            }
+          });
+          break;
+        }
+
+      // Lines have the form 'some avg10=N avg60=N avg300=N total=N' (and the
+      // same for 'full'), of which only the total stall time is cumulative
+      case cpu_pressure_file:
+      case memory_pressure_file:
+        {
+          Int* const some = &v[(f == cpu_pressure_file) ? cpu_some
+                                                        : memory_some];
+          for_each_assignment(file, [some](const char* first,
+                                           const char* key, std::size_t n,
+                                           Int value) {
+            if (is(key, n, "total")) {
+              some[(*first == 'f') ? 1 : 0] = value;
+            }
+          });
+          break;
+        }
+    }
+  }
+
+  const std::string root_;
+  const std::size_t max_open_files_;
+  const bool batch_reads_;
+  std::size_t open_files_ = 0;
+  int inotify_ = -1;
+  bool watching_ = false;
+  Int updates_since_rescan_ = 0;
+  std::vector<std::unique_ptr<Cgroup>> cgroups_;
+  ProcFile scratch_;
+
+  // Names and values as of the last `publish()`, which are written, such
+  // that another thread can write them while the next update is in progress
+  // (as long as `publish()` and `write()` are serialized)
+  std::vector<std::string> published_names_;
+  std::vector<Int> published_values_;
+  bool names_published_ = false;
+  std::string output_;
+
+  // Ring for batched reads, with the open files registered unless they
+  // changed since the last batch
+  ReadBatch batch_;
+  bool registered_ = false;
+};
+
+} // namespace sss
+
+#endif // SSS_CGROUP_HPP
@@ -0,0 +1,821 @@
+#ifndef SSS_COLLECT_HPP
+#define SSS_COLLECT_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sss-cpu.hpp"
+#include "sss-disk.hpp"
+#include "sss-format.hpp"
+#include "sss-histogram.hpp"
+#include "sss-net.hpp"
+#include "sss-scanner.hpp"
+#include "sss-uring.hpp"
+
+namespace sss {
+
+/// Persistent read-only handle to a file in the proc filesystem. The file is
+/// opened once and re-read from the beginning with pread() into a buffer that
+/// is only ever grown, i.e., after the first few reads no more memory is
+/// allocated.
+class ProcFile {
+ public:
+  ProcFile() = default;
+
+  ~ProcFile() { close(); }
+
+  ProcFile(const ProcFile&) = delete;
+  ProcFile& operator=(const ProcFile&) = delete;
+
+  /// Open file with an initial buffer capacity, return false on error
+  bool open(const std::string& path, std::size_t capacity = 4096) {
+    close();
+    path_ = path;
+    buffer_.resize(capacity);
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd_ >= 0;
+  }
+
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+    size_ = 0;
+  }
+
+  /// Re-read file contents. If `whole` is false, only the first buffer full
+  /// of data is read, which is sufficient if only the first line is needed.
+  bool read(bool whole = true) {
+    size_ = 0;
+    while (true) {
+      const auto n = ::pread(fd_, &buffer_[size_], buffer_.size() - size_,
+                             static_cast<off_t>(size_));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        size_ = 0;
+        return false;
+      }
+      size_ += static_cast<std::size_t>(n);
+
+      // Stop at end of file or if only the beginning was requested
+      if (n == 0 || !whole) {
+        return true;
+      }
+
+      // Grow buffer if it is full, since the file might not have been read
+      // completely
+      if (size_ == buffer_.size()) {
+        buffer_.resize(2 * buffer_.size());
+      }
+    }
+  }
+
+  /// Queue a read of the first buffer full of data, whose result must be
+  /// passed to `complete()` once the batch has run
+  void add_to(ReadBatch& batch, std::uint64_t tag) {
+    batch.add(fd_, &buffer_[0], buffer_.size(), tag);
+  }
+
+  /// Take the result of a read queued by `add_to()` (the number of bytes or
+  /// a negated error number). A read that did not fill the buffer got the
+  /// whole file, otherwise the rest is read with read() if `whole` is true,
+  /// and the buffer is grown such that it suffices for the next batch.
+  bool complete(long result, bool whole = true) {
+    if (result < 0) {
+      size_ = 0;
+      return false;
+    }
+    size_ = static_cast<std::size_t>(result);
+    return size_ < buffer_.size() || !whole || read();
+  }
+
+  const char* begin() const { return buffer_.data(); }
+  const char* end() const { return buffer_.data() + size_; }
+  const std::string& path() const { return path_; }
+  int fd() const { return fd_; }
+  bool is_open() const { return fd_ >= 0; }
+  std::size_t capacity() const { return buffer_.size(); }
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  std::vector<char> buffer_;
+  std::size_t size_ = 0;
+};
+
+
+/// Raise the soft limit of open files to the hard limit and return how many
+/// more files may be opened, keeping `reserve` files for everything else
+inline std::size_t raise_open_file_limit(std::size_t reserve) {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return 0;
+  }
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur <= 2 * reserve) {
+    return 0;
+  }
+  return static_cast<std::size_t>(
+      std::min<rlim_t>(limit.rlim_cur - reserve, 1 << 20));
+}
+
+
+/// Settings and state shared by all collectors of a sampler
+struct CollectorContext {
+  // Directory with the files that are usually found in /proc, e.g., fixture
+  // files for benchmarks
+  std::string proc_root = "/proc";
+
+  // Network interfaces (names or patterns, see NetworkTable)
+  std::vector<std::string> network_interfaces;
+
+  // Paths for which the capacity of the file system is recorded
+  std::vector<std::string> stat_paths;
+
+  // Block devices (names or patterns, see DiskTable)
+  std::vector<std::string> disk_devices;
+
+  // Per-CPU statistics (optional) and whether they were updated by the last
+  // sample
+  CpuTable* cpus = nullptr;
+  bool has_cpu_data = false;
+
+  // Per-interface statistics (optional), updated by each sample
+  NetworkTable* networks = nullptr;
+
+  // Per-device I/O statistics and per-path capacities (optional), updated by
+  // each sample
+  DiskTable* disks = nullptr;
+  MountTable* mounts = nullptr;
+
+  // Read the proc files of all collectors in one batch per sample with
+  // io_uring (see ReadBatch), or with read() if it is not available
+  bool batch_reads = false;
+
+  // Problems found when opening collectors that do not prevent sampling
+  std::vector<std::string> warnings;
+};
+
+
+/// Data source for a group of sample fields. Sources are opened once and
+/// re-read for each sample.
+class Collector {
+ public:
+  virtual ~Collector() = default;
+
+  /// Open data sources, return false on error. The context must outlive the
+  /// collector.
+  virtual bool open(CollectorContext& context, std::string& error) = 0;
+
+  /// Fill in the fields of the collector
+  virtual void collect(Sample& s) = 0;
+
+  /// Proc file that `collect()` reads, if it reads exactly one, such that
+  /// the sampler can read it in one batch with the files of other collectors
+  /// and call `parse()` instead of `collect()`. `whole` is set to false if
+  /// only the first buffer full of data is needed.
+  virtual ProcFile* source(bool&) { return nullptr; }
+
+  /// Fill in the fields of the collector from the contents of its source
+  virtual void parse(Sample&) {}
+
+ protected:
+  /// Open proc file and set error message on failure
+  static bool open_proc_file(ProcFile& file, const std::string& path,
+                             std::size_t capacity, std::string& error) {
+    if (!file.open(path, capacity)) {
+      error = "could not open '" + path + "' for reading";
+      return false;
+    }
+    return true;
+  }
+};
+
+
+/// Wall clock and steady clock time of the sample
+class TimeCollector : public Collector {
+ public:
+  bool open(CollectorContext&, std::string&) override { return true; }
+
+  void collect(Sample& s) override {
+    // Current point in time as reference
+    s.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Steady clock timestamp for robust time-average calculation
+    s.steady = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+};
+
+
+/// CPU load averages
+class LoadCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    return open_proc_file(loadavg_, context.proc_root + "/loadavg", 256,
+                          error);
+  }
+
+  void collect(Sample& s) override {
+    if (loadavg_.read()) {
+      parse(s);
+    }
+  }
+
+  ProcFile* source(bool&) override { return &loadavg_; }
+
+  void parse(Sample& s) override {
+    Scanner l(loadavg_.begin(), loadavg_.end());
+    s.cpu_load_1m = l.parse_float();
+    s.cpu_load_5m = l.parse_float();
+    s.cpu_load_15m = l.parse_float();
+  }
+
+ private:
+  ProcFile loadavg_;
+};
+
+
+/// CPU statistics (and per-CPU statistics if requested)
+class CpuCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    context_ = &context;
+    return open_proc_file(stat_, context.proc_root + "/stat", 4096, error);
+  }
+
+  void collect(Sample& s) override {
+    // Only the first line with the cumulated values is needed, thus there is
+    // no need to read the per-CPU lines on large machines unless per-CPU
+    // statistics are requested
+    context_->has_cpu_data = false;
+    if (stat_.read(context_->cpus != nullptr)) {
+      parse(s);
+    }
+  }
+
+  ProcFile* source(bool& whole) override {
+    whole = context_->cpus != nullptr;
+    return &stat_;
+  }
+
+  void parse(Sample& s) override {
+    auto cpus = context_->cpus;
+    if (cpus != nullptr) {
+      context_->has_cpu_data = cpus->update(stat_.begin(), stat_.end());
+    }
+    Scanner l(stat_.begin(), stat_.end());
+
+    // Skip first word (will probably be 'cpu')
+    l.skip_word();
+
+    // Read and convert CPU statistics
+    s.cpu_time_user = l.parse_int();
+    s.cpu_time_nice = l.parse_int();
+    s.cpu_time_system = l.parse_int();
+    s.cpu_time_idle = l.parse_int();
+    s.cpu_time_iowait = l.parse_int();
+    s.cpu_time_irq = l.parse_int();
+    s.cpu_time_softirq = l.parse_int();
+    s.cpu_time_steal = l.parse_int();
+    s.cpu_time_guest = l.parse_int();
+    s.cpu_time_guest_nice = l.parse_int();
+  }
+
+ private:
+  CollectorContext* context_ = nullptr;
+  ProcFile stat_;
+};
+
+
+/// Memory usage
+class MemoryCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    return open_proc_file(meminfo_, context.proc_root + "/meminfo", 8192,
+                          error);
+  }
+
+  void collect(Sample& s) override {
+    if (meminfo_.read()) {
+      parse(s);
+    }
+  }
+
+  ProcFile* source(bool&) override { return &meminfo_; }
+
+  void parse(Sample& s) override {
+    // Keys of interest and where to store their values
+    Int memory_free = 0;
+    Int buffers = 0;
+    Int cached = 0;
+    Int swap_free = 0;
+    struct Key {
+      const char* name;
+      std::size_t length;
+      Int* value;
+    };
+    const Key keys[] = {
+      {"MemTotal:", 9, &s.memory_total},
+      {"MemFree:", 8, &memory_free},
+      {"Buffers:", 8, &buffers},
+      {"Cached:", 7, &cached},
+      {"SwapTotal:", 10, &s.swap_total},
+      {"SwapFree:", 9, &swap_free},
+    };
+    constexpr std::size_t num_keys = sizeof(keys) / sizeof(keys[0]);
+
+    // Scan file line by line until all keys have been found
+    std::size_t found = 0;
+    for (Scanner l(meminfo_.begin(), meminfo_.end());
+         !l.at_end() && found < num_keys; l.skip_line()) {
+      for (std::size_t k = 0; k < num_keys; k++) {
+        if (l.consume(keys[k].name, keys[k].length)) {
+          *keys[k].value = l.parse_int();
+          found++;
+          break;
+        }
+      }
+    }
+
+    // Calculate used memory and used swap space
+    s.memory_used = s.memory_total - memory_free - buffers - cached;
+    s.swap_used = s.swap_total - swap_free;
+
+    // Convert values from kibibytes to bytes
+    s.memory_total *= 1024;
+    s.memory_used *= 1024;
+    s.swap_total *= 1024;
+    s.swap_used *= 1024;
+  }
+
+ private:
+  ProcFile meminfo_;
+};
+
+
+/// Disk usage of all stat paths
+class DiskCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    if (context.mounts == nullptr) {
+      own_mounts_.reset(new MountTable(context.stat_paths));
+    }
+    mounts_ = (context.mounts != nullptr) ? context.mounts
+                                          : own_mounts_.get();
+    return mounts_->open(error);
+  }
+
+  void collect(Sample& s) override {
+    mounts_->update();
+    s.disk_total = mounts_->sum(MountTable::total);
+    s.disk_used = mounts_->sum(MountTable::used);
+    s.disk_available = mounts_->sum(MountTable::available);
+  }
+
+ private:
+  std::unique_ptr<MountTable> own_mounts_;
+  MountTable* mounts_ = nullptr;
+};
+
+
+/// I/O counters of all selected block devices
+class IoCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    if (context.disks == nullptr) {
+      own_disks_.reset(new DiskTable(context.disk_devices,
+                                     block_root(context.proc_root)));
+    }
+    disks_ = (context.disks != nullptr) ? context.disks : own_disks_.get();
+    if (!open_proc_file(diskstats_, context.proc_root + "/diskstats", 8192,
+                        error)) {
+      return false;
+    }
+    if (diskstats_.read()) {
+      disks_->update(diskstats_.begin(), diskstats_.end());
+    }
+    for (const auto& pattern : disks_->unmatched()) {
+      context.warnings.push_back("block device '" + pattern
+                                 + "' not found in '" + diskstats_.path()
+                                 + "'");
+    }
+    return true;
+  }
+
+  void collect(Sample& s) override {
+    if (diskstats_.read()) {
+      parse(s);
+    }
+  }
+
+  ProcFile* source(bool&) override { return &diskstats_; }
+
+  void parse(Sample& s) override {
+    disks_->update(diskstats_.begin(), diskstats_.end());
+    s.io_reads = disks_->total(DiskTable::reads);
+    s.io_sectors_read = disks_->total(DiskTable::sectors_read);
+    s.io_writes = disks_->total(DiskTable::writes);
+    s.io_sectors_written = disks_->total(DiskTable::sectors_written);
+    s.io_time = disks_->total(DiskTable::io_time);
+    s.io_time_weighted = disks_->total(DiskTable::io_time_weighted);
+  }
+
+ private:
+  std::unique_ptr<DiskTable> own_disks_;
+  DiskTable* disks_ = nullptr;
+  ProcFile diskstats_;
+};
+
+
+/// Bytes received/sent on all selected network interfaces
+class NetworkCollector : public Collector {
+ public:
+  bool open(CollectorContext& context, std::string& error) override {
+    // Use the per-interface statistics if requested, otherwise a private
+    // table for the totals
+    if (context.networks == nullptr) {
+      own_networks_.reset(new NetworkTable(context.network_interfaces));
+    }
+    networks_ = (context.networks != nullptr) ? context.networks
+                                              : own_networks_.get();
+    if (!open_proc_file(net_dev_, context.proc_root + "/net/dev", 4096,
+                        error)) {
+      return false;
+    }
+
+    // Interfaces may still appear later (e.g., for containers)
+    if (net_dev_.read()) {
+      networks_->update(net_dev_.begin(), net_dev_.end());
+    }
+    for (const auto& pattern : networks_->unmatched()) {
+      context.warnings.push_back("network interface '" + pattern
+                                 + "' not found in '" + net_dev_.path()
+                                 + "'");
+    }
+    return true;
+  }
+
+  void collect(Sample& s) override {
+    if (net_dev_.read()) {
+      parse(s);
+    }
+  }
+
+  ProcFile* source(bool&) override { return &net_dev_; }
+
+  void parse(Sample& s) override {
+    networks_->update(net_dev_.begin(), net_dev_.end());
+    s.network_received = networks_->total(NetworkTable::rx_bytes);
+    s.network_sent = networks_->total(NetworkTable::tx_bytes);
+  }
+
+ private:
+  std::unique_ptr<NetworkTable> own_networks_;
+  NetworkTable* networks_ = nullptr;
+  ProcFile net_dev_;
+};
+
+
+/// Description of a sample field
+struct FieldDescription {
+  const char* name;
+  const char* description;
+};
+
+/// Registry entry of a collector with the fields it provides
+struct CollectorInfo {
+  const char* name;
+  const char* source;   // data source, for usage information
+  std::vector<FieldDescription> fields;
+  std::unique_ptr<Collector> (*create)();
+};
+
+template <typename T>
+std::unique_ptr<Collector> make_collector() {
+  return std::unique_ptr<Collector>(new T());
+}
+
+/// All collectors in the order in which they are run. Each field of Sample
+/// that is written to log files is provided by exactly one collector. The
+/// first collector (time) is always run.
+inline const std::vector<CollectorInfo>& collector_registry() {
+  static const std::vector<CollectorInfo> registry = {
+    {"time", "the system clock", {
+       {"timestamp", "Unix timestamp (in milliseconds)."},
+       {"time_delta", "Time since last sample was recorded (in "
+                      "milliseconds). A value of zero indicates that this "
+                      "is the first sample since (re-)starting sss-mon."},
+       {"period", "Sampling period in effect (in milliseconds), which is "
+                  "shorter than the base period during a burst (see "
+                  "--burst-period). Zero in logs written before it was "
+                  "added."},
+     }, make_collector<TimeCollector>},
+    {"load", "'/proc/loadavg'", {
+       {"cpu_load_1m", "CPU load average (1 minute average)."},
+       {"cpu_load_5m", "CPU load average (5 minute average)."},
+       {"cpu_load_15m", "CPU load average (15 minute average)."},
+     }, make_collector<LoadCollector>},
+    {"cpu", "'/proc/stat'", {
+       {"cpu_time_user", "CPU time spent in user mode."},
+       {"cpu_time_nice", "CPU time spent in user mode with low priority "
+                         "(nice)."},
+       {"cpu_time_system", "CPU time spent in system mode."},
+       {"cpu_time_idle", "CPU time spent in the idle task."},
+       {"cpu_time_iowait", "CPU time waiting for I/O to complete."},
+       {"cpu_time_irq", "CPU time servicing interrupts."},
+       {"cpu_time_softirq", "CPU time servicing softirqs."},
+       {"cpu_time_steal", "CPU stolen time, which is the time spent in "
+                          "other operating systems when running in a "
+                          "virtualized environment."},
+       {"cpu_time_guest", "CPU time spent running a virtual CPU for guest "
+                          "operating systems under the control of the Linux "
+                          "kernel."},
+       {"cpu_time_guest_nice", "CPU time spent running a niced guest "
+                               "(virtual CPU for guest operating systems "
+                               "under the control of the Linux kernel)."},
+     }, make_collector<CpuCollector>},
+    {"memory", "'/proc/meminfo'", {
+       {"memory_total", "Total usable RAM (in bytes)."},
+       {"memory_used", "Memory currently in use (in bytes)."},
+       {"swap_total", "Total amount of swap space (in bytes)."},
+       {"swap_used", "Swap space currently in use (in bytes)."},
+     }, make_collector<MemoryCollector>},
+    {"disk", "the system call 'statvfs()'", {
+       {"disk_total", "Total usable disk space (in bytes), summed over the "
+                      "distinct file systems of all stat paths."},
+       {"disk_used", "Disk space currently in use (in bytes)."},
+       {"disk_available", "Disk space available for non-privileged users "
+                          "(in bytes)."},
+     }, make_collector<DiskCollector>},
+    {"network", "'/proc/net/dev'", {
+       {"network_received", "Total bytes received on all selected "
+                            "interfaces (in bytes)."},
+       {"network_sent", "Total bytes sent on all selected interfaces (in "
+                        "bytes)."},
+     }, make_collector<NetworkCollector>},
+    {"io", "'/proc/diskstats'", {
+       {"io_reads", "Reads completed on all selected block devices."},
+       {"io_sectors_read", "Sectors read (of 512 bytes)."},
+       {"io_writes", "Writes completed."},
+       {"io_sectors_written", "Sectors written (of 512 bytes)."},
+       {"io_time", "Time spent doing I/O (in milliseconds), summed over "
+                   "devices."},
+       {"io_time_weighted", "Time spent doing I/O weighted by the number of "
+                            "I/Os in progress (in milliseconds), which "
+                            "indicates latency and queue depth."},
+     }, make_collector<IoCollector>},
+  };
+  return registry;
+}
+
+
+/// Split comma-separated list, ignoring empty items
+inline std::vector<std::string> split_list(const std::string& list) {
+  std::vector<std::string> items;
+  std::string::size_type begin = 0;
+  while (begin <= list.size()) {
+    auto end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    if (end > begin) {
+      items.push_back(list.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return items;
+}
+
+
+/// Collectors and fields to be sampled
+struct FieldSelection {
+  // One flag per entry of the collector registry
+  std::vector<bool> collectors;
+
+  // Selected field names in log file order
+  std::vector<std::string> fields;
+};
+
+/// Select fields from comma-separated lists of collector names (which select
+/// all fields of the collector) and field names. If both are empty, all
+/// fields are selected. The fields of the time collector are always
+/// selected. Return false if a name is unknown.
+inline bool select_fields(const std::string& collector_list,
+                          const std::string& field_list,
+                          FieldSelection& selection, std::string& error) {
+  const auto& registry = collector_registry();
+  const bool all = collector_list.empty() && field_list.empty();
+  std::vector<bool> field_selected(sample_fields().size(), all);
+  selection.collectors.assign(registry.size(), all);
+
+  // Mark field and the collector that provides it
+  const auto select = [&](std::size_t c, const char* name) {
+    selection.collectors[c] = true;
+    for (std::size_t i = 0; i < sample_fields().size(); i++) {
+      if (std::strcmp(sample_fields()[i].name, name) == 0) {
+        field_selected[i] = true;
+      }
+    }
+  };
+  for (const auto& f : registry[0].fields) {
+    select(0, f.name);
+  }
+  for (const auto& name : split_list(collector_list)) {
+    std::size_t c = 0;
+    while (c < registry.size() && name != registry[c].name) {
+      c++;
+    }
+    if (c == registry.size()) {
+      error = "unknown collector '" + name + "'";
+      return false;
+    }
+    for (const auto& f : registry[c].fields) {
+      select(c, f.name);
+    }
+  }
+  for (const auto& name : split_list(field_list)) {
+    bool found = false;
+    for (std::size_t c = 0; c < registry.size() && !found; c++) {
+      for (const auto& f : registry[c].fields) {
+        if (name == f.name) {
+          select(c, f.name);
+          found = true;
+        }
+      }
+    }
+    if (!found) {
+      error = "unknown field '" + name + "'";
+      return false;
+    }
+  }
+
+  selection.fields.clear();
+  for (std::size_t i = 0; i < sample_fields().size(); i++) {
+    if (field_selected[i]) {
+      selection.fields.push_back(sample_fields()[i].name);
+    }
+  }
+  return true;
+}
+
+
+/// Sampling engine that runs the selected collectors and keeps all their data
+/// sources open between samples
+class Sampler {
+ public:
+  /// The CPU, network, io, and disk collectors are always run if per-CPU,
+  /// per-interface, per-device, or per-path statistics are requested
+  Sampler(const CollectorContext& context, const FieldSelection& selection)
+    : context_(context) {
+    const auto& registry = collector_registry();
+    for (std::size_t c = 0; c < registry.size(); c++) {
+      if (selection.collectors[c]
+          || (context_.cpus != nullptr
+              && std::strcmp(registry[c].name, "cpu") == 0)
+          || (context_.networks != nullptr
+              && std::strcmp(registry[c].name, "network") == 0)
+          || (context_.disks != nullptr
+              && std::strcmp(registry[c].name, "io") == 0)
+          || (context_.mounts != nullptr
+              && std::strcmp(registry[c].name, "disk") == 0)) {
+        collectors_.push_back(registry[c].create());
+        names_.push_back(registry[c].name);
+      }
+    }
+  }
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+
+  /// Open data sources of all collectors, return false on error. Problems
+  /// that do not prevent sampling are added to `warnings()`.
+  bool open(std::string& error) {
+    for (auto& c : collectors_) {
+      if (!c->open(context_, error)) {
+        return false;
+      }
+    }
+    if (context_.batch_reads) {
+      open_batch();
+    }
+    return true;
+  }
+
+  /// Gather data sample. Fields of collectors that are not run are zero. If
+  /// `timings` is non-null, the duration of the i-th collector of `names()`
+  /// is recorded in `timings[i]`.
+  Sample sample(LatencyHistogram* timings = nullptr) {
+    if (context_.batch_reads) {
+      return sample_batch(timings);
+    }
+    Sample s{};
+    if (timings == nullptr) {
+      for (auto& c : collectors_) {
+        c->collect(s);
+      }
+      return s;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < collectors_.size(); i++) {
+      collectors_[i]->collect(s);
+      const auto end = std::chrono::steady_clock::now();
+      timings[i].record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          end - begin).count());
+      begin = end;
+    }
+    return s;
+  }
+
+  /// Names of the collectors that are run, in the order in which they are run
+  const std::vector<std::string>& names() const { return names_; }
+
+  /// Return true if per-CPU statistics since the previous sample are available
+  bool has_cpu_data() const { return context_.has_cpu_data; }
+
+  const std::vector<std::string>& warnings() const {
+    return context_.warnings;
+  }
+
+ private:
+  /// Set up the ring for batched reads and register the files of all
+  /// collectors with it, which stay the same for the lifetime of the sampler
+  void open_batch() {
+    std::vector<int> fds;
+    for (auto& c : collectors_) {
+      bool whole = true;
+      if (const ProcFile* file = c->source(whole)) {
+        fds.push_back(file->fd());
+      }
+    }
+    std::string error;
+    const auto entries = static_cast<unsigned>(std::max<std::size_t>(
+        fds.size(), 1));
+    if (!batch_.open(entries, error)) {
+      context_.warnings.push_back(error + ", reading files with read()");
+      return;
+    }
+    batch_.register_files(fds);
+  }
+
+  /// Gather data sample with the proc files of all collectors read in one
+  /// batch. Collectors without such a file are run first (e.g., the time,
+  /// which is thus taken before the files are read), the others parse their
+  /// file as soon as it has been read. With `timings`, the duration of a
+  /// collector spans from the previous completion to its own.
+  Sample sample_batch(LatencyHistogram* timings) {
+    Sample s{};
+    context_.has_cpu_data = false;
+    auto begin = std::chrono::steady_clock::now();
+    const auto record = [&](std::size_t i) {
+      if (timings != nullptr) {
+        const auto end = std::chrono::steady_clock::now();
+        timings[i].record(std::chrono::duration_cast<
+            std::chrono::nanoseconds>(end - begin).count());
+        begin = end;
+      }
+    };
+    for (std::size_t i = 0; i < collectors_.size(); i++) {
+      bool whole = true;
+      if (ProcFile* file = collectors_[i]->source(whole)) {
+        file->add_to(batch_, i);
+      } else {
+        collectors_[i]->collect(s);
+        record(i);
+      }
+    }
+    batch_.run([&](std::uint64_t i, long result) {
+      bool whole = true;
+      auto& c = *collectors_[i];
+      if (c.source(whole)->complete(result, whole)) {
+        c.parse(s);
+      }
+      record(i);
+    });
+    return s;
+  }
+
+  CollectorContext context_;
+  std::vector<std::unique_ptr<Collector>> collectors_;
+  std::vector<std::string> names_;
+  ReadBatch batch_;
+};
+
+} // namespace sss
+
+#endif // SSS_COLLECT_HPP
@@ -0,0 +1,287 @@
+#ifndef SSS_COLUMNAR_HPP
+#define SSS_COLUMNAR_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "sss-format.hpp"
+#include "sss-mmap.hpp"
+
+namespace sss {
+
+/// Columnar archives are directories with one file per sample field, such
+/// that a query only needs to read the fields it uses:
+///
+///   columns          Manifest (text): the line 'sss-columnar 1', a line
+///                    'rows ROWS block_rows BLOCK_ROWS', and one line
+///                    'NAME TYPE' per field (type 'i' or 'f', as in
+///                    `FieldInfo`). Written last, such that incomplete
+///                    archives are not mistaken for complete ones.
+///   NAME.values      ROWS values of 8 bytes (little-endian two's complement
+///                    integers or IEEE 754 doubles) in record order.
+///   NAME.zones       Zone map with three doubles (minimum, maximum, sum)
+///                    for each block of BLOCK_ROWS consecutive rows (the last
+///                    one may be shorter).
+///
+/// Zone maps allow queries to skip blocks that cannot match a condition
+/// (e.g., outside of a time range) and to aggregate whole blocks without
+/// reading their values.
+constexpr const char* columnar_magic = "sss-columnar 1";
+
+/// Default number of rows per block of a zone map
+constexpr std::size_t default_block_rows = 4096;
+
+/// Minimum, maximum, and sum of the values of a block
+struct Zone {
+  double min;
+  double max;
+  double sum;
+};
+
+
+/// Return true if values in memory are little-endian, such that columns can
+/// be used in place
+inline bool host_is_little_endian() {
+  const std::uint16_t value = 1;
+  char first;
+  std::memcpy(&first, &value, 1);
+  return first == 1;
+}
+
+
+/// Writes samples to a new columnar archive, one block at a time
+class ColumnarWriter {
+ public:
+  ColumnarWriter() = default;
+
+  ~ColumnarWriter() {
+    for (auto& c : columns_) {
+      if (c.values != nullptr) {
+        std::fclose(c.values);
+      }
+      if (c.zones != nullptr) {
+        std::fclose(c.zones);
+      }
+    }
+  }
+
+  ColumnarWriter(const ColumnarWriter&) = delete;
+  ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+  /// Create archive directory, return false on error (e.g., if it exists)
+  bool open(const std::string& path, std::string& error,
+            std::size_t block_rows = default_block_rows) {
+    path_ = path;
+    block_rows_ = block_rows;
+    if (::mkdir(path.c_str(), 0755) != 0) {
+      error = "could not create archive directory '" + path + "'";
+      return false;
+    }
+    for (const auto& f : sample_fields()) {
+      columns_.emplace_back();
+      auto& c = columns_.back();
+      c.field = &f;
+      c.values = std::fopen((path + "/" + f.name + ".values").c_str(), "wb");
+      c.zones = std::fopen((path + "/" + f.name + ".zones").c_str(), "wb");
+      if (c.values == nullptr || c.zones == nullptr) {
+        error = "could not create column files in '" + path + "'";
+        return false;
+      }
+      c.buffer.reserve(block_rows_ * 8);
+    }
+    return true;
+  }
+
+  /// Add sample, return false on error
+  bool add(const Sample& s) {
+    const auto base = reinterpret_cast<const char*>(&s);
+    for (auto& c : columns_) {
+      std::uint64_t raw;
+      std::memcpy(&raw, base + c.field->offset, sizeof(raw));
+      char value[8];
+      store_le64(raw, value);
+      c.buffer.insert(c.buffer.end(), value, value + sizeof(value));
+    }
+    rows_++;
+    return (rows_ % block_rows_ != 0) || write_block();
+  }
+
+  /// Write last block and manifest, return false on error
+  bool close(std::string& error) {
+    bool good = (rows_ % block_rows_ == 0) || write_block();
+    for (auto& c : columns_) {
+      good = (std::fclose(c.values) == 0) && good;
+      good = (std::fclose(c.zones) == 0) && good;
+      c.values = nullptr;
+      c.zones = nullptr;
+    }
+    std::ofstream manifest(path_ + "/columns");
+    manifest << columnar_magic << "\n"
+             << "rows " << rows_ << " block_rows " << block_rows_ << "\n";
+    for (const auto& c : columns_) {
+      manifest << c.field->name << " " << c.field->type << "\n";
+    }
+    manifest.close();
+    if (!good || !manifest.good()) {
+      error = "could not write archive '" + path_ + "'";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  struct Column {
+    const FieldInfo* field = nullptr;
+    std::FILE* values = nullptr;
+    std::FILE* zones = nullptr;
+    std::vector<char> buffer;
+  };
+
+  /// Write buffered values and their zone of all columns
+  bool write_block() {
+    bool good = true;
+    for (auto& c : columns_) {
+      const std::size_t n = c.buffer.size() / 8;
+      Zone zone = {0.0, 0.0, 0.0};
+      for (std::size_t i = 0; i < n; i++) {
+        const auto raw = load_le64(&c.buffer[8 * i]);
+        double value;
+        if (c.field->type == 'f') {
+          std::memcpy(&value, &raw, sizeof(value));
+        } else {
+          value = static_cast<double>(static_cast<Int>(raw));
+        }
+        zone.min = (i == 0 || value < zone.min) ? value : zone.min;
+        zone.max = (i == 0 || value > zone.max) ? value : zone.max;
+        zone.sum += value;
+      }
+      char encoded[sizeof(Zone)];
+      std::uint64_t raw;
+      std::memcpy(&raw, &zone.min, 8);
+      store_le64(raw, encoded);
+      std::memcpy(&raw, &zone.max, 8);
+      store_le64(raw, encoded + 8);
+      std::memcpy(&raw, &zone.sum, 8);
+      store_le64(raw, encoded + 16);
+      good = std::fwrite(c.buffer.data(), 1, c.buffer.size(), c.values)
+               == c.buffer.size()
+             && std::fwrite(encoded, 1, sizeof(encoded), c.zones)
+               == sizeof(encoded)
+             && good;
+      c.buffer.clear();
+    }
+    return good;
+  }
+
+  std::string path_;
+  std::size_t block_rows_ = default_block_rows;
+  std::uint64_t rows_ = 0;
+  std::vector<Column> columns_;
+};
+
+
+/// Read-only access to a columnar archive. Columns are mapped into memory on
+/// demand and used in place (little-endian hosts only).
+class ColumnarArchive {
+ public:
+  /// Read manifest, return false on error
+  bool open(const std::string& path, std::string& error) {
+    path_ = path;
+    std::ifstream in(path + "/columns");
+    std::string line;
+    std::string word;
+    if (!std::getline(in, line) || line != columnar_magic
+        || !(in >> word >> rows_) || word != "rows"
+        || !(in >> word >> block_rows_) || word != "block_rows"
+        || block_rows_ == 0) {
+      error = "'" + path + "' is not a columnar archive";
+      return false;
+    }
+    if (!host_is_little_endian()) {
+      error = "columnar archives require a little-endian host";
+      return false;
+    }
+    Column c;
+    while (in >> c.name >> c.type) {
+      columns_.push_back(std::move(c));
+      c = Column();
+    }
+    return true;
+  }
+
+  std::uint64_t rows() const { return rows_; }
+  std::uint64_t block_rows() const { return block_rows_; }
+  std::uint64_t blocks() const {
+    return (rows_ + block_rows_ - 1) / block_rows_;
+  }
+
+  /// Return index of column with the given name, or -1 if there is none
+  int find(const std::string& name) const {
+    for (std::size_t i = 0; i < columns_.size(); i++) {
+      if (columns_[i].name == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  /// Type of a column ('i' or 'f')
+  char type(int column) const { return columns_[column].type; }
+
+  /// Map values and zone map of a column, return false on error
+  bool map(int column, std::string& error) {
+    auto& c = columns_[column];
+    if (c.values.data() != nullptr || rows_ == 0) {
+      return true;
+    }
+    const auto base = path_ + "/" + c.name;
+    if (!c.values.open(base + ".values") || !c.zones.open(base + ".zones")
+        || c.values.size() != rows_ * 8
+        || c.zones.size() != blocks() * sizeof(Zone)) {
+      error = "column '" + c.name + "' of archive '" + path_
+              + "' is missing or truncated";
+      return false;
+    }
+    return true;
+  }
+
+  /// Values of a mapped column of integers
+  const Int* ints(int column) const {
+    return reinterpret_cast<const Int*>(columns_[column].values.data());
+  }
+
+  /// Values of a mapped column of floating point numbers
+  const Float* floats(int column) const {
+    return reinterpret_cast<const Float*>(columns_[column].values.data());
+  }
+
+  /// Zone of a block of a mapped column
+  Zone zone(int column, std::uint64_t block) const {
+    Zone z;
+    std::memcpy(&z, columns_[column].zones.data() + block * sizeof(Zone),
+                sizeof(z));
+    return z;
+  }
+
+ private:
+  struct Column {
+    std::string name;
+    char type = 'i';
+    MappedFile values;
+    MappedFile zones;
+  };
+
+  std::string path_;
+  std::uint64_t rows_ = 0;
+  std::uint64_t block_rows_ = 0;
+  std::vector<Column> columns_;
+};
+
+} // namespace sss
+
+#endif // SSS_COLUMNAR_HPP
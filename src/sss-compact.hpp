@@ -0,0 +1,138 @@
+#ifndef SSS_COMPACT_HPP
+#define SSS_COMPACT_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sss-block.hpp"
+#include "sss-format.hpp"
+#include "sss-index.hpp"
+#include "sss-reader.hpp"
+
+namespace sss {
+
+/// Suffix of the archives written by `compact_log_file()`
+constexpr const char* compacted_suffix = ".cmp";
+
+
+/// Rewrite a closed text or binary log file in compressed format with the
+/// fields of `layout`, appending the blocks to '<path>.cmp' and one index
+/// entry per block to its index, then remove the log file and its index.
+/// Compressed files are sequences of independent blocks, so a file name that
+/// recurs (e.g., 'server-%H.log') keeps adding to the same archive. Return
+/// false on error, in which case the archive is truncated to its previous
+/// size (or removed if it was new) and the log file is kept.
+inline bool compact_log_file(const std::string& path,
+                             const BinaryLayout& layout,
+                             std::size_t block_size, std::string& error) {
+  LogReader reader;
+  if (!reader.open(path)) {
+    error = reader.error();
+    return false;
+  }
+  if (reader.format() == Format::compressed) {
+    error = "'" + path + "' is already compressed";
+    return false;
+  }
+
+  // Open archive and check that it is compressed if it exists
+  const auto target = path + compacted_suffix;
+  const int fd = ::open(target.c_str(),
+                        O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  struct stat sb;
+  if (fd < 0 || fstat(fd, &sb) != 0) {
+    error = "could not open '" + target + "' for writing";
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+  const auto size = static_cast<std::uint64_t>(sb.st_size);
+  char magic[sizeof(block_magic)];
+  if (size > 0 && (::pread(fd, magic, sizeof(magic), 0) != sizeof(magic)
+                   || std::memcmp(magic, block_magic, sizeof(magic)) != 0)) {
+    ::close(fd);
+    error = "existing file '" + target + "' is not a compressed log file";
+    return false;
+  }
+  IndexWriter index;
+  if (!index.open(index_path(target), size)) {
+    ::close(fd);
+    error = "could not open index file '" + index_path(target)
+            + "' for writing";
+    return false;
+  }
+
+  // Encode and append blocks, adding an index entry for each
+  BlockEncoder encoder(block_size, layout);
+  std::string block;
+  Int block_timestamp = 0;
+  std::uint64_t position = size;
+  const auto write_block = [&]() {
+    if (encoder.empty()) {
+      return true;
+    }
+    index.add(block_timestamp, position);
+    block.clear();
+    encoder.finish(block);
+    const char* data = block.data();
+    std::size_t remaining = block.size();
+    while (remaining > 0) {
+      const auto n = ::write(fd, data, remaining);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      remaining -= static_cast<std::size_t>(n);
+    }
+    position += block.size();
+    return true;
+  };
+  bool good = true;
+  Sample s;
+  while (good && reader.next(s)) {
+    if (encoder.empty()) {
+      block_timestamp = s.timestamp;
+    }
+    good = !encoder.add(s) || write_block();
+  }
+  good = good && reader.error().empty() && write_block();
+
+  // The log file is only removed once the archive is on disk. Index entries
+  // are discarded on error, since they are only written by `flush()`.
+  good = good && ::fsync(fd) == 0 && index.flush();
+  if (!good) {
+    error = reader.error().empty()
+            ? "could not write to '" + target + "'" : reader.error();
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      error += " (and could not truncate it)";
+    }
+    ::close(fd);
+    if (size == 0) {
+      index.close();
+      std::remove(target.c_str());
+      std::remove(index_path(target).c_str());
+    }
+    return false;
+  }
+  ::close(fd);
+  std::remove(index_path(path).c_str());
+  if (std::remove(path.c_str()) != 0) {
+    error = "could not remove '" + path + "' after compaction";
+    return false;
+  }
+  return true;
+}
+
+} // namespace sss
+
+#endif // SSS_COMPACT_HPP
@@ -0,0 +1,292 @@
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "sss-block.hpp"
+#include "sss-columnar.hpp"
+#include "sss-format.hpp"
+#include "sss-reader.hpp"
+#include "sss-time.hpp"
+
+using sss::Format;
+using sss::Int;
+using sss::Sample;
+
+namespace {
+  /// Values for long options without a short equivalent
+  enum LongOption {
+    OPT_FROM = 256,
+    OPT_UNTIL,
+  };
+
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    bool has_format = false;
+    Format format = Format::text;
+    bool columnar = false;
+    std::string output_file;
+    std::vector<std::string> input_files;
+    Int from = std::numeric_limits<Int>::min();
+    Int until = std::numeric_limits<Int>::max();
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-convert [-h] [-t FORMAT] [-o OUTPUT] [--from TIME]\n"
+     << "                   [--until TIME] [INPUT...]\n"
+     << "\n"
+     << "sss-convert reads log files written by sss-mon and writes their\n"
+     << "records in the requested format. The format of each input file is\n"
+     << "detected automatically. Records of ring files (see '--max-records'\n"
+     << "in sss-mon) are read from the oldest to the newest record.\n"
+     << "\n"
+     << "positional arguments:\n"
+     << "  INPUT                 Log files to read, in order. If omitted or\n"
+     << "                        '-', data is read from stdin.\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  --from TIME           Only convert records with a timestamp at or\n"
+     << "                        after TIME, either a Unix timestamp in\n"
+     << "                        milliseconds or a duration before now\n"
+     << "                        (e.g., '-1h'; units: ms, s, m, h, d).\n"
+     << "                        Binary and ring files, as well as files\n"
+     << "                        with an index (see '--index-interval' in\n"
+     << "                        sss-mon), are not read from the beginning.\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  -o, --output OUTPUT   Write to OUTPUT instead of stdout.\n"
+     << "  -t, --to FORMAT       Output format, either 'text', 'binary',\n"
+     << "                        'compressed', or 'columnar'. By default,\n"
+     << "                        text input is converted to binary and all\n"
+     << "                        other input to text. Columnar archives are\n"
+     << "                        directories with one file per field and\n"
+     << "                        zone maps for sss-query. They require\n"
+     << "                        '--output' with a directory that does not\n"
+     << "                        exist yet.\n"
+     << "  --until TIME          Only convert records with a timestamp before\n"
+     << "                        TIME (same format as for '--from').\n";
+  os.flush();
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+  const Int now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"from", required_argument, nullptr, OPT_FROM},
+      {"help", no_argument, nullptr, 'h'},
+      {"output", required_argument, nullptr, 'o'},
+      {"to", required_argument, nullptr, 't'},
+      {"until", required_argument, nullptr, OPT_UNTIL},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "ho:t:", long_options, nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Set output file
+      case 'o':
+        {
+          args.output_file = optarg;
+          break;
+        }
+
+      // Set output format
+      case 't':
+        {
+          args.columnar = (std::string(optarg) == "columnar");
+          if (!args.columnar && !sss::parse_format(optarg, args.format)) {
+            std::cerr << "error: argument to '-t|--to' (" << optarg
+                      << ") is not a valid format" << std::endl;
+            exit(2);
+          }
+          args.has_format = true;
+          break;
+        }
+
+      // Set time range
+      case OPT_FROM:
+      case OPT_UNTIL:
+        {
+          auto& timestamp = (c == OPT_FROM) ? args.from : args.until;
+          if (!sss::parse_time_point(optarg, now, timestamp)) {
+            std::cerr << "error: argument to '"
+                      << (c == OPT_FROM ? "--from" : "--until") << "' ("
+                      << optarg << ") is not a valid time" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // Remaining arguments are input files
+  for (int i = optind; i < argc; i++) {
+    args.input_files.push_back(argv[i]);
+  }
+  if (args.input_files.empty()) {
+    args.input_files.push_back("-");
+  }
+
+  // Columnar archives are directories
+  if (args.columnar && args.output_file.empty()) {
+    std::cerr << "error: columnar output requires '-o|--output'"
+              << std::endl;
+    exit(2);
+  }
+
+  return args;
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  auto args = parse_arguments(argc, argv);
+
+  // Set output stream to use
+  std::ofstream output_file;
+  sss::ColumnarWriter columnar;
+  if (args.columnar) {
+    std::string error;
+    if (!columnar.open(args.output_file, error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+  } else if (!args.output_file.empty()) {
+    output_file.open(args.output_file,
+                     std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!output_file.good()) {
+      std::cerr << "error: could not open output file '" << args.output_file
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+  }
+  std::ostream os(args.output_file.empty() ? std::cout.rdbuf()
+                                           : output_file.rdbuf());
+
+  // Prepare binary and compressed output
+  const sss::BinaryLayout layout;
+  std::vector<char> record(layout.record_size());
+  sss::BlockEncoder encoder(sss::default_block_samples);
+  std::string block;
+
+  // Convert all input files in order
+  Sample s;
+  for (std::size_t i = 0; i < args.input_files.size(); i++) {
+    sss::LogReader reader;
+    if (!reader.open(args.input_files[i])) {
+      std::cerr << "error: " << reader.error() << std::endl;
+      std::exit(1);
+    }
+
+    // Determine output format from the first input file if not given and
+    // write header for binary output
+    if (i == 0) {
+      if (!args.has_format) {
+        args.format = (reader.format() == Format::text) ? Format::binary
+                                                        : Format::text;
+      }
+      if (args.format == Format::binary) {
+        const auto header = layout.header();
+        os.write(header.data(), static_cast<std::streamsize>(header.size()));
+      }
+    }
+
+    // Convert records in the requested time range
+    if (args.from != std::numeric_limits<Int>::min()) {
+      reader.seek(args.from);
+    }
+    while (reader.next(s)) {
+      if (s.timestamp < args.from) {
+        continue;
+      }
+      if (s.timestamp >= args.until) {
+        break;
+      }
+      if (args.columnar) {
+        if (!columnar.add(s)) {
+          std::cerr << "error: could not write archive '" << args.output_file
+                    << "'" << std::endl;
+          std::exit(1);
+        }
+      } else if (args.format == Format::binary) {
+        layout.encode(s, &record[0]);
+        os.write(record.data(), static_cast<std::streamsize>(record.size()));
+      } else if (args.format == Format::compressed) {
+        if (encoder.add(s)) {
+          block.clear();
+          encoder.finish(block);
+          os.write(block.data(), static_cast<std::streamsize>(block.size()));
+        }
+      } else {
+        sss::write_text(os, s);
+        os << '\n';
+      }
+    }
+    if (!reader.error().empty()) {
+      std::cerr << "error: " << reader.error() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  // Write last (partial) block
+  if (args.columnar) {
+    std::string error;
+    if (!columnar.close(error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    return 0;
+  }
+  block.clear();
+  encoder.finish(block);
+  os.write(block.data(), static_cast<std::streamsize>(block.size()));
+
+  os.flush();
+  if (!os.good()) {
+    std::cerr << "error: could not write output" << std::endl;
+    std::exit(1);
+  }
+}
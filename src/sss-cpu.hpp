@@ -0,0 +1,359 @@
+#ifndef SSS_CPU_HPP
+#define SSS_CPU_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+#include "sss-format.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Parse CPU list as used in sysfs (e.g., '0-3,8,10-11') and call `f` for
+/// each CPU id
+template <typename F>
+inline void for_each_in_cpu_list(const std::string& list, F f) {
+  Scanner l(list.data(), list.data() + list.size());
+  while (!l.at_end()) {
+    const Int first = l.parse_int();
+    if (!l.good()) {
+      break;
+    }
+    Int last = first;
+    if (l.consume("-", 1)) {
+      last = l.parse_int();
+    }
+    for (Int cpu = first; cpu <= last; cpu++) {
+      f(cpu);
+    }
+    if (!l.consume(",", 1)) {
+      break;
+    }
+  }
+}
+
+/// Read first line of a (small) file, return empty string on error
+inline std::string read_first_line(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+
+/// Per-CPU time counters from /proc/stat in a struct-of-arrays layout. All
+/// arrays are sized once at startup for all possible CPUs, such that updating
+/// and computing utilization does not allocate memory and the inner loops run
+/// over contiguous memory (and can be vectorized by the compiler).
+class CpuTable {
+ public:
+  /// Number of time counters per CPU in /proc/stat
+  static constexpr int num_counters = 10;
+
+  /// Indices of counters
+  enum Counter {
+    user, nice, system, idle, iowait, irq, softirq, steal, guest, guest_nice
+  };
+
+  /// Number of utilization values per CPU/node
+  static constexpr int num_utilizations = 6;
+
+  /// Maximum length of an output line (timestamp, name, and values)
+  static constexpr std::size_t max_line_length =
+      2 * 24 + 4 + num_utilizations * 25 + 1;
+
+  /// Size tables for all possible CPUs. If `numa` is true, CPUs are
+  /// additionally mapped to their NUMA nodes from `sys_root` (usually
+  /// '/sys/devices/system').
+  CpuTable(const std::string& sys_root, bool numa) {
+    // Determine number of possible CPUs
+    Int num_cpus = 0;
+    for_each_in_cpu_list(read_first_line(sys_root + "/cpu/possible"),
+                         [&](Int cpu) {
+                           num_cpus = (cpu + 1 > num_cpus) ? cpu + 1
+                                                            : num_cpus;
+                         });
+    if (num_cpus == 0) {
+      num_cpus = 1;
+    }
+    num_cpus_ = static_cast<std::size_t>(num_cpus);
+
+    for (int k = 0; k < num_counters; k++) {
+      current_[k].assign(num_cpus_, 0);
+      previous_[k].assign(num_cpus_, 0);
+      delta_[k].assign(num_cpus_, 0.0);
+    }
+    present_.assign(num_cpus_, 0);
+    was_present_.assign(num_cpus_, 0);
+    total_.assign(num_cpus_, 0.0);
+    for (auto& u : utilization_) {
+      u.assign(num_cpus_, 0.0);
+    }
+
+    // Map CPUs to NUMA nodes
+    if (numa) {
+      read_numa_nodes(sys_root + "/node");
+    }
+
+    // Buffer for formatted output (one line per CPU and node)
+    output_.resize(max_line_length * (num_cpus_ + node_ids_.size()));
+  }
+
+  /// Parse per-CPU lines of /proc/stat and compute utilization since the
+  /// previous call. Return false if there is no previous data.
+  bool update(const char* begin, const char* end) {
+    // Keep previous values
+    for (int k = 0; k < num_counters; k++) {
+      current_[k].swap(previous_[k]);
+    }
+    present_.swap(was_present_);
+    std::fill(present_.begin(), present_.end(), 0);
+
+    // Parse all lines of the form 'cpuN ...'
+    for (Scanner l(begin, end); !l.at_end(); l.skip_line()) {
+      if (!l.consume("cpu", 3)) {
+        // All cpu lines are at the beginning of the file
+        if (l.position() != begin) {
+          break;
+        }
+        continue;
+      }
+      if (l.at_end() || *l.position() < '0' || *l.position() > '9') {
+        continue;
+      }
+      const auto cpu = static_cast<std::size_t>(l.parse_int());
+      if (cpu >= num_cpus_) {
+        continue;
+      }
+      for (int k = 0; k < num_counters; k++) {
+        current_[k][cpu] = l.parse_int();
+      }
+      present_[cpu] = 1;
+    }
+
+    if (!has_previous_) {
+      has_previous_ = true;
+      return false;
+    }
+    compute();
+    return true;
+  }
+
+  /// Write one line per CPU (and NUMA node) with the utilization since the
+  /// previous update and optionally flush the file. Return false on write
+  /// errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) {
+    char* p = output_.data();
+    for (std::size_t i = 0; i < num_cpus_; i++) {
+      if (present_[i] && was_present_[i]) {
+        p = append_line(p, timestamp, "cpu", static_cast<Int>(i),
+                        utilization_, i);
+      }
+    }
+    for (std::size_t n = 0; n < node_ids_.size(); n++) {
+      p = append_line(p, timestamp, "node", node_ids_[n], node_utilization_,
+                      n);
+    }
+    const auto size = static_cast<std::size_t>(p - output_.data());
+    return std::fwrite(output_.data(), 1, size, file) == size
+           && (!flush || std::fflush(file) == 0);
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp cpu util_user util_system util_nice util_idle "
+           "util_iowait util_steal\n";
+  }
+
+  std::size_t num_cpus() const { return num_cpus_; }
+  std::size_t num_nodes() const { return node_ids_.size(); }
+
+ private:
+  /// Append value with three decimal places (same as '%.3f' for values of
+  /// reasonable magnitude)
+  static char* append_fixed3(char* p, Float value) {
+    auto thousandths = static_cast<Int>(std::llround(value * 1000));
+    if (thousandths < 0) {
+      *p++ = '-';
+      thousandths = -thousandths;
+    }
+    p = append_int(p, thousandths / 1000);
+    const auto fraction = thousandths % 1000;
+    *p++ = '.';
+    *p++ = static_cast<char>('0' + fraction / 100);
+    *p++ = static_cast<char>('0' + fraction / 10 % 10);
+    *p++ = static_cast<char>('0' + fraction % 10);
+    return p;
+  }
+
+  /// Append one output line, e.g., 'TIMESTAMP cpu3 0.120 ...'
+  static char* append_line(char* p, Int timestamp, const char* prefix, Int id,
+                           const std::vector<Float>* utilization,
+                           std::size_t index) {
+    p = append_int(p, timestamp);
+    *p++ = ' ';
+    while (*prefix != '\0') {
+      *p++ = *prefix++;
+    }
+    p = append_int(p, id);
+    for (int u = 0; u < num_utilizations; u++) {
+      *p++ = ' ';
+      p = append_fixed3(p, utilization[u][index]);
+    }
+    *p++ = '\n';
+    return p;
+  }
+
+  /// Compute per-CPU (and per-node) utilization from counter deltas
+  void compute() {
+    const std::size_t n = num_cpus_;
+
+    // Counter deltas
+    for (int k = 0; k < num_counters; k++) {
+      const Int* const cur = current_[k].data();
+      const Int* const prev = previous_[k].data();
+      Float* const delta = delta_[k].data();
+      for (std::size_t i = 0; i < n; i++) {
+        delta[i] = static_cast<Float>(cur[i] - prev[i]);
+      }
+    }
+
+    // Aggregate deltas as in sss-extract: guest time is already contained in
+    // user/nice time
+    const Float* const d_user = delta_[user].data();
+    const Float* const d_nice = delta_[nice].data();
+    const Float* const d_system = delta_[system].data();
+    const Float* const d_idle = delta_[idle].data();
+    const Float* const d_iowait = delta_[iowait].data();
+    const Float* const d_irq = delta_[irq].data();
+    const Float* const d_softirq = delta_[softirq].data();
+    const Float* const d_steal = delta_[steal].data();
+    const Float* const d_guest = delta_[guest].data();
+    const Float* const d_guest_nice = delta_[guest_nice].data();
+    Float* const total = total_.data();
+    for (std::size_t i = 0; i < n; i++) {
+      total[i] = d_user[i] + d_nice[i] + d_system[i] + d_idle[i]
+                 + d_iowait[i] + d_irq[i] + d_softirq[i] + d_steal[i];
+    }
+    utilization(d_user, d_guest, nullptr, total, utilization_[0].data(), n);
+    utilization(d_system, d_irq, d_softirq, total, utilization_[1].data(), n,
+                true);
+    utilization(d_nice, d_guest_nice, nullptr, total, utilization_[2].data(),
+                n);
+    utilization(d_idle, d_iowait, nullptr, total, utilization_[3].data(), n,
+                true);
+    utilization(d_iowait, nullptr, nullptr, total, utilization_[4].data(), n);
+    utilization(d_steal, nullptr, nullptr, total, utilization_[5].data(), n);
+
+    // Aggregate per NUMA node
+    if (node_ids_.empty()) {
+      return;
+    }
+    std::fill(node_total_.begin(), node_total_.end(), 0.0);
+    for (auto& u : node_utilization_) {
+      std::fill(u.begin(), u.end(), 0.0);
+    }
+    for (std::size_t i = 0; i < n; i++) {
+      const auto node = cpu_node_[i];
+      if (node < 0 || !present_[i] || !was_present_[i]) {
+        continue;
+      }
+      node_total_[node] += total[i];
+      for (int u = 0; u < num_utilizations; u++) {
+        node_utilization_[u][node] += utilization_[u][i] * total[i];
+      }
+    }
+    for (std::size_t node = 0; node < node_ids_.size(); node++) {
+      const Float scale = (node_total_[node] > 0) ? 1 / node_total_[node] : 0;
+      for (int u = 0; u < num_utilizations; u++) {
+        node_utilization_[u][node] *= scale;
+      }
+    }
+  }
+
+  /// Compute (a - b) / total or, if `add` is true, (a + b + c) / total
+  static void utilization(const Float* a, const Float* b, const Float* c,
+                          const Float* total, Float* result, std::size_t n,
+                          bool add = false) {
+    for (std::size_t i = 0; i < n; i++) {
+      const Float scale = (total[i] > 0) ? 1 / total[i] : 0;
+      Float value = a[i];
+      if (b != nullptr) {
+        value += add ? b[i] : -b[i];
+      }
+      if (c != nullptr) {
+        value += c[i];
+      }
+      result[i] = value * scale;
+    }
+  }
+
+  /// Map CPUs to NUMA nodes using the cpulist file of each node directory
+  void read_numa_nodes(const std::string& node_root) {
+    cpu_node_.assign(num_cpus_, -1);
+    DIR* dir = opendir(node_root.c_str());
+    if (dir == nullptr) {
+      return;
+    }
+    std::vector<Int> nodes;
+    for (dirent* e = readdir(dir); e != nullptr; e = readdir(dir)) {
+      const std::string name = e->d_name;
+      if (name.compare(0, 4, "node") == 0 && name.size() > 4
+          && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+        nodes.push_back(std::stoll(name.substr(4)));
+      }
+    }
+    closedir(dir);
+    std::sort(nodes.begin(), nodes.end());
+
+    for (const auto node : nodes) {
+      const auto index = static_cast<int>(node_ids_.size());
+      node_ids_.push_back(node);
+      for_each_in_cpu_list(
+          read_first_line(node_root + "/node" + std::to_string(node)
+                          + "/cpulist"),
+          [&](Int cpu) {
+            if (cpu >= 0 && static_cast<std::size_t>(cpu) < num_cpus_) {
+              cpu_node_[static_cast<std::size_t>(cpu)] = index;
+            }
+          });
+    }
+    node_total_.assign(node_ids_.size(), 0.0);
+    for (auto& u : node_utilization_) {
+      u.assign(node_ids_.size(), 0.0);
+    }
+  }
+
+  std::size_t num_cpus_ = 0;
+  bool has_previous_ = false;
+
+  // Counters of current and previous update, one array per counter
+  std::vector<Int> current_[num_counters];
+  std::vector<Int> previous_[num_counters];
+  std::vector<char> present_;
+  std::vector<char> was_present_;
+
+  // Deltas and derived utilization, one array per value
+  std::vector<Float> delta_[num_counters];
+  std::vector<Float> total_;
+  std::vector<Float> utilization_[num_utilizations];
+
+  // NUMA nodes
+  std::vector<int> cpu_node_;
+  std::vector<Int> node_ids_;
+  std::vector<Float> node_total_;
+  std::vector<Float> node_utilization_[num_utilizations];
+
+  // Output buffer
+  std::vector<char> output_;
+};
+
+} // namespace sss
+
+#endif // SSS_CPU_HPP
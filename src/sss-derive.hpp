@@ -0,0 +1,226 @@
+#ifndef SSS_DERIVE_HPP
+#define SSS_DERIVE_HPP
+
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Values derived from two consecutive samples: gauges of the newer sample,
+/// utilization fractions of CPU time, and per-second rates of all other
+/// counters
+struct Derived {
+  Int timestamp = 0;
+  Int interval = 0;
+  Float cpu_load_1m = 0.0;
+  Float cpu_load_5m = 0.0;
+  Float cpu_load_15m = 0.0;
+  Float cpu_user = 0.0;
+  Float cpu_system = 0.0;
+  Float cpu_nice = 0.0;
+  Float cpu_idle = 0.0;
+  Float cpu_iowait = 0.0;
+  Float cpu_steal = 0.0;
+  Int memory_total = 0;
+  Int memory_used = 0;
+  Int swap_total = 0;
+  Int swap_used = 0;
+  Int disk_total = 0;
+  Int disk_used = 0;
+  Int disk_available = 0;
+  Float network_received = 0.0;
+  Float network_sent = 0.0;
+  Float io_reads = 0.0;
+  Float io_read_bytes = 0.0;
+  Float io_writes = 0.0;
+  Float io_written_bytes = 0.0;
+  Float io_utilization = 0.0;
+  Float io_latency = 0.0;
+};
+
+
+/// All derived fields in the order in which they are written, with their
+/// descriptions. Each entry has the form X(type, name, description).
+#define SSS_DERIVED_FIELDS(X) \
+  X(Int, timestamp, "Unix timestamp of the newer sample (in milliseconds).") \
+  X(Int, interval, "Time between the two samples (in milliseconds, from " \
+                   "the steady clock).") \
+  X(Float, cpu_load_1m, "CPU load average (1 minute average).") \
+  X(Float, cpu_load_5m, "CPU load average (5 minute average).") \
+  X(Float, cpu_load_15m, "CPU load average (15 minute average).") \
+  X(Float, cpu_user, "Fraction of CPU time in user mode (without guests).") \
+  X(Float, cpu_system, "Fraction of CPU time in system mode, including " \
+                       "interrupts.") \
+  X(Float, cpu_nice, "Fraction of CPU time in user mode with low " \
+                     "priority.") \
+  X(Float, cpu_idle, "Fraction of idle CPU time, including iowait.") \
+  X(Float, cpu_iowait, "Fraction of CPU time waiting for I/O (included in " \
+                       "cpu_idle).") \
+  X(Float, cpu_steal, "Fraction of CPU time stolen by the hypervisor.") \
+  X(Int, memory_total, "Total usable RAM (in bytes).") \
+  X(Int, memory_used, "Memory currently in use (in bytes).") \
+  X(Int, swap_total, "Total amount of swap space (in bytes).") \
+  X(Int, swap_used, "Swap space currently in use (in bytes).") \
+  X(Int, disk_total, "Total usable disk space (in bytes).") \
+  X(Int, disk_used, "Disk space currently in use (in bytes).") \
+  X(Int, disk_available, "Disk space available for non-privileged users " \
+                         "(in bytes).") \
+  X(Float, network_received, "Bytes received per second.") \
+  X(Float, network_sent, "Bytes sent per second.") \
+  X(Float, io_reads, "Reads completed per second.") \
+  X(Float, io_read_bytes, "Bytes read per second.") \
+  X(Float, io_writes, "Writes completed per second.") \
+  X(Float, io_written_bytes, "Bytes written per second.") \
+  X(Float, io_utilization, "Fraction of time the block devices were busy " \
+                           "(added up over devices).") \
+  X(Float, io_latency, "Average time per read or write, including " \
+                       "queueing (in milliseconds).")
+
+
+/// Description of a derived field
+struct DerivedFieldInfo {
+  const char* name;
+  const char* description;
+};
+
+/// Derived fields in the order in which they are written
+inline const std::vector<DerivedFieldInfo>& derived_fields() {
+#define SSS_DERIVED_FIELD_INFO(type, name, description) {#name, description},
+  static const std::vector<DerivedFieldInfo> fields = {
+    SSS_DERIVED_FIELDS(SSS_DERIVED_FIELD_INFO)
+  };
+#undef SSS_DERIVED_FIELD_INFO
+  return fields;
+}
+
+
+/// Find derived field by name, return false if there is none
+inline bool find_derived_field(const std::string& name, std::size_t& index) {
+  const auto& fields = derived_fields();
+  for (index = 0; index < fields.size(); index++) {
+    if (name == fields[index].name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/// Value of the i-th derived field (in the order of `derived_fields()`)
+inline Float derived_value(const Derived& d, std::size_t i) {
+  using Accessor = Float (*)(const Derived&);
+#define SSS_DERIVED_ACCESSOR(type, name, description) \
+  [](const Derived& d) { return static_cast<Float>(d.name); },
+  static const Accessor accessors[] = {
+    SSS_DERIVED_FIELDS(SSS_DERIVED_ACCESSOR)
+  };
+#undef SSS_DERIVED_ACCESSOR
+  return accessors[i](d);
+}
+
+
+/// Increase of a counter between two samples. A decrease means that the
+/// counter was reset (e.g., an interface or device was re-created or removed
+/// from the selection), and the increase is unknown, which is treated as
+/// zero. Since the counters are sums over many interfaces, devices, or CPUs,
+/// a wrap-around of one of them cannot be told from a reset and is treated
+/// the same way.
+inline Int counter_delta(Int previous, Int current) {
+  return (current >= previous) ? current - previous : 0;
+}
+
+
+/// Derive values from two consecutive samples that are `interval`
+/// milliseconds apart. If the interval is not positive, all rates and
+/// fractions are zero.
+inline Derived derive(const Sample& previous, const Sample& current,
+                      Int interval) {
+  Derived d;
+  d.timestamp = current.timestamp;
+  d.interval = interval;
+  d.cpu_load_1m = current.cpu_load_1m;
+  d.cpu_load_5m = current.cpu_load_5m;
+  d.cpu_load_15m = current.cpu_load_15m;
+  d.memory_total = current.memory_total;
+  d.memory_used = current.memory_used;
+  d.swap_total = current.swap_total;
+  d.swap_used = current.swap_used;
+  d.disk_total = current.disk_total;
+  d.disk_used = current.disk_used;
+  d.disk_available = current.disk_available;
+  if (interval <= 0) {
+    return d;
+  }
+  const auto delta = [&](Int Sample::* field) {
+    return counter_delta(previous.*field, current.*field);
+  };
+
+  // CPU utilization (user, system, nice, idle; all in time fraction), where
+  // guest time is already included in user and nice time
+  // Source: http://stackoverflow.com/a/23376195/1329844 @ 20160113
+  const Int guest = delta(&Sample::cpu_time_guest);
+  const Int guest_nice = delta(&Sample::cpu_time_guest_nice);
+  const Int user = delta(&Sample::cpu_time_user) - guest;
+  const Int nice = delta(&Sample::cpu_time_nice) - guest_nice;
+  const Int system = delta(&Sample::cpu_time_system)
+                     + delta(&Sample::cpu_time_irq)
+                     + delta(&Sample::cpu_time_softirq);
+  const Int iowait = delta(&Sample::cpu_time_iowait);
+  const Int idle = delta(&Sample::cpu_time_idle) + iowait;
+  const Int steal = delta(&Sample::cpu_time_steal);
+  const Int total = user + nice + system + idle + steal + guest + guest_nice;
+  if (total > 0) {
+    const auto t = static_cast<Float>(total);
+    d.cpu_user = user / t;
+    d.cpu_system = system / t;
+    d.cpu_nice = nice / t;
+    d.cpu_idle = idle / t;
+    d.cpu_iowait = iowait / t;
+    d.cpu_steal = steal / t;
+  }
+
+  // Rates per second
+  const Float seconds = interval / 1000.0;
+  const auto rate = [&](Int Sample::* field, Int factor) {
+    return static_cast<Float>(delta(field) * factor) / seconds;
+  };
+  d.network_received = rate(&Sample::network_received, 1);
+  d.network_sent = rate(&Sample::network_sent, 1);
+  d.io_reads = rate(&Sample::io_reads, 1);
+  d.io_read_bytes = rate(&Sample::io_sectors_read, 512);
+  d.io_writes = rate(&Sample::io_writes, 1);
+  d.io_written_bytes = rate(&Sample::io_sectors_written, 512);
+  d.io_utilization = static_cast<Float>(delta(&Sample::io_time)) / interval;
+  const Int ios = delta(&Sample::io_reads) + delta(&Sample::io_writes);
+  if (ios > 0) {
+    d.io_latency = static_cast<Float>(delta(&Sample::io_time_weighted)) / ios;
+  }
+  return d;
+}
+
+
+/// Write derived values as a single line of space-separated text (with
+/// newline), fractions and rates with three decimals
+inline std::string format_derived(const Derived& d) {
+  std::string line;
+  char buffer[64];
+#define SSS_FORMAT_DERIVED(type, name, description) \
+  line += line.empty() ? "" : " "; \
+  line.append(buffer, static_cast<std::size_t>( \
+      std::is_same<type, Float>::value \
+      ? std::snprintf(buffer, sizeof(buffer), "%1.3f", \
+                      static_cast<double>(d.name)) \
+      : std::snprintf(buffer, sizeof(buffer), "%lld", \
+                      static_cast<long long>(d.name))));
+  SSS_DERIVED_FIELDS(SSS_FORMAT_DERIVED)
+#undef SSS_FORMAT_DERIVED
+  return line + "\n";
+}
+
+} // namespace sss
+
+#endif // SSS_DERIVE_HPP
@@ -0,0 +1,359 @@
+#ifndef SSS_DISK_HPP
+#define SSS_DISK_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "sss-format.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Directory with the block devices in the sysfs next to a proc filesystem
+/// (e.g., /sys/class/block for /proc, /host/sys/class/block for /host/proc),
+/// such that synthetic files of tests and benchmarks are not classified by
+/// the devices of this host
+inline std::string block_root(std::string proc_root) {
+  while (proc_root.size() > 1 && proc_root.back() == '/') {
+    proc_root.pop_back();
+  }
+  const auto slash = proc_root.find_last_of('/');
+  const auto root = (slash == std::string::npos)
+                    ? std::string(".") : proc_root.substr(0, slash);
+  return root + "/sys/class/block";
+}
+
+
+/// I/O counters of block devices from /proc/diskstats for all devices that
+/// match one of a list of patterns (shell wildcards or 'all'), gathered in a
+/// single pass over the file. Without patterns, all whole disks are selected,
+/// i.e., all devices except partitions and loop, ram, zram, and device mapper
+/// devices, such that no I/O is counted twice. Partitions are recognized by
+/// their attributes in `block_root` (usually '/sys/class/block'), or by their
+/// names if it is empty or does not exist. As for NetworkTable, which line
+/// belongs to which device is cached and only re-determined if the set of
+/// devices changes.
+class DiskTable {
+ public:
+  /// Number of counters per device
+  static constexpr int num_counters = 6;
+
+  /// Indices of counters
+  enum Counter {
+    reads, sectors_read, writes, sectors_written, io_time, io_time_weighted
+  };
+
+  DiskTable(const std::vector<std::string>& patterns,
+            const std::string& block_root)
+    : patterns_(patterns), block_root_(block_root) {
+    // Room for typical hosts, such that sampling does not allocate memory
+    line_names_.reserve(64);
+    line_selected_.reserve(64);
+    names_.reserve(64);
+    counters_.reserve(64 * num_counters);
+  }
+
+  /// Parse contents of /proc/diskstats
+  void update(const char* begin, const char* end) {
+    std::size_t line = 0;
+    std::size_t slot = 0;
+    bool changed = false;
+    for (const char* p = begin; p < end; line++) {
+      const char* eol = static_cast<const char*>(
+          std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+      eol = (eol == nullptr) ? end : eol;
+
+      // Lines have the form 'MAJOR MINOR NAME COUNTERS...'
+      Scanner l(p, eol);
+      l.skip_word();
+      l.skip_word();
+      l.skip_spaces();
+      const char* const name = l.position();
+      l.skip_word();
+      const auto length = static_cast<std::size_t>(l.position() - name);
+
+      // Look up line in the cache, and match name if it is not the same
+      // as in the previous update
+      if (changed || line >= line_names_.size()
+          || line_names_[line].size() != length
+          || std::memcmp(line_names_[line].data(), name, length) != 0) {
+        changed = true;
+        line_names_.resize(line);
+        line_names_.emplace_back(name, length);
+        const bool selected = length > 0 && selects(line);
+        line_selected_.resize(line);
+        line_selected_.push_back(selected);
+        if (selected) {
+          names_.resize(slot);
+          names_.push_back(line_names_.back());
+          counters_.resize(num_counters * (slot + 1));
+        }
+      }
+
+      // Counters: reads completed, reads merged, sectors read, time reading,
+      // writes completed, writes merged, sectors written, time writing, I/Os
+      // in progress, time doing I/O, weighted time doing I/O
+      if (line_selected_[line]) {
+        Int values[11];
+        for (auto& v : values) {
+          v = l.parse_int();
+        }
+        Int* const c = &counters_[num_counters * slot];
+        c[reads] = values[0];
+        c[sectors_read] = values[2];
+        c[writes] = values[4];
+        c[sectors_written] = values[6];
+        c[io_time] = values[9];
+        c[io_time_weighted] = values[10];
+        slot++;
+      }
+      p = eol + 1;
+    }
+
+    // Devices at the end may have disappeared
+    if (changed || line != line_names_.size()) {
+      line_names_.resize(line);
+      line_selected_.resize(line);
+      names_.resize(slot);
+      counters_.resize(num_counters * slot);
+    }
+  }
+
+  /// Number of selected devices
+  std::size_t size() const { return names_.size(); }
+
+  /// Counter of the i-th selected device
+  Int counter(std::size_t i, Counter c) const {
+    return counters_[num_counters * i + c];
+  }
+
+  /// Sum of a counter over all selected devices
+  Int total(Counter c) const {
+    Int sum = 0;
+    for (std::size_t i = 0; i < size(); i++) {
+      sum += counter(i, c);
+    }
+    return sum;
+  }
+
+  /// Patterns that do not match any device
+  std::vector<std::string> unmatched() const {
+    std::vector<std::string> result;
+    for (const auto& pattern : patterns_) {
+      bool found = false;
+      for (const auto& name : names_) {
+        found = found || matches(pattern, name);
+      }
+      if (!found) {
+        result.push_back(pattern);
+      }
+    }
+    return result;
+  }
+
+  /// Write one line per selected device with its counters and optionally
+  /// flush the file. Return false on write errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) {
+    output_.resize(size() * max_line_length);
+    char* p = &output_[0];
+    for (std::size_t i = 0; i < size(); i++) {
+      p = append_int(p, timestamp);
+      *p++ = ' ';
+      std::memcpy(p, names_[i].data(), names_[i].size());
+      p += names_[i].size();
+      for (int k = 0; k < num_counters; k++) {
+        *p++ = ' ';
+        p = append_int(p, counters_[num_counters * i + k]);
+      }
+      *p++ = '\n';
+    }
+    const auto size = static_cast<std::size_t>(p - output_.data());
+    return std::fwrite(output_.data(), 1, size, file) == size
+           && (!flush || std::fflush(file) == 0);
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp device reads sectors_read writes sectors_written "
+           "io_time io_time_weighted\n";
+  }
+
+ private:
+  /// Device names are limited to 32 characters, counters to 20 digits
+  static constexpr std::size_t max_line_length = 256;
+
+  static bool matches(const std::string& pattern, const std::string& name) {
+    return pattern == "all" || fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+  }
+
+  /// Return true if the device of the given line is selected (all previous
+  /// lines must be known already)
+  bool selects(std::size_t line) const {
+    const auto& name = line_names_[line];
+    if (!patterns_.empty()) {
+      for (const auto& pattern : patterns_) {
+        if (matches(pattern, name)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Virtual devices
+    for (const char* prefix : {"loop", "ram", "zram", "dm-"}) {
+      if (name.compare(0, std::strlen(prefix), prefix) == 0) {
+        return false;
+      }
+    }
+
+    // Partitions have a 'partition' attribute in sysfs, where slashes in
+    // device names (e.g., cciss/c0d0) are replaced by '!'
+    struct stat sb;
+    if (!block_root_.empty() && stat(block_root_.c_str(), &sb) == 0) {
+      auto device = name;
+      std::replace(device.begin(), device.end(), '/', '!');
+      const auto path = block_root_ + "/" + device + "/partition";
+      return stat(path.c_str(), &sb) != 0;
+    }
+
+    // Without sysfs (e.g., in some containers or for synthetic files of
+    // tests and benchmarks), partitions are recognized by
+    // the kernel's naming scheme: they follow their disk and have its name
+    // plus the partition number, separated by 'p' if the disk name ends in a
+    // digit (e.g., sda1 or nvme0n1p1, but not nvme0n10 or nbd10)
+    for (std::size_t i = 0; i < line; i++) {
+      const auto& disk = line_names_[i];
+      if (disk.empty() || name.size() <= disk.size()
+          || name.compare(0, disk.size(), disk) != 0) {
+        continue;
+      }
+      auto rest = disk.size();
+      if (std::isdigit(static_cast<unsigned char>(disk.back()))) {
+        if (name[rest] != 'p') {
+          continue;
+        }
+        rest++;
+      }
+      if (rest < name.size()
+          && name.find_first_not_of("0123456789", rest) == std::string::npos) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const std::vector<std::string> patterns_;
+  const std::string block_root_;
+
+  // Device name and whether it is selected for each line of the file
+  std::vector<std::string> line_names_;
+  std::vector<char> line_selected_;
+
+  // Names and counters of selected devices
+  std::vector<std::string> names_;
+  std::vector<Int> counters_;
+
+  // Output buffer
+  std::string output_;
+};
+
+
+/// Capacity of the file systems of a list of paths (via statvfs)
+class MountTable {
+ public:
+  /// Number of values per path
+  static constexpr int num_values = 3;
+
+  /// Indices of values (in bytes)
+  enum Value { total, used, available };
+
+  explicit MountTable(const std::vector<std::string>& paths)
+    : paths_(paths), values_(num_values * paths.size(), 0),
+      counted_(paths.size(), 1) {}
+
+  /// Return false and set error message if a path cannot be used. Paths on
+  /// the same file system as a previous path are not counted in the totals.
+  bool open(std::string& error) {
+    std::vector<dev_t> devices;
+    for (std::size_t i = 0; i < paths_.size(); i++) {
+      struct stat sb;
+      struct statvfs vfs;
+      if (stat(paths_[i].c_str(), &sb) != 0
+          || statvfs(paths_[i].c_str(), &vfs) != 0) {
+        error = "stat path (" + paths_[i] + ") does not exist or cannot be "
+                "used";
+        return false;
+      }
+      for (const auto d : devices) {
+        counted_[i] = counted_[i] && d != sb.st_dev;
+      }
+      devices.push_back(sb.st_dev);
+    }
+    return true;
+  }
+
+  /// Query all file systems
+  void update() {
+    for (std::size_t i = 0; i < paths_.size(); i++) {
+      struct statvfs sb;
+      Int* const v = &values_[num_values * i];
+      if (statvfs(paths_[i].c_str(), &sb) != 0) {
+        v[total] = v[used] = v[available] = 0;
+        continue;
+      }
+
+      // All values of interest from statvfs are given in blocks, thus to
+      // obtain the byte value they have to be multiplied by frsize
+      // Total = disk capacity
+      v[total] = sb.f_blocks * sb.f_frsize;
+      // Used = capacity minus what kernel/root may use
+      v[used] = (sb.f_blocks - sb.f_bfree) * sb.f_frsize;
+      // Available = remaining capacity that normal users may use
+      v[available] = sb.f_bavail * sb.f_frsize;
+    }
+  }
+
+  /// Sum of a value over all distinct file systems
+  Int sum(Value value) const {
+    Int result = 0;
+    for (std::size_t i = 0; i < paths_.size(); i++) {
+      result += counted_[i] ? values_[num_values * i + value] : 0;
+    }
+    return result;
+  }
+
+  /// Write one line per path and optionally flush the file. Return false on
+  /// write errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) {
+    for (std::size_t i = 0; i < paths_.size(); i++) {
+      const Int* const v = &values_[num_values * i];
+      if (std::fprintf(file, "%lld %s %lld %lld %lld\n", timestamp,
+                       paths_[i].c_str(), v[total], v[used], v[available])
+          < 0) {
+        return false;
+      }
+    }
+    return !flush || std::fflush(file) == 0;
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp path total used available\n";
+  }
+
+ private:
+  const std::vector<std::string> paths_;
+  std::vector<Int> values_;
+  std::vector<char> counted_;
+};
+
+} // namespace sss
+
+#endif // SSS_DISK_HPP
@@ -0,0 +1,878 @@
+// Assumptions about record/log files
+// - each log file contains only records (i.e. no headers etc.), either one
+//   record per line (text format) or as fixed-size records after the file
+//   header (binary format and ring files); compressed files are decoded to
+//   binary records in memory
+// - the first field of each record is the Unix timestamp in milliseconds
+// - excluding leap seconds, the ordering of records is strictly monotonically
+//   increasing by timestamp
+// - the second field of each record contains the time since the last sample
+//   was recorded (in milliseconds)
+// - if the second field contains a zero, it means that this is the first record
+//   after sss-mon was (re-)started
+// - log files do not overlap in time (i.e. the first record of any log file will
+//   never be from a point in time that is between the first and the last record
+//   of another log file)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <getopt.h>
+
+#include "sss-block.hpp"
+#include "sss-derive.hpp"
+#include "sss-format.hpp"
+#include "sss-index.hpp"
+#include "sss-mmap.hpp"
+#include "sss-ring.hpp"
+
+using sss::Float;
+using sss::Format;
+using sss::Int;
+using sss::Sample;
+
+// Set sensible default values
+const std::string DEFAULT_TIME_RANGE = "1h:1d:3d:30d";
+const std::string DEFAULT_DATA_FILE_PREFIX = "sss_data_%Y%m%d_%H%M%S_";
+constexpr const Int DEFAULT_NUM_SAMPLES = 2048;
+constexpr const Int DEFAULT_THREADS = 0;
+
+namespace {
+  /// Size limits for the chunks that are processed in parallel
+  constexpr const std::size_t min_chunk_size = 1 << 20;
+  constexpr const std::size_t max_chunk_size = 16 << 20;
+
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    std::vector<std::string> log_files;
+    std::string time_range = DEFAULT_TIME_RANGE;
+    std::string data_file_prefix = DEFAULT_DATA_FILE_PREFIX;
+    Int num_samples = DEFAULT_NUM_SAMPLES;
+    Int threads = DEFAULT_THREADS;
+  };
+
+  /// Input log file mapped into memory (or a contiguous range of records in a
+  /// ring file, or the decoded records of a compressed file)
+  struct InputFile {
+    std::string name;
+    std::shared_ptr<sss::MappedFile> map;
+    std::shared_ptr<std::vector<char>> decoded;
+    Format format = Format::text;
+    sss::BinaryLayout layout;
+    std::size_t data_begin = 0;
+    std::size_t data_end = 0;
+    Int first_timestamp = 0;
+
+    // Processing starts here, earlier records are only read as predecessors
+    std::size_t scan_begin = 0;
+
+    const char* data() const {
+      return decoded ? decoded->data() : map->data();
+    }
+  };
+
+  /// Contiguous range of records in an input file (as byte offsets)
+  struct Chunk {
+    std::size_t file;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  /// Formatted output records of a chunk
+  struct ChunkResult {
+    std::string text;
+    std::vector<std::size_t> offsets;
+    std::vector<Int> timestamps;
+    std::string error;
+  };
+
+  /// Output data file for a single time range
+  struct DataFile {
+    std::string name;
+    std::FILE* file;
+    Int timestamp;
+  };
+
+  /// Units for time ranges (in milliseconds)
+  struct RangeUnit {
+    const char* name;
+    Int milliseconds;
+  };
+  const RangeUnit range_units[] = {
+    {"h", 3600 * 1000LL},
+    {"d", 24 * 3600 * 1000LL},
+    {"y", 365 * 24 * 3600 * 1000LL},
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-extract [-h] [-t TIME_RANGE] [-p DATA_FILE_PREFIX]\n"
+     << "                   [-n NUM_SAMPLES] [-j THREADS] LOG_FILE "
+     << "[LOG_FILE...]\n"
+     << "\n"
+     << "sss-extract reads log files written by sss-mon (in any format) and\n"
+     << "creates one data file for each time range with CPU\n"
+     << "utilization, memory and disk usage, and network bandwidth.\n"
+     << "\n"
+     << "positional arguments:\n"
+     << "  LOG_FILE              Log files to read. They are sorted by their\n"
+     << "                        first timestamp and files that are older\n"
+     << "                        than the longest time range are skipped.\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  -j, --threads THREADS\n"
+     << "                        Number of threads used for parsing. If set\n"
+     << "                        to zero, one thread per core is used\n"
+     << "                        (default: " << DEFAULT_THREADS << ").\n"
+     << "  -n, --num-samples NUM_SAMPLES\n"
+     << "                        Accepted for compatibility, currently\n"
+     << "                        unused (default: " << DEFAULT_NUM_SAMPLES
+     << ").\n"
+     << "  -p, --data-file-prefix DATA_FILE_PREFIX\n"
+     << "                        Prefix for data files, which may contain\n"
+     << "                        time format strings as defined in\n"
+     << "                        std::strftime. The time range is appended\n"
+     << "                        (default: " << DEFAULT_DATA_FILE_PREFIX
+     << ").\n"
+     << "  -t, --time-range TIME_RANGE\n"
+     << "                        Colon-separated list of time ranges, each\n"
+     << "                        given as an integer followed by 'h', 'd',\n"
+     << "                        or 'y' (default: " << DEFAULT_TIME_RANGE
+     << ").\n";
+  os.flush();
+}
+
+
+/// Parse integer argument or quit with an error
+static Int parse_int_argument(const char* arg, const char* name) {
+  std::istringstream in(arg);
+  Int value = 0;
+  in >> value;
+  if (in.fail() || in.get() != std::istringstream::traits_type::eof()) {
+    std::cerr << "error: argument to '" << name << "' (" << arg
+              << ") is not an integer" << std::endl;
+    exit(2);
+  }
+  return value;
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"data-file-prefix", required_argument, nullptr, 'p'},
+      {"help", no_argument, nullptr, 'h'},
+      {"num-samples", required_argument, nullptr, 'n'},
+      {"threads", required_argument, nullptr, 'j'},
+      {"time-range", required_argument, nullptr, 't'},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "hj:n:p:t:", long_options, nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Set number of threads
+      case 'j':
+        {
+          args.threads = parse_int_argument(optarg, "-j|--threads");
+          if (args.threads < 0) {
+            std::cerr << "error: argument to '-j|--threads' (" << optarg
+                      << ") is negative" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set number of samples
+      case 'n':
+        {
+          args.num_samples = parse_int_argument(optarg, "-n|--num-samples");
+          break;
+        }
+
+      // Set data file prefix
+      case 'p':
+        {
+          args.data_file_prefix = optarg;
+          break;
+        }
+
+      // Set time ranges
+      case 't':
+        {
+          args.time_range = optarg;
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // Remaining arguments are log files
+  for (int i = optind; i < argc; i++) {
+    args.log_files.push_back(argv[i]);
+  }
+  if (args.log_files.empty()) {
+    std::cerr << "error: at least one log file is required" << std::endl;
+    print_usage();
+    exit(2);
+  }
+
+  return args;
+}
+
+
+/// Convert time range (e.g., '3d') into the timestamp of its beginning
+static bool range_to_timestamp(const std::string& range, Int now,
+                               Int& timestamp) {
+  // Split into value and unit
+  const auto unit_begin = range.find_first_not_of("0123456789");
+  if (unit_begin == 0 || unit_begin == std::string::npos) {
+    return false;
+  }
+  const auto unit = range.substr(unit_begin);
+  for (const auto& u : range_units) {
+    if (unit == u.name) {
+      timestamp = now - std::stoll(range.substr(0, unit_begin)) * u.milliseconds;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/// Split string at colons
+static std::vector<std::string> split_ranges(const std::string& s) {
+  std::vector<std::string> parts;
+  std::size_t begin = 0;
+  while (true) {
+    const auto end = s.find(':', begin);
+    parts.push_back(s.substr(begin, end - begin));
+    if (end == std::string::npos) {
+      break;
+    }
+    begin = end + 1;
+  }
+  return parts;
+}
+
+
+/// Return true if the line only contains whitespace
+static bool is_blank(const char* begin, const char* end) {
+  for (; begin < end; begin++) {
+    if (*begin != ' ' && *begin != '\t' && *begin != '\r') {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/// Parse next non-empty text line in [p, end) and advance p, return false if
+/// there are no more lines. If the line is malformed, `good` is set to false.
+static bool next_text_sample(const char*& p, const char* end, Sample& s,
+                             bool& good) {
+  while (p < end) {
+    const auto eol = static_cast<const char*>(
+        std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+    const char* const line_end = (eol == nullptr) ? end : eol;
+    const char* const line = p;
+    p = (eol == nullptr) ? end : eol + 1;
+    if (!is_blank(line, line_end)) {
+      good = sss::parse_text(line, line_end, s);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/// Decode blocks of a compressed file, starting at the given offset, and
+/// append the samples as binary records with the default layout
+static bool decode_blocks(const char* data, std::size_t size,
+                          std::size_t offset, std::vector<char>& decoded,
+                          std::string& error) {
+  const sss::BinaryLayout layout;
+  sss::BinaryLayout block_layout;
+  std::vector<char> records;
+  Sample s;
+  while (offset < size) {
+    if (!sss::decode_block(data + offset, size - offset, block_layout,
+                           records, error)) {
+      return false;
+    }
+    for (std::size_t r = 0; r < records.size();
+         r += block_layout.record_size()) {
+      block_layout.decode(&records[r], s);
+      const auto end = decoded.size();
+      decoded.resize(end + layout.record_size());
+      layout.encode(s, decoded.data() + end);
+    }
+    offset += sss::block_size(data + offset, size - offset);
+  }
+  return true;
+}
+
+
+/// Map input file, determine its format and first timestamp, and append it to
+/// the list of input files. Ring files are added as up to two input files,
+/// one for each contiguous range of records in time order. Blocks of
+/// compressed files with an index are only decoded from the last block before
+/// `from` onwards.
+static bool open_input(const std::string& name, Int from,
+                       std::vector<InputFile>& files, std::string& error) {
+  InputFile f;
+  f.name = name;
+  f.map = std::make_shared<sss::MappedFile>();
+  if (!f.map->open(name)) {
+    error = "could not open '" + name + "' for reading";
+    return false;
+  }
+  const char* const data = f.map->data();
+  const std::size_t size = f.map->size();
+
+  // Ring files have up to two ranges of records
+  if (sss::is_ring_file(data, size)) {
+    f.format = Format::binary;
+    sss::RingInfo info;
+    if (!sss::parse_ring_header(data, size, info, f.layout, error)) {
+      error = "'" + name + "': " + error;
+      return false;
+    }
+    if (info.count == 0) {
+      error = "'" + name + "' does not contain any records";
+      return false;
+    }
+    if (info.data_begin + info.capacity * info.record_size > size) {
+      error = "'" + name + "': truncated ring file";
+      return false;
+    }
+    const auto first = std::min(info.count, info.capacity - info.head);
+    const std::uint64_t ranges[2][2] = {
+      {info.head, info.head + first}, {0, info.count - first}};
+    for (const auto& r : ranges) {
+      if (r[1] > r[0]) {
+        f.data_begin = info.data_begin + r[0] * info.record_size;
+        f.data_end = info.data_begin + r[1] * info.record_size;
+        Sample s;
+        f.layout.decode(data + f.data_begin, s);
+        f.first_timestamp = s.timestamp;
+        files.push_back(f);
+      }
+    }
+    return true;
+  }
+
+  // Compressed files are decoded into binary records with the default layout
+  if (sss::is_block_file(data, size)) {
+    f.format = Format::binary;
+    f.decoded = std::make_shared<std::vector<char>>();
+    Sample s;
+
+    // Decode first block for the first timestamp, then skip to the block
+    // given by the index and make sure that it matches
+    sss::LogIndex index;
+    if (index.open(sss::index_path(name))) {
+      const auto i = index.last_before(from);
+      const auto offset = (i < index.size()) ? index.offset(i) : 0;
+      if (offset > 0 && offset < size
+          && decode_blocks(data, sss::block_size(data, size), 0, *f.decoded,
+                           error)
+          && !f.decoded->empty()) {
+        f.layout.decode(f.data(), s);
+        f.first_timestamp = s.timestamp;
+        f.decoded->clear();
+        const bool good = decode_blocks(data, size, offset, *f.decoded, error)
+                          && !f.decoded->empty();
+        if (good) {
+          f.layout.decode(f.data(), s);
+        }
+        if (!good || s.timestamp != index.timestamp(i)) {
+          f.decoded->clear();
+        }
+      }
+    }
+
+    // Otherwise decode all blocks
+    if (f.decoded->empty()) {
+      if (!decode_blocks(data, size, 0, *f.decoded, error)) {
+        error = "'" + name + "': " + error;
+        return false;
+      }
+      if (f.decoded->empty()) {
+        error = "'" + name + "' does not contain any records";
+        return false;
+      }
+      f.layout.decode(f.data(), s);
+      f.first_timestamp = s.timestamp;
+    }
+    f.map.reset();
+    f.data_begin = 0;
+    f.data_end = f.decoded->size();
+    files.push_back(f);
+    return true;
+  }
+
+  // Binary files are recognized by their magic bytes
+  if (size >= sss::binary_fixed_header_size
+      && std::memcmp(data, sss::binary_magic,
+                     sizeof(sss::binary_magic)) == 0) {
+    f.format = Format::binary;
+    if (!f.layout.parse(data, size, error)) {
+      error = "'" + name + "': " + error;
+      return false;
+    }
+    f.data_begin = sss::BinaryLayout::header_size(data, size);
+    const auto records = (size - f.data_begin) / f.layout.record_size();
+    f.data_end = f.data_begin + records * f.layout.record_size();
+    if (records == 0) {
+      error = "'" + name + "' does not contain any records";
+      return false;
+    }
+    Sample s;
+    f.layout.decode(data + f.data_begin, s);
+    f.first_timestamp = s.timestamp;
+    files.push_back(f);
+    return true;
+  }
+
+  // Text file
+  f.format = Format::text;
+  f.data_begin = 0;
+  f.data_end = size;
+  const char* p = data;
+  Sample s;
+  bool good = true;
+  if (!next_text_sample(p, data + size, s, good) || !good) {
+    error = "'" + name + "' does not start with a valid record";
+    return false;
+  }
+  f.first_timestamp = s.timestamp;
+  files.push_back(f);
+  return true;
+}
+
+
+/// Skip records before `from` if this is possible without reading the whole
+/// file: binary records are searched directly, text files need an index
+static void skip_before(InputFile& f, Int from) {
+  f.scan_begin = f.data_begin;
+  Sample s;
+
+  // Binary: search first record not before `from`
+  if (f.format == Format::binary) {
+    const auto record_size = f.layout.record_size();
+    const auto first = sss::lower_bound_timestamp(
+        (f.data_end - f.data_begin) / record_size, from,
+        [&](std::uint64_t i) {
+          f.layout.decode(f.data() + f.data_begin + i * record_size, s);
+          return s.timestamp;
+        });
+    f.scan_begin = f.data_begin + first * record_size;
+    return;
+  }
+
+  // Text: start at last indexed record before `from`, if the index entry
+  // matches the log file
+  sss::LogIndex index;
+  if (!index.open(sss::index_path(f.name))) {
+    return;
+  }
+  const auto i = index.last_before(from);
+  if (i == index.size()) {
+    return;
+  }
+  const auto offset = index.offset(i);
+  if (offset <= f.data_begin || offset >= f.data_end
+      || f.data()[offset - 1] != '\n') {
+    return;
+  }
+  const char* const line = f.data() + offset;
+  const auto eol = static_cast<const char*>(
+      std::memchr(line, '\n', f.data_end - offset));
+  if (eol != nullptr && sss::parse_text(line, eol, s)
+      && s.timestamp == index.timestamp(i)) {
+    f.scan_begin = offset;
+  }
+}
+
+
+/// Read the last record before the given offset in the input file, return
+/// false if there is none
+static bool record_before(const InputFile& f, std::size_t offset, Sample& s) {
+  if (offset <= f.data_begin) {
+    return false;
+  }
+
+  // Binary: just decode the previous record
+  if (f.format == Format::binary) {
+    f.layout.decode(f.data() + offset - f.layout.record_size(), s);
+    return true;
+  }
+
+  // Text: search backwards for the last non-empty line
+  const char* const begin = f.map->begin();
+  const char* end = begin + offset;
+  while (end > begin) {
+    const char* const line_end = (end[-1] == '\n') ? end - 1 : end;
+    const char* line = line_end;
+    while (line > begin && line[-1] != '\n') {
+      line--;
+    }
+    if (!is_blank(line, line_end)) {
+      return sss::parse_text(line, line_end, s);
+    }
+    end = line;
+  }
+  return false;
+}
+
+
+/// Split input files into chunks of roughly the given size that start and end
+/// at record boundaries
+static std::vector<Chunk> make_chunks(const std::vector<InputFile>& files,
+                                      std::size_t chunk_size) {
+  std::vector<Chunk> chunks;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    const auto& f = files[i];
+    if (f.format == Format::binary) {
+      // Binary records have a fixed size
+      const auto record_size = f.layout.record_size();
+      const auto step = std::max<std::size_t>(1, chunk_size / record_size)
+                        * record_size;
+      for (auto begin = f.scan_begin; begin < f.data_end; begin += step) {
+        chunks.push_back({i, begin, std::min(begin + step, f.data_end)});
+      }
+    } else {
+      // Text chunks end after the next newline following the chunk size
+      for (auto begin = f.scan_begin; begin < f.data_end; ) {
+        auto end = std::min(begin + chunk_size, f.data_end);
+        if (end < f.data_end) {
+          const auto eol = static_cast<const char*>(std::memchr(
+              f.map->data() + end, '\n', f.data_end - end));
+          end = (eol == nullptr) ? f.data_end
+                                 : static_cast<std::size_t>(
+                                       eol + 1 - f.map->data());
+        }
+        chunks.push_back({i, begin, end});
+        begin = end;
+      }
+    }
+  }
+  return chunks;
+}
+
+
+/// Floor division as used for the conversion to mebibytes
+static Int floor_div(Int a, Int b) {
+  const Int q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+
+/// Compute a data record from two consecutive samples and append it to the
+/// chunk result
+static void append_record(const Sample& previous, const Sample& current,
+                          ChunkResult& result) {
+  // CPU utilization and network bandwidth
+  const auto d = sss::derive(previous, current, current.time_delta);
+
+  // Format record
+  char line[512];
+  const auto length = std::snprintf(
+      line, sizeof(line),
+      "%lld %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f "
+      "%lld %lld %lld %lld %lld %lld %lld %1.3f %1.3f\n",
+      current.timestamp,
+      current.cpu_load_1m,
+      current.cpu_load_5m,
+      current.cpu_load_15m,
+      d.cpu_user,
+      d.cpu_system,
+      d.cpu_nice,
+      d.cpu_idle,
+      floor_div(current.memory_total, 1048576),
+      floor_div(current.memory_used, 1048576),
+      floor_div(current.swap_total, 1048576),
+      floor_div(current.swap_used, 1048576),
+      floor_div(current.disk_total, 1048576),
+      floor_div(current.disk_used, 1048576),
+      floor_div(current.disk_available, 1048576),
+      d.network_received,
+      d.network_sent);
+
+  result.offsets.push_back(result.text.size());
+  result.timestamps.push_back(current.timestamp);
+  result.text.append(line, static_cast<std::size_t>(length));
+}
+
+
+/// Process all records of a chunk. If `has_previous` is true, `previous` is
+/// the record directly preceding the chunk.
+static ChunkResult process_chunk(const InputFile& f, const Chunk& chunk,
+                                 bool has_previous, Sample previous) {
+  ChunkResult result;
+  result.text.reserve((chunk.end - chunk.begin) * 3 / 4);
+
+  // Handle a single sample
+  auto handle = [&](const Sample& current) {
+    // If time_delta is zero, treat this sample as if there was no previous
+    if (current.time_delta == 0) {
+      has_previous = false;
+    }
+
+    // If there is a previous sample, create new data record
+    if (has_previous) {
+      append_record(previous, current, result);
+    }
+    previous = current;
+    has_previous = true;
+  };
+
+  Sample current;
+  if (f.format == Format::binary) {
+    const auto record_size = f.layout.record_size();
+    for (auto offset = chunk.begin; offset < chunk.end; offset += record_size) {
+      f.layout.decode(f.data() + offset, current);
+      handle(current);
+    }
+  } else {
+    const char* p = f.map->data() + chunk.begin;
+    const char* const end = f.map->data() + chunk.end;
+    bool good = true;
+    while (next_text_sample(p, end, current, good)) {
+      if (!good) {
+        result.error = "'" + f.name + "': malformed record";
+        break;
+      }
+      handle(current);
+    }
+  }
+
+  return result;
+}
+
+
+/// Write the records of a chunk to all data files whose time range they fall
+/// into
+static void write_chunk(const ChunkResult& result,
+                        const std::vector<DataFile>& data_files) {
+  if (result.timestamps.empty()) {
+    return;
+  }
+  const auto minmax = std::minmax_element(result.timestamps.begin(),
+                                          result.timestamps.end());
+  for (const auto& d : data_files) {
+    if (*minmax.first >= d.timestamp) {
+      // All records belong to this time range
+      std::fwrite(result.text.data(), 1, result.text.size(), d.file);
+    } else if (*minmax.second >= d.timestamp) {
+      // Check record by record
+      for (std::size_t i = 0; i < result.timestamps.size(); i++) {
+        if (result.timestamps[i] >= d.timestamp) {
+          const auto end = (i + 1 < result.offsets.size())
+                           ? result.offsets[i + 1] : result.text.size();
+          std::fwrite(result.text.data() + result.offsets[i], 1,
+                      end - result.offsets[i], d.file);
+        }
+      }
+    }
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  const auto args = parse_arguments(argc, argv);
+
+  // Get current time in milliseconds
+  const Int now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // Get timestamps for the specified ranges
+  const auto ranges = split_ranges(args.time_range);
+  std::vector<Int> range_timestamps;
+  for (const auto& r : ranges) {
+    Int timestamp = 0;
+    if (!range_to_timestamp(r, now, timestamp)) {
+      std::cerr << "error: invalid time range '" << r << "'" << std::endl;
+      exit(2);
+    }
+    range_timestamps.push_back(timestamp);
+  }
+  const Int min_range_timestamp =
+      *std::min_element(range_timestamps.begin(), range_timestamps.end());
+
+  // Map all log files and sort them by their first timestamp
+  std::vector<InputFile> all_files;
+  for (std::size_t i = 0; i < args.log_files.size(); i++) {
+    std::string error;
+    if (!open_input(args.log_files[i], min_range_timestamp, all_files,
+                    error)) {
+      std::cerr << "error: " << error << std::endl;
+      exit(1);
+    }
+  }
+  std::sort(all_files.begin(), all_files.end(),
+            [](const InputFile& a, const InputFile& b) {
+              return std::make_pair(a.first_timestamp, a.name)
+                     < std::make_pair(b.first_timestamp, b.name);
+            });
+
+  // Filter out log files that are not needed
+  std::vector<InputFile> files;
+  for (std::size_t i = 0; i + 1 < all_files.size(); i++) {
+    if (all_files[i + 1].first_timestamp >= min_range_timestamp) {
+      files.push_back(std::move(all_files[i]));
+    }
+  }
+  files.push_back(std::move(all_files.back()));
+
+  // Skip records that are older than the longest time range
+  for (auto& f : files) {
+    skip_before(f, min_range_timestamp);
+  }
+
+  // Create data files
+  std::vector<DataFile> data_files;
+  const std::time_t now_seconds = static_cast<std::time_t>(now / 1000);
+  for (std::size_t i = 0; i < ranges.size(); i++) {
+    char name[4096];
+    const auto format = args.data_file_prefix + ranges[i];
+    if (std::strftime(name, sizeof(name), format.c_str(),
+                      std::localtime(&now_seconds)) == 0) {
+      std::cerr << "error: data file name is too long" << std::endl;
+      exit(1);
+    }
+    std::FILE* file = std::fopen(name, "w");
+    if (file == nullptr) {
+      std::cerr << "error: could not open data file '" << name
+                << "' for writing" << std::endl;
+      exit(1);
+    }
+    data_files.push_back({name, file, range_timestamps[i]});
+  }
+
+  // Write header
+  for (const auto& d : data_files) {
+    std::fputs("# timestamp cpu_load_1m cpu_load_5m cpu_load_15m cpu_util_user "
+               "cpu_util_system cpu_util_nice cpu_util_idle memory_total "
+               "memory_used swap_total swap_used disk_total disk_used "
+               "disk_available network_in network_out\n", d.file);
+  }
+
+  // Split input into chunks
+  const auto threads = static_cast<std::size_t>(
+      args.threads > 0 ? args.threads
+                       : std::max(1u, std::thread::hardware_concurrency()));
+  std::size_t total_size = 0;
+  for (const auto& f : files) {
+    total_size += f.data_end - f.scan_begin;
+  }
+  const auto chunk_size = std::min(
+      max_chunk_size, std::max(min_chunk_size, total_size / (4 * threads)));
+  const auto chunks = make_chunks(files, chunk_size);
+
+  // Process chunks in waves, such that memory usage stays bounded: within a
+  // wave, all chunks are processed in parallel, then written in order
+  const std::size_t wave_size = 2 * threads;
+  std::vector<ChunkResult> results(wave_size);
+  for (std::size_t wave = 0; wave < chunks.size(); wave += wave_size) {
+    const auto wave_end = std::min(wave + wave_size, chunks.size());
+    std::atomic<std::size_t> next(wave);
+    auto worker = [&]() {
+      for (auto c = next++; c < wave_end; c = next++) {
+        // Determine record preceding the chunk, which may be in one of the
+        // previous files
+        Sample previous;
+        bool has_previous = false;
+        for (auto f = chunks[c].file + 1; f-- > 0 && !has_previous; ) {
+          const auto offset = (f == chunks[c].file) ? chunks[c].begin
+                                                    : files[f].data_end;
+          has_previous = record_before(files[f], offset, previous);
+        }
+        results[c - wave] = process_chunk(files[chunks[c].file], chunks[c],
+                                          has_previous, previous);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t t = 1; t < std::min(threads, wave_end - wave); t++) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+      t.join();
+    }
+
+    // Write results in order
+    for (std::size_t c = wave; c < wave_end; c++) {
+      if (!results[c - wave].error.empty()) {
+        std::cerr << "error: " << results[c - wave].error << std::endl;
+        exit(1);
+      }
+      write_chunk(results[c - wave], data_files);
+      results[c - wave] = ChunkResult();
+    }
+  }
+
+  // Close files
+  bool good = true;
+  for (const auto& d : data_files) {
+    good = (std::fclose(d.file) == 0) && good;
+  }
+  if (!good) {
+    std::cerr << "error: could not write data files" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,636 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include "sss-collect.hpp"
+#include "sss-derive.hpp"
+#include "sss-format.hpp"
+#include "sss-pool.hpp"
+#include "sss-reader.hpp"
+#include "sss-time.hpp"
+
+using sss::Float;
+using sss::Int;
+using sss::Sample;
+
+// Set sensible default values
+constexpr const Int DEFAULT_BUCKET = 60 * 1000;
+constexpr const Int DEFAULT_THREADS = 0;
+
+namespace {
+  /// Values for long options without a short equivalent
+  enum LongOption {
+    OPT_FROM = 256,
+    OPT_UNTIL,
+  };
+
+  /// Memory for decoded samples that are waiting to be merged (in bytes)
+  constexpr const std::size_t batch_memory = 64 << 20;
+
+  /// Percentiles across hosts that are written for each bucket
+  const double percentiles[] = {0.5, 0.9, 0.99};
+
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    std::vector<std::string> hosts;
+    std::string output_file;
+    Int bucket = DEFAULT_BUCKET;
+    Int threads = DEFAULT_THREADS;
+    std::string fields;
+    Int from = std::numeric_limits<Int>::min();
+    Int until = std::numeric_limits<Int>::max();
+  };
+
+  /// Log file of a host, which is decoded in batches by the thread pool
+  /// while the previous batch is merged
+  struct Stream {
+    std::size_t host;
+    std::string path;
+    sss::LogReader reader;
+    bool opened = false;
+
+    // Batch that is being merged (main thread only)
+    std::vector<Sample> current;
+    std::size_t position = 0;
+    bool finished = false;
+
+    // Batch that is being decoded, guarded by the mutex of the merger until
+    // `ready` is set
+    std::vector<Sample> next;
+    bool ready = false;
+    bool end = false;
+    std::string error;
+  };
+
+  /// Values of a host in the current bucket
+  struct HostState {
+    std::string name;
+    Sample previous;
+    bool has_previous = false;
+    Int samples = 0;
+    std::vector<Float> sums;
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-fleet [-h] [-b BUCKET] [-f FIELDS] [-j THREADS]\n"
+     << "                 [-o OUTPUT] [--from TIME] [--until TIME]\n"
+     << "                 HOST [HOST...]\n"
+     << "\n"
+     << "sss-fleet reads the log files of many hosts at once, merges them by\n"
+     << "timestamp, and writes fleet-wide aggregates of the derived values\n"
+     << "(see 'sss-mon --derived') per time bucket. For each bucket and\n"
+     << "field, one line with the number of hosts and the sum, mean,\n"
+     << "minimum, maximum, and 50th/90th/99th percentile across hosts is\n"
+     << "written, followed by the name of the host with the maximum. The\n"
+     << "value of a host is the mean over its samples in the bucket.\n"
+     << "\n"
+     << "positional arguments:\n"
+     << "  HOST                  Log file of a host or directory with the log\n"
+     << "                        files of a host (in any format and order,\n"
+     << "                        possibly overlapping; index files are\n"
+     << "                        skipped). The host is named after the file\n"
+     << "                        or directory.\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  -b, --bucket BUCKET   Width of time buckets, which are aligned to\n"
+     << "                        multiples of their width since the Unix\n"
+     << "                        epoch (e.g., '5m'; units: ms, s, m, h, d;\n"
+     << "                        default: " << DEFAULT_BUCKET / 1000
+     << "s).\n"
+     << "  -f, --fields FIELDS   Comma-separated list of derived fields to\n"
+     << "                        aggregate (default: all but timestamp and\n"
+     << "                        interval).\n"
+     << "  --from TIME           Only read records with a timestamp at or\n"
+     << "                        after TIME, either a Unix timestamp in\n"
+     << "                        milliseconds or a duration before now\n"
+     << "                        (e.g., '-1h'; units: ms, s, m, h, d).\n"
+     << "                        Binary and ring files, as well as files\n"
+     << "                        with an index, are not read from the\n"
+     << "                        beginning.\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  -j, --threads THREADS\n"
+     << "                        Number of threads used for decoding. If set\n"
+     << "                        to zero, one thread per core is used\n"
+     << "                        (default: " << DEFAULT_THREADS << ").\n"
+     << "  -o, --output OUTPUT   Write to OUTPUT instead of stdout.\n"
+     << "  --until TIME          Only read records with a timestamp before\n"
+     << "                        TIME (same format as for '--from').\n";
+  os.flush();
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+  const Int now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"bucket", required_argument, nullptr, 'b'},
+      {"fields", required_argument, nullptr, 'f'},
+      {"from", required_argument, nullptr, OPT_FROM},
+      {"help", no_argument, nullptr, 'h'},
+      {"output", required_argument, nullptr, 'o'},
+      {"threads", required_argument, nullptr, 'j'},
+      {"until", required_argument, nullptr, OPT_UNTIL},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "b:f:hj:o:", long_options,
+                               nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Set bucket width
+      case 'b':
+        {
+          if (!sss::parse_duration(optarg, args.bucket)) {
+            std::cerr << "error: argument to '-b|--bucket' (" << optarg
+                      << ") is not a valid duration" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set fields
+      case 'f':
+        {
+          args.fields = optarg;
+          break;
+        }
+
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Set number of threads
+      case 'j':
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.threads;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.threads < 0) {
+            std::cerr << "error: argument to '-j|--threads' (" << optarg
+                      << ") is not a non-negative integer" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set output file
+      case 'o':
+        {
+          args.output_file = optarg;
+          break;
+        }
+
+      // Set time range
+      case OPT_FROM:
+      case OPT_UNTIL:
+        {
+          auto& timestamp = (c == OPT_FROM) ? args.from : args.until;
+          if (!sss::parse_time_point(optarg, now, timestamp)) {
+            std::cerr << "error: argument to '"
+                      << (c == OPT_FROM ? "--from" : "--until") << "' ("
+                      << optarg << ") is not a valid time" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // Remaining arguments are hosts
+  for (int i = optind; i < argc; i++) {
+    args.hosts.push_back(argv[i]);
+  }
+  if (args.hosts.empty()) {
+    std::cerr << "error: at least one host is required" << std::endl;
+    print_usage();
+    exit(2);
+  }
+
+  return args;
+}
+
+
+/// Return the indices of the selected derived fields, or quit with an error
+static std::vector<std::size_t> select_fields(const std::string& list) {
+  const auto& fields = sss::derived_fields();
+  std::vector<std::size_t> selected;
+  if (list.empty()) {
+    for (std::size_t i = 0; i < fields.size(); i++) {
+      if (std::strcmp(fields[i].name, "timestamp") != 0
+          && std::strcmp(fields[i].name, "interval") != 0) {
+        selected.push_back(i);
+      }
+    }
+    return selected;
+  }
+  std::istringstream in(list);
+  std::string name;
+  while (std::getline(in, name, ',')) {
+    std::size_t i = 0;
+    while (i < fields.size() && name != fields[i].name) {
+      i++;
+    }
+    if (i == fields.size()) {
+      std::cerr << "error: unknown field '" << name << "' (see "
+                << "'sss-mon --derived -f')" << std::endl;
+      exit(2);
+    }
+    selected.push_back(i);
+  }
+  return selected;
+}
+
+
+/// Return last component of a path without trailing slashes
+static std::string base_name(std::string path) {
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+  const auto slash = path.rfind('/');
+  return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+
+/// Add the log files of a host, which is either a single file or a directory
+/// with log files, to the streams. Return false on error.
+static bool add_host(const std::string& path, std::size_t host,
+                     std::vector<std::unique_ptr<Stream>>& streams,
+                     std::string& error) {
+  std::vector<std::string> files;
+  struct stat sb;
+  if (stat(path.c_str(), &sb) != 0) {
+    error = "could not open '" + path + "' for reading";
+    return false;
+  }
+  if (S_ISDIR(sb.st_mode)) {
+    DIR* const dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      error = "could not open directory '" + path + "'";
+      return false;
+    }
+    while (const dirent* entry = readdir(dir)) {
+      const std::string name = entry->d_name;
+      const auto file = path + "/" + name;
+      if (name[0] != '.'
+          && (name.size() < 4 || name.compare(name.size() - 4, 4, ".idx") != 0)
+          && stat(file.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+        files.push_back(file);
+      }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+  } else {
+    files.push_back(path);
+  }
+  for (const auto& file : files) {
+    streams.emplace_back(new Stream());
+    streams.back()->host = host;
+    streams.back()->path = file;
+  }
+  return true;
+}
+
+
+/// Merges the streams of all hosts by timestamp with a k-way heap. Streams
+/// are decoded in batches by a thread pool: while a batch is merged, the next
+/// batch of the same stream is decoded.
+class Merger {
+ public:
+  Merger(std::vector<std::unique_ptr<Stream>>& streams, std::size_t threads,
+         Int from, Int until)
+    : streams_(streams), pool_(threads), from_(from), until_(until),
+      batch_size_(std::min<std::size_t>(
+          4096, std::max<std::size_t>(
+                    64, batch_memory / sizeof(Sample)
+                        / (2 * std::max<std::size_t>(1, streams.size()))))) {}
+
+  /// Call `f(host, sample)` for all samples in timestamp order (ties are
+  /// broken by stream order). Return false on error.
+  template <typename F>
+  bool run(F f, std::string& error) {
+    for (std::size_t i = 0; i < streams_.size(); i++) {
+      decode(i);
+    }
+    for (std::size_t i = 0; i < streams_.size(); i++) {
+      if (!next_batch(i, error)) {
+        return false;
+      }
+      push(i);
+    }
+    while (!heap_.empty()) {
+      const auto i = heap_.top().second;
+      heap_.pop();
+      auto& s = *streams_[i];
+      f(s.host, s.current[s.position]);
+      s.position++;
+      if (s.position == s.current.size() && !next_batch(i, error)) {
+        return false;
+      }
+      push(i);
+    }
+    return true;
+  }
+
+ private:
+  /// Push stream onto the heap if it has samples left
+  void push(std::size_t i) {
+    const auto& s = *streams_[i];
+    if (s.position < s.current.size()) {
+      heap_.emplace(s.current[s.position].timestamp, i);
+    }
+  }
+
+  /// Wait for the next batch of a stream and start decoding the one after
+  bool next_batch(std::size_t i, std::string& error) {
+    auto& s = *streams_[i];
+    s.current.clear();
+    s.position = 0;
+    if (s.finished) {
+      return true;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      decoded_.wait(lock, [&s] { return s.ready; });
+      if (!s.error.empty()) {
+        error = s.error;
+        return false;
+      }
+      s.current.swap(s.next);
+      s.ready = false;
+      s.finished = s.end;
+    }
+    if (!s.finished) {
+      decode(i);
+    }
+    return true;
+  }
+
+  /// Decode next batch of a stream in the thread pool
+  void decode(std::size_t i) {
+    pool_.submit([this, i] {
+      auto& s = *streams_[i];
+      std::vector<Sample> batch;
+      batch.swap(s.next);
+      batch.clear();
+      batch.reserve(batch_size_);
+      std::string error;
+      bool end = false;
+      if (!s.opened) {
+        s.opened = true;
+        if (!s.reader.open(s.path)) {
+          error = s.reader.error();
+        } else if (from_ != std::numeric_limits<Int>::min()) {
+          s.reader.seek(from_);
+        }
+      }
+      Sample sample;
+      while (error.empty() && batch.size() < batch_size_) {
+        if (!s.reader.next(sample)) {
+          error = s.reader.error();
+          end = true;
+          break;
+        }
+        if (sample.timestamp < from_) {
+          continue;
+        }
+        if (sample.timestamp >= until_) {
+          end = true;
+          break;
+        }
+        batch.push_back(sample);
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        s.next.swap(batch);
+        s.end = end;
+        s.error = error;
+        s.ready = true;
+      }
+      decoded_.notify_all();
+    });
+  }
+
+  using HeapEntry = std::pair<Int, std::size_t>;
+
+  std::vector<std::unique_ptr<Stream>>& streams_;
+  sss::ThreadPool pool_;
+  const Int from_;
+  const Int until_;
+  const std::size_t batch_size_;
+  std::mutex mutex_;
+  std::condition_variable decoded_;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>> heap_;
+};
+
+
+/// Aggregate the values of all hosts with samples in a bucket and write one
+/// line per field
+static bool write_bucket(std::FILE* output, Int bucket,
+                         const std::vector<std::size_t>& fields,
+                         const std::vector<HostState>& hosts,
+                         const std::vector<std::size_t>& active,
+                         std::vector<Float>& values) {
+  const auto& info = sss::derived_fields();
+  for (std::size_t k = 0; k < fields.size(); k++) {
+    values.clear();
+    Float sum = 0.0;
+    Float max = -std::numeric_limits<Float>::infinity();
+    std::size_t max_host = 0;
+    for (const auto h : active) {
+      const Float v = hosts[h].sums[k] / static_cast<Float>(hosts[h].samples);
+      values.push_back(v);
+      sum += v;
+      if (v > max) {
+        max = v;
+        max_host = h;
+      }
+    }
+    std::sort(values.begin(), values.end());
+    const auto n = values.size();
+    if (std::fprintf(output, "%lld %s %zu %1.3f %1.3f %1.3f %1.3f", bucket,
+                     info[fields[k]].name, n, sum,
+                     sum / static_cast<Float>(n), values.front(),
+                     values.back()) < 0) {
+      return false;
+    }
+
+    // Nearest-rank percentiles
+    for (const auto p : percentiles) {
+      const auto rank = std::max<std::size_t>(
+          1, static_cast<std::size_t>(std::ceil(p * static_cast<Float>(n))));
+      if (std::fprintf(output, " %1.3f", values[rank - 1]) < 0) {
+        return false;
+      }
+    }
+    if (std::fprintf(output, " %s\n", hosts[max_host].name.c_str()) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  const auto args = parse_arguments(argc, argv);
+  const auto fields = select_fields(args.fields);
+
+  // Find log files of all hosts
+  std::vector<HostState> hosts(args.hosts.size());
+  std::vector<std::unique_ptr<Stream>> streams;
+  for (std::size_t h = 0; h < args.hosts.size(); h++) {
+    hosts[h].name = base_name(args.hosts[h]);
+    hosts[h].sums.assign(fields.size(), 0.0);
+    std::string error;
+    if (!add_host(args.hosts[h], h, streams, error)) {
+      std::cerr << "error: " << error << std::endl;
+      exit(1);
+    }
+  }
+
+  // All log files are open at the same time
+  if (streams.size() > sss::raise_open_file_limit(64)) {
+    std::cerr << "error: too many log files (" << streams.size()
+              << ") for the limit of open files" << std::endl;
+    exit(1);
+  }
+
+  // Open output file
+  std::FILE* output = stdout;
+  if (!args.output_file.empty()) {
+    output = std::fopen(args.output_file.c_str(), "w");
+    if (output == nullptr) {
+      std::cerr << "error: could not open output file '" << args.output_file
+                << "' for writing" << std::endl;
+      exit(1);
+    }
+  }
+  std::fputs("# bucket field hosts sum mean min max", output);
+  for (const auto p : percentiles) {
+    std::fprintf(output, " p%g", 100 * p);
+  }
+  std::fputs(" max_host\n", output);
+
+  // Merge samples of all hosts and aggregate the derived values of each
+  // host per bucket. Within a host, samples that are not newer than the
+  // previous one (from overlapping log files) are skipped.
+  std::vector<std::size_t> active;
+  std::vector<Float> values;
+  Int current_bucket = std::numeric_limits<Int>::min();
+  bool good = true;
+  auto flush_bucket = [&]() {
+    if (!active.empty()) {
+      good = write_bucket(output, current_bucket, fields, hosts, active,
+                          values) && good;
+    }
+    for (const auto h : active) {
+      hosts[h].samples = 0;
+      std::fill(hosts[h].sums.begin(), hosts[h].sums.end(), 0.0);
+    }
+    active.clear();
+  };
+  Merger merger(streams, static_cast<std::size_t>(args.threads), args.from,
+                args.until);
+  std::string error;
+  const bool merged = merger.run([&](std::size_t h, const Sample& s) {
+    auto& host = hosts[h];
+    if (host.has_previous && s.timestamp <= host.previous.timestamp) {
+      return;
+    }
+
+    // Buckets are aligned to multiples of their width (also before 1970)
+    const Int bucket = s.timestamp - ((s.timestamp % args.bucket)
+                                      + args.bucket) % args.bucket;
+    if (bucket != current_bucket) {
+      flush_bucket();
+      current_bucket = bucket;
+    }
+
+    // A zero time delta marks the first sample after sss-mon was started
+    if (host.has_previous && s.time_delta > 0) {
+      const auto d = sss::derive(host.previous, s, s.time_delta);
+      for (std::size_t k = 0; k < fields.size(); k++) {
+        host.sums[k] += sss::derived_value(d, fields[k]);
+      }
+      if (host.samples++ == 0) {
+        active.push_back(h);
+      }
+    }
+    host.previous = s;
+    host.has_previous = true;
+  }, error);
+  if (!merged) {
+    std::cerr << "error: " << error << std::endl;
+    exit(1);
+  }
+  flush_bucket();
+
+  // Close output file
+  good = (std::fflush(output) == 0) && good;
+  if (output != stdout) {
+    good = (std::fclose(output) == 0) && good;
+  }
+  if (!good) {
+    std::cerr << "error: could not write output" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,405 @@
+#ifndef SSS_FORMAT_HPP
+#define SSS_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Data structure for statistical data sample
+struct Sample {
+  // Timestamp values may be signed
+  Int timestamp = 0;
+  Int steady = 0;
+
+  // Time since the previous sample (in milliseconds), zero for the first
+  // sample after (re-)starting sss-mon
+  Int time_delta = 0;
+
+  // Sampling period in effect (in milliseconds), shorter during bursts
+  Int period = 0;
+
+  // Load values may be decimal numbers
+  Float cpu_load_1m = 0.0;
+  Float cpu_load_5m = 0.0;
+  Float cpu_load_15m = 0.0;
+
+  // All other values are counters that cannot be negative
+  Int cpu_time_user = 0;
+  Int cpu_time_nice = 0;
+  Int cpu_time_system = 0;
+  Int cpu_time_idle = 0;
+  Int cpu_time_iowait = 0;
+  Int cpu_time_irq = 0;
+  Int cpu_time_softirq = 0;
+  Int cpu_time_steal = 0;
+  Int cpu_time_guest = 0;
+  Int cpu_time_guest_nice = 0;
+  Int memory_total = 0;
+  Int memory_used = 0;
+  Int swap_total = 0;
+  Int swap_used = 0;
+  Int disk_total = 0;
+  Int disk_used = 0;
+  Int disk_available = 0;
+  Int network_received = 0;
+  Int network_sent = 0;
+  Int io_reads = 0;
+  Int io_sectors_read = 0;
+  Int io_writes = 0;
+  Int io_sectors_written = 0;
+  Int io_time = 0;
+  Int io_time_weighted = 0;
+};
+
+
+/// All fields that are written for each sample, in the order in which they
+/// appear in a log file. Each entry has the form X(type, name).
+#define SSS_SAMPLE_FIELDS(X) \
+  X(Int, timestamp) \
+  X(Int, time_delta) \
+  X(Float, cpu_load_1m) \
+  X(Float, cpu_load_5m) \
+  X(Float, cpu_load_15m) \
+  X(Int, cpu_time_user) \
+  X(Int, cpu_time_nice) \
+  X(Int, cpu_time_system) \
+  X(Int, cpu_time_idle) \
+  X(Int, cpu_time_iowait) \
+  X(Int, cpu_time_irq) \
+  X(Int, cpu_time_softirq) \
+  X(Int, cpu_time_steal) \
+  X(Int, cpu_time_guest) \
+  X(Int, cpu_time_guest_nice) \
+  X(Int, memory_total) \
+  X(Int, memory_used) \
+  X(Int, swap_total) \
+  X(Int, swap_used) \
+  X(Int, disk_total) \
+  X(Int, disk_used) \
+  X(Int, disk_available) \
+  X(Int, network_received) \
+  X(Int, network_sent) \
+  X(Int, io_reads) \
+  X(Int, io_sectors_read) \
+  X(Int, io_writes) \
+  X(Int, io_sectors_written) \
+  X(Int, io_time) \
+  X(Int, io_time_weighted) \
+  X(Int, period)
+
+/// Number of fields in text log files written before the I/O fields were
+/// added (up to network_sent), which can still be parsed
+constexpr std::size_t text_min_fields = 24;
+
+
+/// Description of a single sample field
+struct FieldInfo {
+  const char* name;
+  char type;            // 'i' for Int, 'f' for Float
+  std::size_t offset;   // offset of member in Sample
+};
+
+/// Fields of a sample in the order in which they are written
+inline const std::vector<FieldInfo>& sample_fields() {
+#define SSS_FIELD_INFO(type, name) \
+  {#name, std::is_same<type, Float>::value ? 'f' : 'i', offsetof(Sample, name)},
+  static const std::vector<FieldInfo> fields = {
+    SSS_SAMPLE_FIELDS(SSS_FIELD_INFO)
+  };
+#undef SSS_FIELD_INFO
+  return fields;
+}
+
+
+/// Supported log file formats
+enum class Format {
+  text,
+  binary,
+  compressed
+};
+
+/// Convert format name to format, returns false for unknown names
+inline bool parse_format(const std::string& name, Format& format) {
+  if (name == "text") {
+    format = Format::text;
+  } else if (name == "binary") {
+    format = Format::binary;
+  } else if (name == "compressed") {
+    format = Format::compressed;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/// Return name of format
+inline const char* format_name(Format format) {
+  switch (format) {
+    case Format::text: return "text";
+    case Format::binary: return "binary";
+    case Format::compressed: return "compressed";
+  }
+  return "unknown";
+}
+
+
+/// Append decimal integer to a buffer with enough space (snprintf is too slow
+/// for thousands of values) and return the new end
+inline char* append_int(char* p, Int value) {
+  if (value < 0) {
+    *p++ = '-';
+    value = -value;
+  }
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+
+/// Store 64 bit value in little-endian byte order
+inline void store_le64(std::uint64_t value, char* out) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+/// Load 64 bit value stored in little-endian byte order
+inline std::uint64_t load_le64(const char* in) {
+  std::uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+/// Store 32 bit value in little-endian byte order
+inline void store_le32(std::uint32_t value, char* out) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+/// Load 32 bit value stored in little-endian byte order
+inline std::uint32_t load_le32(const char* in) {
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(in[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+
+/// Binary log files start with a header, followed by fixed-size records:
+///
+///   offset  size  content
+///        0     8  magic bytes "SSS-BIN\0"
+///        8     4  format version
+///       12     4  header size in bytes (multiple of 8)
+///       16     4  record size in bytes
+///       20     4  number of fields
+///       24     -  for each field: type ('i' or 'f'), name, '\0'
+///
+/// The header is padded with zeros to the header size. Each record consists
+/// of one 8 byte little-endian value per field, either a two's complement
+/// integer ('i') or an IEEE 754 double ('f'), in the order given in the
+/// header. Thus, record N starts at byte `header_size + N * record_size`.
+constexpr char binary_magic[8] = {'S', 'S', 'S', '-', 'B', 'I', 'N', '\0'};
+constexpr std::uint32_t binary_version = 1;
+constexpr std::size_t binary_fixed_header_size = 24;
+
+/// Mapping between the fields of a binary record and the members of Sample
+class BinaryLayout {
+ public:
+  /// Create layout with all sample fields
+  BinaryLayout() {
+    for (const auto& f : sample_fields()) {
+      names_.push_back(f.name);
+      types_.push_back(f.type);
+      offsets_.push_back(static_cast<long>(f.offset));
+    }
+  }
+
+  /// Create layout with the sample fields of the given names (in the order of
+  /// `sample_fields()`)
+  explicit BinaryLayout(const std::vector<std::string>& names) {
+    for (const auto& f : sample_fields()) {
+      for (const auto& name : names) {
+        if (name == f.name) {
+          names_.push_back(f.name);
+          types_.push_back(f.type);
+          offsets_.push_back(static_cast<long>(f.offset));
+          break;
+        }
+      }
+    }
+  }
+
+  /// Parse layout from file header, return false if header is invalid. The
+  /// data must contain at least `binary_fixed_header_size` bytes and, if the
+  /// header is valid, `header_size()` bytes.
+  bool parse(const char* data, std::size_t size, std::string& error) {
+    if (size < binary_fixed_header_size
+        || std::memcmp(data, binary_magic, sizeof(binary_magic)) != 0) {
+      error = "not a binary log file";
+      return false;
+    }
+    const auto version = load_le32(data + 8);
+    if (version != binary_version) {
+      error = "unsupported binary format version " + std::to_string(version);
+      return false;
+    }
+    const auto header_size = load_le32(data + 12);
+    const auto record_size = load_le32(data + 16);
+    const auto num_fields = load_le32(data + 20);
+    if (header_size > size || record_size != 8 * num_fields
+        || header_size % 8 != 0) {
+      error = "corrupt binary log file header";
+      return false;
+    }
+
+    // Read field descriptions and map them to sample members by name.
+    // Unknown fields are skipped when decoding.
+    names_.clear();
+    types_.clear();
+    offsets_.clear();
+    const char* p = data + binary_fixed_header_size;
+    const char* const end = data + header_size;
+    for (std::uint32_t i = 0; i < num_fields; i++) {
+      const auto nul = static_cast<const char*>(
+          std::memchr(p, '\0', static_cast<std::size_t>(end - p)));
+      if (p + 1 >= end || nul == nullptr || (*p != 'i' && *p != 'f')) {
+        error = "corrupt binary log file header";
+        return false;
+      }
+      types_.push_back(*p);
+      names_.push_back(std::string(p + 1, nul));
+      offsets_.push_back(-1);
+      for (const auto& f : sample_fields()) {
+        if (names_.back() == f.name && types_.back() == f.type) {
+          offsets_.back() = static_cast<long>(f.offset);
+        }
+      }
+      p = nul + 1;
+    }
+    return true;
+  }
+
+  /// Return the size of the header in bytes as stored in a file header, or
+  /// zero if the data is too short
+  static std::size_t header_size(const char* data, std::size_t size) {
+    return (size < binary_fixed_header_size) ? 0 : load_le32(data + 12);
+  }
+
+  /// Serialize file header
+  std::string header() const {
+    std::string h(binary_magic, sizeof(binary_magic));
+    h.resize(binary_fixed_header_size);
+    store_le32(binary_version, &h[8]);
+    store_le32(static_cast<std::uint32_t>(record_size()), &h[16]);
+    store_le32(static_cast<std::uint32_t>(names_.size()), &h[20]);
+    for (std::size_t i = 0; i < names_.size(); i++) {
+      h.push_back(types_[i]);
+      h.append(names_[i]);
+      h.push_back('\0');
+    }
+    h.resize((h.size() + 7) / 8 * 8, '\0');
+    store_le32(static_cast<std::uint32_t>(h.size()), &h[12]);
+    return h;
+  }
+
+  /// Size of a single record in bytes
+  std::size_t record_size() const { return 8 * names_.size(); }
+
+  /// Field names in record order
+  const std::vector<std::string>& names() const { return names_; }
+
+  /// Field types ('i' or 'f') in record order
+  const std::vector<char>& types() const { return types_; }
+
+  /// Encode sample as binary record of `record_size()` bytes. Fields that are
+  /// not members of Sample are written as zero.
+  void encode(const Sample& s, char* out) const {
+    const auto base = reinterpret_cast<const char*>(&s);
+    for (std::size_t i = 0; i < offsets_.size(); i++) {
+      std::uint64_t raw = 0;
+      if (offsets_[i] >= 0) {
+        std::memcpy(&raw, base + offsets_[i], 8);
+      }
+      store_le64(raw, out + 8 * i);
+    }
+  }
+
+  /// Decode binary record of `record_size()` bytes into sample
+  void decode(const char* in, Sample& s) const {
+    const auto base = reinterpret_cast<char*>(&s);
+    for (std::size_t i = 0; i < offsets_.size(); i++) {
+      if (offsets_[i] >= 0) {
+        const auto raw = load_le64(in + 8 * i);
+        std::memcpy(base + offsets_[i], &raw, 8);
+      }
+    }
+  }
+
+ private:
+  std::vector<std::string> names_;
+  std::vector<char> types_;
+  std::vector<long> offsets_;
+};
+
+
+/// Write sample as a single line of space-separated text (without newline)
+inline void write_text(std::ostream& os, const Sample& s) {
+  const char* separator = "";
+#define SSS_WRITE_FIELD(type, name) \
+  os << separator << s.name; \
+  separator = " ";
+  SSS_SAMPLE_FIELDS(SSS_WRITE_FIELD)
+#undef SSS_WRITE_FIELD
+}
+
+/// Parse a single line of text into sample, return false if the line is
+/// malformed. Additional fields at the end of the line are ignored, missing
+/// fields at the end (of older log files) are zero.
+inline bool parse_text(const char* begin, const char* end, Sample& s) {
+  while (end > begin && (end[-1] == ' ' || end[-1] == '\t'
+                         || end[-1] == '\r' || end[-1] == '\n')) {
+    end--;
+  }
+  Scanner l(begin, end);
+  std::size_t parsed = 0;
+#define SSS_PARSE_FIELD(type, name) \
+  l.skip_spaces(); \
+  if (l.at_end()) { \
+    s.name = 0; \
+  } else { \
+    s.name = std::is_same<type, Float>::value \
+             ? static_cast<type>(l.parse_float()) \
+             : static_cast<type>(l.parse_int()); \
+    parsed++; \
+  }
+  SSS_SAMPLE_FIELDS(SSS_PARSE_FIELD)
+#undef SSS_PARSE_FIELD
+  return l.good() && parsed >= text_min_fields;
+}
+
+
+} // namespace sss
+
+#endif // SSS_FORMAT_HPP
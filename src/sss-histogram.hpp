@@ -0,0 +1,115 @@
+#ifndef SSS_HISTOGRAM_HPP
+#define SSS_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Counts of a latency histogram at one point in time
+struct LatencySnapshot {
+  static constexpr std::size_t num_buckets = 32;
+
+  std::array<std::uint64_t, num_buckets> counts{};
+  std::uint64_t total_ns = 0;
+
+  /// Number of recorded durations
+  std::uint64_t count() const {
+    std::uint64_t n = 0;
+    for (const auto c : counts) {
+      n += c;
+    }
+    return n;
+  }
+
+  /// Mean duration in microseconds
+  double mean_us() const {
+    const auto n = count();
+    return (n == 0) ? 0.0 : static_cast<double>(total_ns) / n / 1000.0;
+  }
+
+  /// Upper bound (in microseconds) of the bucket that contains the quantile
+  /// `q` (between 0 and 1), or zero if nothing was recorded
+  std::uint64_t quantile_us(double q) const {
+    const auto n = count();
+    if (n == 0) {
+      return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(n));
+    std::uint64_t seen = 0;
+    for (std::size_t b = 0; b < num_buckets; b++) {
+      seen += counts[b];
+      if (seen > rank || seen == n) {
+        return std::uint64_t(1) << b;
+      }
+    }
+    return std::uint64_t(1) << (num_buckets - 1);
+  }
+
+  /// Durations recorded since an earlier snapshot
+  LatencySnapshot operator-(const LatencySnapshot& earlier) const {
+    LatencySnapshot d;
+    for (std::size_t b = 0; b < num_buckets; b++) {
+      d.counts[b] = counts[b] - earlier.counts[b];
+    }
+    d.total_ns = total_ns - earlier.total_ns;
+    return d;
+  }
+};
+
+
+/// Histogram of durations with logarithmic buckets: bucket 0 holds durations
+/// below 1 us and bucket B durations in [2^(B-1), 2^B) us. Recording costs a
+/// few instructions. Counters are atomic, such that one thread may record
+/// while another one takes snapshots.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() {
+    for (auto& c : counts_) {
+      c.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  /// Record duration in nanoseconds (only one thread may record)
+  void record(Int ns) {
+    const auto us = static_cast<std::uint64_t>(ns < 0 ? 0 : ns) / 1000;
+    std::size_t b = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+    if (b >= LatencySnapshot::num_buckets) {
+      b = LatencySnapshot::num_buckets - 1;
+    }
+    add(counts_[b], 1);
+    add(total_ns_, static_cast<std::uint64_t>(ns < 0 ? 0 : ns));
+  }
+
+  /// Current counts
+  LatencySnapshot snapshot() const {
+    LatencySnapshot s;
+    for (std::size_t b = 0; b < LatencySnapshot::num_buckets; b++) {
+      s.counts[b] = counts_[b].load(std::memory_order_relaxed);
+    }
+    s.total_ns = total_ns_.load(std::memory_order_relaxed);
+    return s;
+  }
+
+ private:
+  // With a single recording thread, no atomic read-modify-write is needed
+  static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<std::uint64_t>, LatencySnapshot::num_buckets>
+      counts_;
+  std::atomic<std::uint64_t> total_ns_{0};
+};
+
+} // namespace sss
+
+#endif // SSS_HISTOGRAM_HPP
@@ -0,0 +1,213 @@
+#ifndef SSS_INDEX_HPP
+#define SSS_INDEX_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sss-format.hpp"
+#include "sss-mmap.hpp"
+
+namespace sss {
+
+/// Index files ('LOGFILE.idx') hold a sparse list of (timestamp, offset)
+/// pairs for a log file, such that readers can find the records of a time
+/// range without reading the log from the beginning:
+///
+///   offset  size  content
+///        0     8  magic bytes "SSS-IDX\0"
+///        8     4  format version
+///       12     4  entry size in bytes (16)
+///       16     -  entries: timestamp (8 bytes, signed), byte offset of the
+///                 record with this timestamp in the log file (8 bytes)
+///
+/// All values are little-endian. Entries are in time order. Since the index
+/// is written independently of the log, readers must verify that an entry
+/// matches the log before using it.
+constexpr char index_magic[8] = {'S', 'S', 'S', '-', 'I', 'D', 'X', '\0'};
+constexpr std::uint32_t index_version = 1;
+constexpr std::size_t index_header_size = 16;
+constexpr std::size_t index_entry_size = 16;
+
+/// Name of the index file for a log file
+inline std::string index_path(const std::string& log_path) {
+  return log_path + ".idx";
+}
+
+
+/// Return the first position in [0, count) whose timestamp is not before
+/// `from`, or `count` if there is none. `timestamp_at(i)` must be
+/// non-decreasing in i.
+template <typename F>
+inline std::uint64_t lower_bound_timestamp(std::uint64_t count, Int from,
+                                           F timestamp_at) {
+  std::uint64_t begin = 0;
+  while (count > 0) {
+    const auto half = count / 2;
+    if (timestamp_at(begin + half) < from) {
+      begin += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return begin;
+}
+
+
+/// Read access to an index file. The file is mapped, so a lookup only touches
+/// O(log n) pages.
+class LogIndex {
+ public:
+  /// Open index file, return false if it does not exist or is invalid
+  bool open(const std::string& path) {
+    if (!map_.open(path, false) || map_.size() < index_header_size
+        || std::memcmp(map_.data(), index_magic, sizeof(index_magic)) != 0
+        || load_le32(map_.data() + 8) != index_version
+        || load_le32(map_.data() + 12) != index_entry_size) {
+      map_.close();
+      return false;
+    }
+    return true;
+  }
+
+  /// Number of entries
+  std::uint64_t size() const {
+    return map_.size() < index_header_size
+           ? 0 : (map_.size() - index_header_size) / index_entry_size;
+  }
+
+  Int timestamp(std::uint64_t i) const {
+    return static_cast<Int>(load_le64(entry(i)));
+  }
+
+  std::uint64_t offset(std::uint64_t i) const {
+    return load_le64(entry(i) + 8);
+  }
+
+  /// Return position of the last entry with a timestamp before `from`, or
+  /// `size()` if there is none
+  std::uint64_t last_before(Int from) const {
+    const auto i = lower_bound_timestamp(
+        size(), from, [this](std::uint64_t j) { return timestamp(j); });
+    return (i == 0) ? size() : i - 1;
+  }
+
+ private:
+  const char* entry(std::uint64_t i) const {
+    return map_.data() + index_header_size + i * index_entry_size;
+  }
+
+  MappedFile map_;
+};
+
+
+/// Append-only writer for index files. Entries are buffered until flushed.
+class IndexWriter {
+ public:
+  IndexWriter() = default;
+
+  ~IndexWriter() { close(); }
+
+  IndexWriter(const IndexWriter&) = delete;
+  IndexWriter& operator=(const IndexWriter&) = delete;
+
+  /// Open (or create) the index for a log file of the given size. Entries of
+  /// an existing index are discarded if they do not fit the log file, e.g.,
+  /// because it was truncated in the meantime.
+  bool open(const std::string& path, std::uint64_t log_size) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      return false;
+    }
+    struct stat sb;
+    if (fstat(fd_, &sb) != 0) {
+      close();
+      return false;
+    }
+
+    // Check header and last entry of an existing index
+    auto size = static_cast<std::uint64_t>(sb.st_size);
+    char header[index_header_size];
+    char last[index_entry_size];
+    const bool valid =
+        size >= index_header_size
+        && ::pread(fd_, header, sizeof(header), 0) == sizeof(header)
+        && std::memcmp(header, index_magic, sizeof(index_magic)) == 0
+        && load_le32(header + 8) == index_version
+        && load_le32(header + 12) == index_entry_size;
+    size = valid ? size - (size - index_header_size) % index_entry_size : 0;
+    if (valid && size > index_header_size
+        && (::pread(fd_, last, sizeof(last),
+                    static_cast<off_t>(size - index_entry_size))
+            != sizeof(last)
+            || load_le64(last + 8) >= log_size)) {
+      size = index_header_size;
+    }
+
+    // Start new index if necessary
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+      close();
+      return false;
+    }
+    if (size == 0) {
+      buffer_.assign(index_magic, sizeof(index_magic));
+      buffer_.resize(index_header_size, '\0');
+      store_le32(index_version, &buffer_[8]);
+      store_le32(index_entry_size, &buffer_[12]);
+    }
+    size_ = size;
+    return true;
+  }
+
+  /// Add entry for the record with the given timestamp at the given offset
+  void add(Int timestamp, std::uint64_t offset) {
+    char entry[index_entry_size];
+    store_le64(static_cast<std::uint64_t>(timestamp), entry);
+    store_le64(offset, entry + 8);
+    buffer_.append(entry, sizeof(entry));
+  }
+
+  /// Write buffered entries
+  bool flush() {
+    while (!buffer_.empty()) {
+      const auto n = ::pwrite(fd_, buffer_.data(), buffer_.size(),
+                              static_cast<off_t>(size_));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buffer_.erase(0, static_cast<std::size_t>(n));
+      size_ += static_cast<std::uint64_t>(n);
+    }
+    return true;
+  }
+
+  /// Close file, discarding any entries that were not flushed
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+    size_ = 0;
+    buffer_.clear();
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+
+ private:
+  int fd_ = -1;
+  std::uint64_t size_ = 0;
+  std::string buffer_;
+};
+
+} // namespace sss
+
+#endif // SSS_INDEX_HPP
@@ -0,0 +1,88 @@
+#ifndef SSS_MMAP_HPP
+#define SSS_MMAP_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sss {
+
+/// Read-only memory mapping of an entire file
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept { swap(other); }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  /// Map file into memory, return false on error. Empty files are valid but
+  /// have no mapping. Unless `sequential` is false, the kernel is advised to
+  /// read ahead aggressively.
+  bool open(const std::string& path, bool sequential = true) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<std::size_t>(sb.st_size);
+    if (size_ > 0) {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        size_ = 0;
+        return false;
+      }
+      data_ = static_cast<const char*>(data);
+
+      // Files are usually read front to back
+      madvise(data, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    }
+    ::close(fd);
+    return true;
+  }
+
+  /// Unmap file
+  void close() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  const char* data() const { return data_; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  void swap(MappedFile& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace sss
+
+#endif // SSS_MMAP_HPP
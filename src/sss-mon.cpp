@@ -1,28 +1,109 @@
 #include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <string>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <vector>
+#include <fcntl.h>
 #include <getopt.h>
-#include <sys/statvfs.h>
-
-// Define types for statistic data - use 64 bit values (signed) for maximum
-// range and ease-of-use
-using Int = long long int;
-using Float = double;
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sss-block.hpp"
+#include "sss-burst.hpp"
+#include "sss-cgroup.hpp"
+#include "sss-collect.hpp"
+#include "sss-compact.hpp"
+#include "sss-cpu.hpp"
+#include "sss-derive.hpp"
+#include "sss-format.hpp"
+#include "sss-index.hpp"
+#include "sss-pool.hpp"
+#include "sss-proc.hpp"
+#include "sss-ring.hpp"
+#include "sss-rollup.hpp"
+#include "sss-scanner.hpp"
+#include "sss-selfstats.hpp"
+#include "sss-shm.hpp"
+#include "sss-spsc.hpp"
+#include "sss-time.hpp"
+
+using sss::Float;
+using sss::Format;
+using sss::Int;
+using sss::Sample;
 
 // Set sensible default values for network interface and sampling period
 constexpr const Int DEFAULT_ITERATIONS = 0;
 const std::string DEFAULT_NETWORK_INTERFACE = "eth0";
 const std::string DEFAULT_LOG_FILE = "";
-constexpr const Int DEFAULT_PERIOD = 1;
+constexpr const Int DEFAULT_PERIOD = 1000; // ms
 const std::string DEFAULT_STAT_PATH = ".";
+const std::string DEFAULT_PROC_ROOT = "/proc";
+constexpr const Format DEFAULT_FORMAT = Format::text;
+constexpr const Int DEFAULT_ROLLUP_RECORDS = 10000;
+constexpr const Int DEFAULT_FLUSH_INTERVAL = 0;
+constexpr const Int DEFAULT_SYNC_INTERVAL = 0;
+constexpr const Int DEFAULT_QUEUE_SIZE = 1024;
+constexpr const Int DEFAULT_BLOCK_SIZE = sss::default_block_samples;
+constexpr const Int DEFAULT_INDEX_INTERVAL = 1000;
+constexpr const Int DEFAULT_SELF_STATS_INTERVAL = 60000; // ms
+constexpr const Int DEFAULT_SHM_SAMPLES = 64;
+constexpr const Int DEFAULT_TOP = 10;
+constexpr const char* DEFAULT_CGROUP_ROOT = "/sys/fs/cgroup";
+constexpr const Int DEFAULT_BURST_COOLDOWN = 60000; // ms
 
 namespace {
+  /// Values for long options without a short equivalent
+  enum LongOption {
+    OPT_BLOCK_SIZE = 256,
+    OPT_BURST_COOLDOWN,
+    OPT_BURST_ON,
+    OPT_BURST_PERIOD,
+    OPT_CGROUP_FILE,
+    OPT_CGROUP_ROOT,
+    OPT_COLLECTORS,
+    OPT_COMPACT,
+    OPT_CPU_FILE,
+    OPT_DERIVED,
+    OPT_DISK,
+    OPT_DISK_FILE,
+    OPT_FIELDS,
+    OPT_FLUSH_INTERVAL,
+    OPT_INDEX_INTERVAL,
+    OPT_IO_URING,
+    OPT_MAX_RECORDS,
+    OPT_MOUNT_FILE,
+    OPT_NETWORK_FILE,
+    OPT_NUMA,
+    OPT_PROC_ROOT,
+    OPT_PROCESS_FILE,
+    OPT_QUEUE_SIZE,
+    OPT_ROLLUP,
+    OPT_ROLLUP_FILE,
+    OPT_ROLLUP_RECORDS,
+    OPT_ROLLUP_SKETCHES,
+    OPT_SELF_STATS,
+    OPT_SELF_STATS_INTERVAL,
+    OPT_SHM,
+    OPT_SHM_SAMPLES,
+    OPT_SYNC_INTERVAL,
+    OPT_TOP,
+  };
+
   /// Maximum file name length for time-encoded log files
   constexpr const Int max_log_file_name_length = 512;
 
@@ -30,49 +111,79 @@ namespace {
   struct CommandLineArguments {
     Int iterations = DEFAULT_ITERATIONS;
     std::string log_file = DEFAULT_LOG_FILE;
-    std::string network_interface = DEFAULT_NETWORK_INTERFACE;
+    std::vector<std::string> network_interfaces;
     Int period = DEFAULT_PERIOD;
-    std::string stat_path = DEFAULT_STAT_PATH;
+    Int burst_period = 0;
+    Int burst_cooldown = DEFAULT_BURST_COOLDOWN;
+    std::vector<sss::BurstCondition> burst_conditions;
+    std::vector<std::string> stat_paths;
+    std::vector<std::string> disk_devices;
+    Format format = DEFAULT_FORMAT;
+    bool has_format = false;
+    bool derived = false;
+    bool field_names = false;
+    Int max_records = 0;
+    std::string rollup;
+    std::string rollup_file;
+    Int rollup_records = DEFAULT_ROLLUP_RECORDS;
+    std::vector<std::size_t> rollup_sketches;
+    std::string cpu_file;
+    std::string network_file;
+    std::string disk_file;
+    std::string mount_file;
+    bool numa = false;
+    bool compact = false;
+    bool io_uring = false;
+    Int flush_interval = DEFAULT_FLUSH_INTERVAL;
+    Int sync_interval = DEFAULT_SYNC_INTERVAL;
+    Int queue_size = DEFAULT_QUEUE_SIZE;
+    Int block_size = DEFAULT_BLOCK_SIZE;
+    Int index_interval = DEFAULT_INDEX_INTERVAL;
+    std::string collectors;
+    std::string fields;
+    sss::FieldSelection selection;
+    std::string proc_root = DEFAULT_PROC_ROOT;
+    std::string self_stats;
+    Int self_stats_interval = DEFAULT_SELF_STATS_INTERVAL;
+    std::string shm;
+    std::string process_file;
+    Int top = DEFAULT_TOP;
+    std::string cgroup_file;
+    std::string cgroup_root = DEFAULT_CGROUP_ROOT;
+    Int shm_samples = DEFAULT_SHM_SAMPLES;
   };
+}
 
-  /// Internal data structure for statistical data sample
-  struct Sample {
-    // Timestamp values may be signed
-    Int timestamp = 0;
-    Int steady = 0;
-
-    // Load values may be decimal numbers
-    Float cpu_load_1m = 0.0;
-    Float cpu_load_5m = 0.0;
-    Float cpu_load_15m = 0.0;
-
-    // All other values are counters that cannot be negative
-    Int cpu_time_user = 0;
-    Int cpu_time_nice = 0;
-    Int cpu_time_system = 0;
-    Int cpu_time_idle = 0;
-    Int cpu_time_iowait = 0;
-    Int cpu_time_irq = 0;
-    Int cpu_time_softirq = 0;
-    Int cpu_time_steal = 0;
-    Int cpu_time_guest = 0;
-    Int cpu_time_guest_nice = 0;
-    Int memory_total = 0;
-    Int memory_used = 0;
-    Int swap_total = 0;
-    Int swap_used = 0;
-    Int disk_total = 0;
-    Int disk_used = 0;
-    Int disk_available = 0;
-    Int network_received = 0;
-    Int network_sent = 0;
-  };
+
+/// Print field description word-wrapped at 76 columns in the style of the
+/// usage information
+static void print_field(std::ostream& os, const std::string& name,
+                          const std::string& description) {
+  constexpr std::size_t indent = 24;
+  std::string line = "  " + name;
+  if (line.size() + 1 > indent) {
+    os << line << "\n";
+    line.clear();
+  }
+  line.resize(indent, ' ');
+  std::istringstream words(description);
+  bool first = true;
+  for (std::string word; words >> word; first = false) {
+    if (!first && line.size() + 1 + word.size() > 76) {
+      os << line << "\n";
+      line.assign(indent, ' ');
+      first = true;
+    }
+    line += (first ? "" : " ") + word;
+  }
+  os << line << "\n";
 }
 
 
 /// Print usage information
 static void print_usage(std::ostream& os = std::cerr) {
-  os << "usage: sss-mon [-f] [-h] [-i INTERFACE] [-p PERIOD] [LOGFILE]\n"
+  os << "usage: sss-mon [-f] [-h] [-F FORMAT] [-i INTERFACE] [-p PERIOD] "
+     << "[LOGFILE]\n"
      << "\n"
      << "sss-mon gathers information on the current CPU load, memory usage, \n"
      << "and network traffic and writes it to stdout or a log file. Once \n"
@@ -90,9 +201,120 @@ static void print_usage(std::ostream& os = std::cerr) {
      << ".\n"
      << "\n"
      << "optional arguments:\n"
+     << "  --block-size SAMPLES  Number of samples per block in compressed\n"
+     << "                        format. Samples are kept in memory until a\n"
+     << "                        block is complete (default: "
+     << DEFAULT_BLOCK_SIZE << ").\n"
+     << "  --burst-cooldown DURATION\n"
+     << "                        Return to the base period once no burst\n"
+     << "                        condition has held for DURATION (e.g.,\n"
+     << "                        '5m'; units: ms, s, m, h, d; default: "
+     << DEFAULT_BURST_COOLDOWN / 1000 << "s).\n"
+     << "  --burst-on CONDITION  Start (or extend) a burst when CONDITION\n"
+     << "                        holds for the values derived from a sample\n"
+     << "                        and its predecessor (see --derived). May be\n"
+     << "                        given multiple times. Conditions have the\n"
+     << "                        form 'FIELD>VALUE' or 'FIELD<VALUE', e.g.,\n"
+     << "                        'cpu_iowait>0.2' or 'network_received>1e8'.\n"
+     << "                        With a leading '+', the increase since the\n"
+     << "                        previous sample is compared instead, e.g.,\n"
+     << "                        '+swap_used>0' or '+cpu_user>0.3'.\n"
+     << "  --burst-period PERIOD\n"
+     << "                        Sample at PERIOD (shorter than --period)\n"
+     << "                        while a burst is in progress. The period in\n"
+     << "                        effect is written with each sample (field\n"
+     << "                        'period').\n"
+     << "  --cgroup-file CGROUP_FILE\n"
+     << "                        Additionally append one line per cgroup in\n"
+     << "                        the subtree of --cgroup-root (including\n"
+     << "                        itself) and sample to CGROUP_FILE with its\n"
+     << "                        CPU time, throttling, memory, I/O, and\n"
+     << "                        pressure stall counters (cgroup v2 only).\n"
+     << "  --cgroup-root DIR     Root of the cgroup subtree for --cgroup-file\n"
+     << "                        (default: " << DEFAULT_CGROUP_ROOT << ").\n"
+     << "  --collectors COLLECTORS\n"
+     << "                        Only gather the fields of the given comma-\n"
+     << "                        separated list of collectors (see below).\n"
+     << "                        Data sources of other collectors are never\n"
+     << "                        read. Can be combined with --fields.\n"
+     << "  --compact             Once a log file is closed because its time-\n"
+     << "                        formatted name changed, compress it in a\n"
+     << "                        background thread: its samples are appended\n"
+     << "                        to 'LOGFILE.cmp' in compressed format (with\n"
+     << "                        index), and the log file and its index are\n"
+     << "                        removed (text or binary format only).\n"
+     << "  --derived             Write utilization fractions and rates per\n"
+     << "                        second computed from consecutive samples\n"
+     << "                        instead of the raw counters (text format\n"
+     << "                        only, see below). Counter resets (e.g., of\n"
+     << "                        removed interfaces) yield zero rates.\n"
      << "  -f, --field-names     Print space-separated list of field names\n"
-     << "                        to stdout and exit.\n"
+     << "                        (of derived fields with --derived) to stdout\n"
+     << "                        and exit.\n"
+     << "  --fields FIELDS       Only gather the given comma-separated list\n"
+     << "                        of fields (see below), plus timestamp and\n"
+     << "                        time_delta. In binary and compressed format,\n"
+     << "                        only these fields are written. In text\n"
+     << "                        format, all other fields are written as zero\n"
+     << "                        such that the columns stay the same.\n"
+     << "  --cpu-file CPU_FILE   Additionally gather statistics for each\n"
+     << "                        CPU and append one line per CPU and sample\n"
+     << "                        to CPU_FILE with the fraction of user,\n"
+     << "                        system, nice, idle, iowait, and steal time\n"
+     << "                        since the previous sample.\n"
+     << "  --disk DEVICE         Gather I/O statistics for the given block\n"
+     << "                        device in '/proc/diskstats'. May be given\n"
+     << "                        multiple times and may contain shell\n"
+     << "                        wildcards (e.g., 'nvme*'), or be 'all' for\n"
+     << "                        all devices. The I/O of all matching devices\n"
+     << "                        is added up (default: all disks, but no\n"
+     << "                        partitions, loop, ram, or dm devices).\n"
+     << "  --disk-file DISK_FILE\n"
+     << "                        Additionally append one line per matching\n"
+     << "                        block device and sample to DISK_FILE with\n"
+     << "                        its I/O counters (see io fields below).\n"
+     << "  -F, --format FORMAT   Output format, either 'text', 'binary', or\n"
+     << "                        'compressed' (default: "
+     << sss::format_name(DEFAULT_FORMAT) << "). See below for\n"
+     << "                        details.\n"
+     << "  --flush-interval INTERVAL\n"
+     << "                        Samples and all other output files are\n"
+     << "                        written by a separate thread, such that\n"
+     << "                        slow disks do not delay sampling. Buffered\n"
+     << "                        data is written to the files at most every\n"
+     << "                        INTERVAL (e.g., '10s';\n"
+     << "                        units: ms, s, m, h, d; default: "
+     << DEFAULT_FLUSH_INTERVAL << ",\n"
+     << "                        i.e., immediately).\n"
      << "  -h, --help            Show this help message and exit.\n"
+     << "  --index-interval RECORDS\n"
+     << "                        Maintain the index file 'LOGFILE.idx' with\n"
+     << "                        the timestamp and file offset of every\n"
+     << "                        RECORDS-th record (of every block in\n"
+     << "                        compressed format), which allows reading a\n"
+     << "                        time range without scanning the whole log.\n"
+     << "                        Zero disables the index (default: "
+     << DEFAULT_INDEX_INTERVAL << ").\n"
+     << "  --io-uring            Read the proc files of all collectors (and\n"
+     << "                        the files of all cgroups for --cgroup-file)\n"
+     << "                        with one io_uring submission per sample\n"
+     << "                        instead of one read() each, which saves\n"
+     << "                        system calls on hosts with many sources.\n"
+     << "                        Falls back to read() on kernels without\n"
+     << "                        io_uring.\n"
+     << "  --max-records RECORDS\n"
+     << "                        Write LOGFILE as a ring file with a fixed\n"
+     << "                        number of preallocated record slots. Once\n"
+     << "                        all slots are used, each new sample\n"
+     << "                        overwrites the oldest one, such that the\n"
+     << "                        file never needs to be truncated. Ring\n"
+     << "                        files are always in binary format and can be\n"
+     << "                        read with 'sss-convert'.\n"
+     << "  --mount-file MOUNT_FILE\n"
+     << "                        Additionally append one line per stat path\n"
+     << "                        and sample to MOUNT_FILE with the total,\n"
+     << "                        used, and available bytes of its file\n"
+     << "                        system.\n"
      << "  -n, --iterations ITERATIONS\n"
      << "                        Number of samples to gather. Must be a \n"
      << "                        non-negative integer value. If set to zero, \n"
@@ -100,61 +322,137 @@ static void print_usage(std::ostream& os = std::cerr) {
      << "                        (default: " << DEFAULT_ITERATIONS << ").\n"
      << "  -i, --network-interface INTERFACE\n"
      << "                        Gather traffic statistics for the given\n"
-     << "                        network interface. INTERFACE must be a valid\n"
-     << "                        interface in '/proc/net/dev' (default: "
+     << "                        network interface in '/proc/net/dev'. May be\n"
+     << "                        given multiple times and may contain shell\n"
+     << "                        wildcards (e.g., 'veth*'), or be 'all' for\n"
+     << "                        all interfaces. The traffic of all matching\n"
+     << "                        interfaces is added up (default: "
      << DEFAULT_NETWORK_INTERFACE << ").\n"
-     << "  -p, --period PERIOD   Set sampling period (in seconds). Must be a\n"
-     << "                        positive integer value (default: "
-     << DEFAULT_PERIOD << ").\n"
+     << "  --network-file NETWORK_FILE\n"
+     << "                        Additionally append one line per matching\n"
+     << "                        network interface and sample to NETWORK_FILE\n"
+     << "                        with the bytes, packets, errors, and dropped\n"
+     << "                        packets received and sent (as counters).\n"
+     << "  --rollup TIERS        Additionally aggregate samples into time\n"
+     << "                        windows of the given colon-separated widths\n"
+     << "                        (e.g., '10s:1m:1h:1d'; units: ms, s, m, h,\n"
+     << "                        d). Windows are aligned to multiples of\n"
+     << "                        their width since the Unix epoch. For each\n"
+     << "                        window, a line with the window start, its\n"
+     << "                        width, the number of samples, min/max/mean/\n"
+     << "                        last of each gauge and the rate per second\n"
+     << "                        of each counter (cpu_time_*, network_*,\n"
+     << "                        io_*) is written to 'ROLLUP_FILE.WIDTH'.\n"
+     << "  --rollup-file ROLLUP_FILE\n"
+     << "                        Prefix for rollup files (required with\n"
+     << "                        --rollup).\n"
+     << "  --rollup-records RECORDS\n"
+     << "                        Maximum number of records per rollup file.\n"
+     << "                        Once reached, the file is renamed to\n"
+     << "                        'ROLLUP_FILE.WIDTH.old' and a new file is\n"
+     << "                        started. Zero means unbounded (default: "
+     << DEFAULT_ROLLUP_RECORDS << ").\n"
+     << "  --rollup-sketches FIELDS\n"
+     << "                        Additionally keep a quantile sketch of the\n"
+     << "                        given comma-separated derived fields (see\n"
+     << "                        '--derived -f') for each rollup window, and\n"
+     << "                        write one line per window and field with\n"
+     << "                        p50/p90/p99/max and the mergeable sketch to\n"
+     << "                        'ROLLUP_FILE.WIDTH.sketch' (see\n"
+     << "                        sss-quantiles).\n"
+     << "  --numa                With --cpu-file, also write one line per\n"
+     << "                        NUMA node with the utilization of all its\n"
+     << "                        CPUs (as listed in\n"
+     << "                        /sys/devices/system/node).\n"
+     << "  --proc-root DIR       Read the files of the proc filesystem from\n"
+     << "                        DIR instead, e.g., synthetic files for\n"
+     << "                        tests and benchmarks (default: "
+     << DEFAULT_PROC_ROOT << ").\n"
+     << "  --process-file PROCESS_FILE\n"
+     << "                        Additionally scan all processes and append\n"
+     << "                        the top processes by CPU time since the\n"
+     << "                        previous sample and by resident memory to\n"
+     << "                        PROCESS_FILE, one line per process with its\n"
+     << "                        rank, pid, CPU time (in ms), resident memory\n"
+     << "                        (in bytes), and command name (see --top).\n"
+     << "  --queue-size SAMPLES  Maximum number of samples waiting for the\n"
+     << "                        writer thread. If the queue is full, new\n"
+     << "                        samples are dropped and reported on stderr\n"
+     << "                        (default: " << DEFAULT_QUEUE_SIZE << ").\n"
+     << "  -p, --period PERIOD   Set sampling period as a positive integer\n"
+     << "                        with an optional unit (ms, s, m, h, d; e.g.,\n"
+     << "                        '100ms'). Plain integers are seconds.\n"
+     << "                        Samples are taken at multiples of the period\n"
+     << "                        since the Unix epoch, e.g., at every full\n"
+     << "                        second, such that logs of different hosts\n"
+     << "                        line up (default: " << DEFAULT_PERIOD
+     << "ms).\n"
+     << "  --self-stats SELF_STATS_FILE\n"
+     << "                        Measure the overhead of sss-mon itself and\n"
+     << "                        append one line per --self-stats-interval to\n"
+     << "                        SELF_STATS_FILE with its CPU time (also as a\n"
+     << "                        fraction of a core), resident memory, and\n"
+     << "                        the mean, 99th percentile, and maximum\n"
+     << "                        latency (in us, as power-of-two bucket\n"
+     << "                        bounds) of timer wake-ups, of each\n"
+     << "                        collector, and of writing and flushing. A\n"
+     << "                        summary is printed to stderr on exit.\n"
+     << "  --self-stats-interval INTERVAL\n"
+     << "                        Interval for --self-stats lines (e.g., '1h';\n"
+     << "                        units: ms, s, m, h, d; default: "
+     << DEFAULT_SELF_STATS_INTERVAL / 1000 << "s).\n"
+     << "  --shm NAME            Additionally publish the most recent samples\n"
+     << "                        in the POSIX shared memory object NAME\n"
+     << "                        (e.g., '/sss-mon', see shm_open(3)), from\n"
+     << "                        which local processes can read the current\n"
+     << "                        values without syscalls using the reader in\n"
+     << "                        'sss-shm.hpp'. All fields are published.\n"
+     << "  --shm-samples SAMPLES\n"
+     << "                        Number of samples kept in the shared memory\n"
+     << "                        object (default: " << DEFAULT_SHM_SAMPLES
+     << ").\n"
      << "  -s, --stat-file       Path to file/directory on the file system\n"
      << "                        that should be used to gather disk usage\n"
-     << "                        statistics (default: " << DEFAULT_STAT_PATH
+     << "                        statistics. May be given multiple times,\n"
+     << "                        in which case the usage of all distinct\n"
+     << "                        file systems is added up (default: "
+     << DEFAULT_STAT_PATH << ").\n"
+     << "  --sync-interval INTERVAL\n"
+     << "                        Additionally call fdatasync() on the log\n"
+     << "                        file every INTERVAL. Zero means never\n"
+     << "                        (default: " << DEFAULT_SYNC_INTERVAL << ").\n"
+     << "  --top PROCESSES       Number of processes per order in\n"
+     << "                        --process-file (default: " << DEFAULT_TOP
      << ").\n"
      << "\n"
      << "For each sample, a space-separated list of the following fields is\n"
      << "written to stdout or a log file and terminated by a newline \n"
-     << "character (\\n):\n"
-     << "  timestamp             Unix timestamp (in milliseconds).\n"
-     << "  time_delta            Time since last sample was recorded (in \n"
-     << "                        milliseconds). A value of zero indicates\n"
-     << "                        that this is the first sample since\n"
-     << "                        (re-)starting sss-mon.\n"
-     << "  cpu_load_1m           CPU load average (1 minute average).\n"
-     << "  cpu_load_5m           CPU load average (5 minute average).\n"
-     << "  cpu_load_15m          CPU load average (15 minute average).\n"
-     << "  cpu_time_user         CPU time spent in user mode.\n"
-     << "  cpu_time_nice         CPU time spent in user mode with low \n"
-     << "                        priority (nice).\n"
-     << "  cpu_time_system       CPU time spent in system mode.\n"
-     << "  cpu_time_idle         CPU time spent in the idle task.\n"
-     << "  cpu_time_iowait       CPU time waiting for I/O to complete.\n"
-     << "  cpu_time_irq          CPU time servicing interrupts.\n"
-     << "  cpu_time_softirq      CPU time ervicing softirqs.\n"
-     << "  cpu_time_steal        CPU stolen time, which is the time spent in\n"
-     << "                        other operating systems when running in a \n"
-     << "                        virtualized environment.\n"
-     << "  cpu_time_guest        CPU time spent running a virtual CPU for \n"
-     << "                        guest operating systems under the control of\n"
-     << "                        the Linux kernel.\n"
-     << "  cpu_time_guest_nice   CPU time spent running a niced guest \n"
-     << "                        (virtual CPU for guest operating systems\n"
-     << "                        under the control of the Linux kernel).\n"
-     << "  memory_total          Total usable RAM (in bytes).\n"
-     << "  memory_used           Memory currently in use (in bytes).\n"
-     << "  swap_total            Total amount of swap space (in bytes).\n"
-     << "  swap_used             Swap space currently in use (in bytes).\n"
-     << "  disk_total            Total usable disk space (in bytes).\n"
-     << "  disk_used             Disk space currently in use (in bytes).\n"
-     << "  disk_available        Disk space available for non-privileged\n"
-     << "                        users (in bytes).\n"
-     << "  network_received      Total bytes received (in bytes).\n"
-     << "  network_sent          Total bytes sent (in bytes).\n"
+     << "character (\\n). Fields are grouped by the collector that gathers\n"
+     << "them (see --collectors). Most of the information is gathered from\n"
+     << "the 'proc' filesystem (see also 'man proc').\n";
+  for (const auto& c : sss::collector_registry()) {
+    os << "\n" << c.name << " (from " << c.source << "):\n";
+    for (const auto& f : c.fields) {
+      print_field(os, f.name, f.description);
+    }
+  }
+  os << "\n"
+     << "In binary format, the output starts with a header that lists the\n"
+     << "field names, followed by one fixed-size record per sample with one\n"
+     << "8 byte little-endian value per field (integers or IEEE 754 doubles).\n"
+     << "When appending to an existing binary log file, its header must\n"
+     << "match. Compressed format stores blocks of samples column by column,\n"
+     << "with delta-of-delta encoded timestamps, delta encoded integers, and\n"
+     << "XOR encoded floating point values, which typically needs less than\n"
+     << "a tenth of the space of text format. Use 'sss-convert' to convert\n"
+     << "between all formats.\n"
      << "\n"
-     << "Most of the information is gathered from the 'proc' filesystem (see\n"
-     << "also 'man proc'). CPU data is from '/proc/loadavg' and '/proc/stat',\n"
-     << "memory data is from '/proc/meminfo', and network data is from\n"
-     << "'/proc/net/dev'. Disk usage statistics are obtained through the\n"
-     << "system call 'statvfs()'.\n";
+     << "With --derived, one line per sample (except the first one) is\n"
+     << "written with the following fields, computed from the sample and its\n"
+     << "predecessor:\n";
+  for (const auto& f : sss::derived_fields()) {
+    print_field(os, f.name, f.description);
+  }
   os.flush();
 }
 
@@ -167,18 +465,53 @@ static CommandLineArguments parse_arguments(int argc, char* argv[]) {
   while (true) {
     // Create structure with long options
     static struct option long_options[] = {
+      {"block-size", required_argument, nullptr, OPT_BLOCK_SIZE},
+      {"burst-cooldown", required_argument, nullptr, OPT_BURST_COOLDOWN},
+      {"burst-on", required_argument, nullptr, OPT_BURST_ON},
+      {"burst-period", required_argument, nullptr, OPT_BURST_PERIOD},
+      {"cgroup-file", required_argument, nullptr, OPT_CGROUP_FILE},
+      {"cgroup-root", required_argument, nullptr, OPT_CGROUP_ROOT},
+      {"collectors", required_argument, nullptr, OPT_COLLECTORS},
+      {"compact", no_argument, nullptr, OPT_COMPACT},
+      {"cpu-file", required_argument, nullptr, OPT_CPU_FILE},
+      {"derived", no_argument, nullptr, OPT_DERIVED},
+      {"disk", required_argument, nullptr, OPT_DISK},
+      {"disk-file", required_argument, nullptr, OPT_DISK_FILE},
       {"field-names", no_argument, nullptr, 'f'},
+      {"fields", required_argument, nullptr, OPT_FIELDS},
+      {"flush-interval", required_argument, nullptr, OPT_FLUSH_INTERVAL},
+      {"format", required_argument, nullptr, 'F'},
       {"help", no_argument, nullptr, 'h'},
+      {"index-interval", required_argument, nullptr, OPT_INDEX_INTERVAL},
+      {"io-uring", no_argument, nullptr, OPT_IO_URING},
       {"iterations", required_argument, nullptr, 'n'},
+      {"max-records", required_argument, nullptr, OPT_MAX_RECORDS},
+      {"mount-file", required_argument, nullptr, OPT_MOUNT_FILE},
+      {"network-file", required_argument, nullptr, OPT_NETWORK_FILE},
       {"network-interface", required_argument, nullptr, 'i'},
+      {"numa", no_argument, nullptr, OPT_NUMA},
       {"period", required_argument, nullptr, 'p'},
+      {"proc-root", required_argument, nullptr, OPT_PROC_ROOT},
+      {"process-file", required_argument, nullptr, OPT_PROCESS_FILE},
+      {"queue-size", required_argument, nullptr, OPT_QUEUE_SIZE},
+      {"rollup", required_argument, nullptr, OPT_ROLLUP},
+      {"rollup-file", required_argument, nullptr, OPT_ROLLUP_FILE},
+      {"rollup-records", required_argument, nullptr, OPT_ROLLUP_RECORDS},
+      {"rollup-sketches", required_argument, nullptr, OPT_ROLLUP_SKETCHES},
+      {"self-stats", required_argument, nullptr, OPT_SELF_STATS},
+      {"self-stats-interval", required_argument, nullptr,
+       OPT_SELF_STATS_INTERVAL},
+      {"shm", required_argument, nullptr, OPT_SHM},
+      {"shm-samples", required_argument, nullptr, OPT_SHM_SAMPLES},
       {"stat-path", required_argument, nullptr, 's'},
+      {"sync-interval", required_argument, nullptr, OPT_SYNC_INTERVAL},
+      {"top", required_argument, nullptr, OPT_TOP},
       {nullptr, 0, nullptr, 0}
     };
 
     // Get next argument
     const auto c = getopt_long(
-        argc, argv, "fhn:l:i:p:s:", long_options, nullptr);
+        argc, argv, "fF:hn:l:i:p:s:", long_options, nullptr);
 
     // Exit loop if end of options is reached
     if (c == -1) {
@@ -190,32 +523,27 @@ static CommandLineArguments parse_arguments(int argc, char* argv[]) {
       // Print field names and quit
       case 'f':
         {
-          std::cout << "timestamp"
-                    << " time_delta"
-                    << " cpu_load_1m"
-                    << " cpu_load_5m"
-                    << " cpu_load_15m"
-                    << " cpu_time_user"
-                    << " cpu_time_nice"
-                    << " cpu_time_system"
-                    << " cpu_time_idle"
-                    << " cpu_time_iowait"
-                    << " cpu_time_irq"
-                    << " cpu_time_softirq"
-                    << " cpu_time_steal"
-                    << " cpu_time_guest"
-                    << " cpu_time_guest_nice"
-                    << " memory_total"
-                    << " memory_used"
-                    << " swap_total"
-                    << " swap_used"
-                    << " disk_total"
-                    << " disk_used"
-                    << " disk_available"
-                    << " network_received"
-                    << " network_sent"
-                    << std::endl;
-          exit(0);
+          args.field_names = true;
+          break;
+        }
+
+      // Write derived values instead of raw counters
+      case OPT_DERIVED:
+        {
+          args.derived = true;
+          break;
+        }
+
+      // Set output format
+      case 'F':
+        {
+          if (!sss::parse_format(optarg, args.format)) {
+            std::cerr << "error: argument to '-F|--format' (" << optarg
+                      << ") is not a valid format" << std::endl;
+            exit(2);
+          }
+          args.has_format = true;
+          break;
         }
 
       // Show usage information and quit
@@ -242,45 +570,366 @@ static CommandLineArguments parse_arguments(int argc, char* argv[]) {
           break;
         }
 
-      // Set network interface
+      // Add network interface
       case 'i':
         {
-          args.network_interface = optarg;
+          args.network_interfaces.push_back(optarg);
           break;
         }
 
       // Set sampling period
       case 'p':
+        {
+          // Parse argument as duration in milliseconds
+          if (!sss::parse_duration(optarg, args.period, "s")) {
+            std::cerr << "error: argument to '-p|--period' (" << optarg
+                      << ") is not a positive duration" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set burst period and cooldown
+      case OPT_BURST_PERIOD:
+      case OPT_BURST_COOLDOWN:
+        {
+          const bool period = (c == OPT_BURST_PERIOD);
+          if (!sss::parse_duration(optarg, period ? args.burst_period
+                                                  : args.burst_cooldown,
+                                   "s")) {
+            std::cerr << "error: argument to '"
+                      << (period ? "--burst-period" : "--burst-cooldown")
+                      << "' (" << optarg << ") is not a positive duration"
+                      << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Add burst condition
+      case OPT_BURST_ON:
+        {
+          sss::BurstCondition condition;
+          if (!sss::parse_burst_condition(optarg, condition)) {
+            std::cerr << "error: argument to '--burst-on' (" << optarg
+                      << ") is not a valid condition" << std::endl;
+            exit(2);
+          }
+          args.burst_conditions.push_back(condition);
+          break;
+        }
+
+      // Add stat path
+      case 's':
+        {
+          args.stat_paths.push_back(optarg);
+          break;
+        }
+
+      // Set number of records in ring file
+      case OPT_MAX_RECORDS:
         {
           // Try to parse argument as integer
           std::istringstream arg(optarg);
-          arg >> args.period;
+          arg >> args.max_records;
 
           // Handle bad arguments
           if (arg.fail()
-              || arg.get() != std::istringstream::traits_type::eof()) {
-            std::cerr << "error: argument to '-p|--period' (" << optarg
-                      << ") is not an integer" << std::endl;
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.max_records < 1) {
+            std::cerr << "error: argument to '--max-records' (" << optarg
+                      << ") is not a positive integer" << std::endl;
             exit(2);
-          } else if (args.period < 1) {
-            std::cerr << "error: argument to '-p|--period' (" << optarg
-                      << ") is less than one" << std::endl;
+          }
+          break;
+        }
+
+      // Set rollup tiers
+      case OPT_ROLLUP:
+        {
+          args.rollup = optarg;
+          break;
+        }
+
+      // Set rollup file prefix
+      case OPT_ROLLUP_FILE:
+        {
+          args.rollup_file = optarg;
+          break;
+        }
+
+      // Set maximum number of records per rollup file
+      case OPT_ROLLUP_RECORDS:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.rollup_records;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.rollup_records < 0) {
+            std::cerr << "error: argument to '--rollup-records' (" << optarg
+                      << ") is not a non-negative integer" << std::endl;
             exit(2);
           }
           break;
         }
 
-      // Set stat path
-      case 's':
+      // Set derived fields with quantile sketches in rollup windows
+      case OPT_ROLLUP_SKETCHES:
+        {
+          std::istringstream arg(optarg);
+          std::string name;
+          while (std::getline(arg, name, ',')) {
+            std::size_t field = 0;
+            if (!sss::find_derived_field(name, field)) {
+              std::cerr << "error: argument to '--rollup-sketches' ("
+                        << optarg << ") contains unknown field '" << name
+                        << "'" << std::endl;
+              exit(2);
+            }
+            args.rollup_sketches.push_back(field);
+          }
+          break;
+        }
+
+      // Set number of samples per compressed block
+      case OPT_BLOCK_SIZE:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.block_size;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.block_size <= 0 || args.block_size > (1 << 20)) {
+            std::cerr << "error: argument to '--block-size' (" << optarg
+                      << ") is not an integer between 1 and " << (1 << 20)
+                      << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Select collectors and fields
+      case OPT_COLLECTORS:
+        {
+          args.collectors = optarg;
+          break;
+        }
+      case OPT_FIELDS:
+        {
+          args.fields = optarg;
+          break;
+        }
+
+      // Compress closed log files
+      case OPT_COMPACT:
+        {
+          args.compact = true;
+          break;
+        }
+
+      // Set per-CPU statistics file
+      case OPT_CPU_FILE:
+        {
+          args.cpu_file = optarg;
+          break;
+        }
+
+      // Set per-interface statistics file
+      case OPT_NETWORK_FILE:
+        {
+          args.network_file = optarg;
+          break;
+        }
+
+      // Add block device
+      case OPT_DISK:
+        {
+          args.disk_devices.push_back(optarg);
+          break;
+        }
+
+      // Set per-device I/O statistics file
+      case OPT_DISK_FILE:
+        {
+          args.disk_file = optarg;
+          break;
+        }
+
+      // Set per-path disk usage file
+      case OPT_MOUNT_FILE:
+        {
+          args.mount_file = optarg;
+          break;
+        }
+
+      // Enable per-NUMA-node statistics
+      case OPT_NUMA:
+        {
+          args.numa = true;
+          break;
+        }
+
+      // Set flush and sync intervals (zero or a duration)
+      case OPT_FLUSH_INTERVAL:
+      case OPT_SYNC_INTERVAL:
+        {
+          auto& interval = (c == OPT_FLUSH_INTERVAL) ? args.flush_interval
+                                                     : args.sync_interval;
+          if (std::string(optarg) == "0") {
+            interval = 0;
+          } else if (!sss::parse_duration(optarg, interval)) {
+            std::cerr << "error: argument to '"
+                      << (c == OPT_FLUSH_INTERVAL ? "--flush-interval"
+                                                  : "--sync-interval")
+                      << "' (" << optarg << ") is not a valid duration"
+                      << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Read files in batches with io_uring
+      case OPT_IO_URING:
+        {
+          args.io_uring = true;
+          break;
+        }
+
+      // Set number of records per index entry
+      case OPT_INDEX_INTERVAL:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.index_interval;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.index_interval < 0) {
+            std::cerr << "error: argument to '--index-interval' (" << optarg
+                      << ") is not a non-negative integer" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set directory to read proc files from
+      case OPT_PROC_ROOT:
+        {
+          args.proc_root = optarg;
+          break;
+        }
+
+      // Set per-process statistics file
+      case OPT_PROCESS_FILE:
+        {
+          args.process_file = optarg;
+          break;
+        }
+
+      // Set per-cgroup statistics file
+      case OPT_CGROUP_FILE:
+        {
+          args.cgroup_file = optarg;
+          break;
+        }
+
+      // Set root of cgroup subtree
+      case OPT_CGROUP_ROOT:
+        {
+          args.cgroup_root = optarg;
+          break;
+        }
+
+      // Set number of top processes
+      case OPT_TOP:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.top;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.top <= 0) {
+            std::cerr << "error: argument to '--top' (" << optarg
+                      << ") is not a positive integer" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set self statistics file and interval
+      case OPT_SELF_STATS:
+        {
+          args.self_stats = optarg;
+          break;
+        }
+      case OPT_SELF_STATS_INTERVAL:
         {
-          args.stat_path = optarg;
+          if (!sss::parse_duration(optarg, args.self_stats_interval)) {
+            std::cerr << "error: argument to '--self-stats-interval' ("
+                      << optarg << ") is not a positive duration"
+                      << std::endl;
+            exit(2);
+          }
+          break;
+        }
 
-          // Make sure that the path exists and can be used
-          struct statvfs sb;
-          if (statvfs(args.stat_path.c_str(), &sb) != 0) {
-            std::cerr << "error: stat path (" << args.stat_path << ") does"
-                      << " not exit or cannot be used" << std::endl;
-            std::exit(2);
+      // Set maximum number of queued samples
+      case OPT_QUEUE_SIZE:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.queue_size;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.queue_size <= 0 || args.queue_size > (1 << 20)) {
+            std::cerr << "error: argument to '--queue-size' (" << optarg
+                      << ") is not an integer between 1 and " << (1 << 20)
+                      << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set name of shared memory ring
+      case OPT_SHM:
+        {
+          args.shm = optarg;
+          if (args.shm.size() < 2 || args.shm[0] != '/'
+              || args.shm.find('/', 1) != std::string::npos) {
+            std::cerr << "error: argument to '--shm' (" << optarg
+                      << ") must be a name of the form '/NAME'" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set number of samples in shared memory ring
+      case OPT_SHM_SAMPLES:
+        {
+          // Try to parse argument as integer
+          std::istringstream arg(optarg);
+          arg >> args.shm_samples;
+
+          // Handle bad arguments
+          if (arg.fail()
+              || arg.get() != std::istringstream::traits_type::eof()
+              || args.shm_samples < 2 || args.shm_samples > (1 << 20)) {
+            // With a single slot, the latest sample would be overwritten
+            // while it is being published
+            std::cerr << "error: argument to '--shm-samples' (" << optarg
+                      << ") is not an integer between 2 and " << (1 << 20)
+                      << std::endl;
+            exit(2);
           }
           break;
         }
@@ -303,6 +952,84 @@ static CommandLineArguments parse_arguments(int argc, char* argv[]) {
     }
   }
 
+  // Print field names and exit
+  if (args.field_names) {
+    const char* separator = "";
+    if (args.derived) {
+      for (const auto& f : sss::derived_fields()) {
+        std::cout << separator << f.name;
+        separator = " ";
+      }
+    } else {
+      for (const auto& f : sss::sample_fields()) {
+        std::cout << separator << f.name;
+        separator = " ";
+      }
+    }
+    std::cout << std::endl;
+    exit(0);
+  }
+
+  // Derived values are only written as text
+  if (args.derived && (args.format != Format::text || args.max_records > 0)) {
+    std::cerr << "error: '--derived' requires text format" << std::endl;
+    exit(2);
+  }
+
+  // Determine collectors to run and fields to write
+  std::string error;
+  if (!sss::select_fields(args.collectors, args.fields, args.selection,
+                          error)) {
+    std::cerr << "error: " << error << " in '--collectors' or '--fields'"
+              << std::endl;
+    exit(2);
+  }
+
+  // Bursts need conditions and a period shorter than the base period
+  if (args.burst_period > 0) {
+    if (args.burst_conditions.empty()) {
+      std::cerr << "error: '--burst-period' requires '--burst-on'"
+                << std::endl;
+      exit(2);
+    }
+    if (args.burst_period >= args.period) {
+      std::cerr << "error: '--burst-period' must be shorter than the "
+                << "period" << std::endl;
+      exit(2);
+    }
+  } else if (!args.burst_conditions.empty()) {
+    std::cerr << "error: '--burst-on' requires '--burst-period'"
+              << std::endl;
+    exit(2);
+  }
+
+  // Rollups need a file prefix
+  if (!args.rollup.empty() && args.rollup_file.empty()) {
+    std::cerr << "error: '--rollup' requires '--rollup-file'" << std::endl;
+    exit(2);
+  }
+  if (!args.rollup_sketches.empty() && args.rollup.empty()) {
+    std::cerr << "error: '--rollup-sketches' requires '--rollup'"
+              << std::endl;
+    exit(2);
+  }
+
+  // Use default network interface unless one was given
+  if (args.network_interfaces.empty()) {
+    args.network_interfaces.push_back(DEFAULT_NETWORK_INTERFACE);
+  }
+
+  // Use default stat path unless one was given
+  if (args.stat_paths.empty()) {
+    args.stat_paths.push_back(DEFAULT_STAT_PATH);
+  }
+
+  // NUMA statistics are written to the per-CPU statistics file
+  if (args.numa && args.cpu_file.empty()) {
+    std::cerr << "error: '--numa' requires '--cpu-file'" << std::endl;
+    exit(2);
+  }
+
   // Parse for optional log file
   if (optind < argc) {
     args.log_file = argv[optind];
@@ -317,176 +1044,571 @@ static CommandLineArguments parse_arguments(int argc, char* argv[]) {
     }
   }
 
+  // Ring files require a log file and are always binary
+  if (args.max_records > 0) {
+    if (args.log_file.empty()) {
+      std::cerr << "error: '--max-records' requires a log file" << std::endl;
+      exit(2);
+    }
+    if (args.has_format && args.format != Format::binary) {
+      std::cerr << "error: '--max-records' requires binary format"
+                << std::endl;
+      exit(2);
+    }
+    args.format = Format::binary;
+  }
+
+  // Only log files with a time-formatted name are closed while running, and
+  // only raw samples in text or binary format can be compressed
+  if (args.compact) {
+    if (args.log_file.find('%') == std::string::npos) {
+      std::cerr << "error: '--compact' requires a log file name with time "
+                << "format" << std::endl;
+      exit(2);
+    }
+    if (args.format == Format::compressed || args.derived
+        || args.max_records > 0) {
+      std::cerr << "error: '--compact' requires text or binary format"
+                << std::endl;
+      exit(2);
+    }
+  }
+
   return args;
 }
 
 
-/// Gather data sample
-static Sample sample(const std::string& network_interface,
-                     const std::string& stat_path) {
-  // Create sample object
-  Sample s{};
+/// Parse string through std::strftime using the given time (in seconds since
+/// the Unix epoch)
+static std::string time_formatted(const std::string& s,
+                                  std::time_t when = std::time(nullptr)) {
+  // Return early if string is empty
+  if (s.empty()) {
+    return std::string();
+  }
 
-  // Current point in time as reference
-  s.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-      std::chrono::system_clock::now().time_since_epoch()).count();
+  // Parse string through strftime (localtime_r, since this is also called
+  // from the writer thread)
+  std::array<char, max_log_file_name_length + 1> buffer;
+  std::tm local;
+  localtime_r(&when, &local);
+  const auto status = std::strftime(
+      &buffer[0], max_log_file_name_length + 1, s.c_str(), &local);
 
-  // Steady clock timestamp for robust time-average calculation
-  s.steady = std::chrono::duration_cast<std::chrono::milliseconds>(
-      std::chrono::steady_clock::now().time_since_epoch()).count();
+  // If there was an error, return empty string
+  if (status == 0) {
+    return std::string();
+  }
 
-  // CPU load averages
-  {
-    // Open file
-    std::ifstream in("/proc/loadavg");
+  return std::string(&buffer[0]);
+}
 
-    // Read line
-    std::string line;
-    std::getline(in, line);
-    std::istringstream l(line);
 
-    // Read and convert CPU load averages
-    l >> s.cpu_load_1m;
-    l >> s.cpu_load_5m;
-    l >> s.cpu_load_15m;
+/// Return size of file in bytes or -1 if it does not exist
+static Int log_file_size(const std::string& name) {
+  struct stat sb;
+  if (stat(name.c_str(), &sb) != 0) {
+    return -1;
   }
+  return static_cast<Int>(sb.st_size);
+}
 
-  // CPU statistics
-  {
-    // Open file
-    std::ifstream in("/proc/stat");
-
-    // Read first line with cumulated values
-    std::string line;
-    std::getline(in, line);
-    std::istringstream l(line);
-
-    // Read first word and throw it away (will probably be 'cpu')
-    std::string dump;
-    l >> dump;
-
-    // Read and convert CPU statistics
-    l >> s.cpu_time_user;
-    l >> s.cpu_time_nice;
-    l >> s.cpu_time_system;
-    l >> s.cpu_time_idle;
-    l >> s.cpu_time_iowait;
-    l >> s.cpu_time_irq;
-    l >> s.cpu_time_softirq;
-    l >> s.cpu_time_steal;
-    l >> s.cpu_time_guest;
-    l >> s.cpu_time_guest_nice;
-  }
-
-  // Memory usage
-  {
-    // Open file
-    std::ifstream in("/proc/meminfo");
-
-    // Read file line by line and parse each line for relevant data
-    Int memory_free = 0;
-    Int buffers = 0;
-    Int cached = 0;
-    Int swap_free = 0;
-    for (std::string line; std::getline(in, line); ) {
-      // Extract data type
-      std::istringstream l(line);
-      std::string type;
-      l >> type;
-
-      // Store data depending on type
-      if (type == "MemTotal:") {
-        l >> s.memory_total;
-      } else if (type == "MemFree:") {
-        l >> memory_free;
-      } else if (type == "Buffers:") {
-        l >> buffers;
-      } else if (type == "Cached:") {
-        l >> cached;
-      } else if (type == "SwapTotal:") {
-        l >> s.swap_total;
-      } else if (type == "SwapFree:") {
-        l >> swap_free;
+
+/// Check that an existing binary or compressed log file is either empty or
+/// starts with the given header (or magic bytes)
+static bool prepare_binary_log_file(const std::string& name,
+                                    const std::string& header) {
+  if (log_file_size(name) <= 0) {
+    return true;
+  }
+  std::ifstream in(name, std::ios::in | std::ios::binary);
+  std::string existing(header.size(), '\0');
+  in.read(&existing[0], static_cast<std::streamsize>(existing.size()));
+  return in.good() && existing == header;
+}
+
+
+/// Append-only output file (or stdout) that collects data in memory until it
+/// is flushed
+class OutputFile {
+ public:
+  OutputFile() = default;
+
+  ~OutputFile() { close(); }
+
+  OutputFile(const OutputFile&) = delete;
+  OutputFile& operator=(const OutputFile&) = delete;
+
+  /// Open file for appending, an empty path denotes stdout
+  bool open(const std::string& path) {
+    close();
+    if (path.empty()) {
+      fd_ = STDOUT_FILENO;
+      return true;
+    }
+    fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                 0644);
+    owned_ = (fd_ >= 0);
+    struct stat sb;
+    position_ = (fd_ >= 0 && fstat(fd_, &sb) == 0)
+                ? static_cast<std::uint64_t>(sb.st_size) : 0;
+    return fd_ >= 0;
+  }
+
+  /// Buffer data
+  void append(const char* data, std::size_t size) {
+    buffer_.append(data, size);
+    position_ += size;
+  }
+
+  /// File offset at which the next appended data will be written
+  std::uint64_t position() const { return position_; }
+
+  /// Write buffered data to the file
+  bool flush() {
+    const char* data = buffer_.data();
+    std::size_t size = buffer_.size();
+    while (size > 0) {
+      const auto n = ::write(fd_, data, size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
       }
+      data += n;
+      size -= static_cast<std::size_t>(n);
     }
+    buffer_.clear();
+    return true;
+  }
 
-    // Calculate used memory and used swap space
-    s.memory_used = s.memory_total - memory_free - buffers - cached;
-    s.swap_used = s.swap_total - swap_free;
+  /// Flush data to the file and from there to the storage device
+  bool sync() {
+    return flush() && (!owned_ || ::fdatasync(fd_) == 0);
+  }
 
-    // Convert values from kibibytes to bytes
-    s.memory_total *= 1024;
-    s.memory_used *= 1024;
-    s.swap_total *= 1024;
-    s.swap_used *= 1024;
+  /// Close file, discarding any data that was not flushed
+  void close() {
+    if (owned_) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+    owned_ = false;
+    position_ = 0;
+    buffer_.clear();
   }
 
-  // Disk usage
-  {
-    // Call statvfs to get information on file system
-    struct statvfs sb;
-    statvfs(stat_path.c_str(), &sb);
+  bool is_open() const { return fd_ >= 0; }
+
+ private:
+  int fd_ = -1;
+  bool owned_ = false;
+  std::uint64_t position_ = 0;
+  std::string buffer_;
+};
+
+
+/// Output side of sss-mon, i.e., everything that may block on disk I/O: log
+/// files (including rotation of time-encoded file names), index files, ring
+/// files, and rollup tiers. Used by the writer thread only, except for the
+/// compaction of closed log files, which runs in a thread of its own.
+class LogWriter {
+ public:
+  explicit LogWriter(const CommandLineArguments& args)
+    : args_(args),
+      has_time_in_log_file_name_(time_formatted(args.log_file)
+                                 != args.log_file),
+      rotation_(has_time_in_log_file_name_ ? args.log_file : std::string()),
+      layout_(args.selection.fields),
+      binary_header_(layout_.header()),
+      record_(layout_.record_size()),
+      encoder_(static_cast<std::size_t>(args.block_size), layout_) {
+    // Binary output on stdout starts with a header
+    if (args_.log_file.empty()) {
+      log_file_.open("");
+      if (args_.format == Format::binary) {
+        log_file_.append(binary_header_.data(), binary_header_.size());
+      }
+    }
+
+    // Set up rollup tiers
+    if (!args_.rollup.empty()
+        && !rollup_.configure(args_.rollup, args_.rollup_file,
+                              args_.rollup_records, args_.rollup_sketches)) {
+      std::cerr << "error: argument to '--rollup' (" << args_.rollup
+                << ") is not a valid list of durations" << std::endl;
+      std::exit(2);
+    }
 
-    // All values of interest from statvfs are given in blocks, thus to obtain
-    // the byte value they have to be multiplied by frsize
-    // Total = disk capacity
-    s.disk_total = sb.f_blocks * sb.f_frsize;
-    // Used = capacity minus what kernel/root may use
-    s.disk_used = (sb.f_blocks - sb.f_bfree) * sb.f_frsize;
-    // Available = remaining capacity that normal users may use
-    s.disk_available = sb.f_bavail * sb.f_frsize;
+    if (args_.compact) {
+      compactor_.reset(new sss::ThreadPool(1));
+    }
   }
 
-  // Bytes received/sent on network interface
-  {
-    // Open file
-    std::ifstream in("/proc/net/dev");
-
-    // Read file line by line until selected interface is found
-    for (std::string line; std::getline(in, line); ) {
-      // Extract interface name
-      std::istringstream l(line);
-      std::string interface;
-      l >> interface;
-
-      // If specified interface is found, read data and exit loop
-      if (interface == network_interface + ":") {
-        // Bytes received is the 2nd value
-        l >> s.network_received;
-
-        // Bytes sent is the 10th value
-        for (Int i = 0; i < 8; i++) {
-          l >> s.network_sent;
-        }
-        break;
+  /// Buffer sample, (re-)opening the log file first if necessary
+  void write(Sample s) {
+    // The time delta refers to the previously written sample, which is not
+    // the previously taken one if samples were dropped. It is zero for the
+    // first sample since (re-)starting.
+    s.time_delta = has_written_ ? s.steady - last_steady_ : 0;
+    has_written_ = true;
+    last_steady_ = s.steady;
+
+    if (!args_.log_file.empty()) {
+      open(s);
+    }
+
+    // Write sample in selected format
+    if (ring_file_.is_open()) {
+      layout_.encode(s, &record_[0]);
+      if (!ring_file_.append(record_.data())) {
+        std::cerr << "error: could not write to ring file '" << log_file_name_
+                  << "'" << std::endl;
+        std::exit(1);
+      }
+    } else if (args_.format == Format::binary) {
+      add_index_entry(s);
+      layout_.encode(s, &record_[0]);
+      log_file_.append(record_.data(), record_.size());
+    } else if (args_.format == Format::compressed) {
+      if (encoder_.empty()) {
+        block_timestamp_ = s.timestamp;
+      }
+      if (encoder_.add(s)) {
+        finish_block();
+      }
+    } else if (args_.derived) {
+      // The first sample has no predecessor, later ones use the steady clock,
+      // such that the interval is also correct if samples were dropped
+      if (has_previous_) {
+        add_index_entry(s);
+        const auto line = sss::format_derived(
+            sss::derive(previous_, s, s.steady - previous_.steady));
+        log_file_.append(line.data(), line.size());
       }
+      previous_ = s;
+      has_previous_ = true;
+    } else {
+      add_index_entry(s);
+      text_.str(std::string());
+      sss::write_text(text_, s);
+      text_ << '\n';
+      const auto line = text_.str();
+      log_file_.append(line.data(), line.size());
     }
+
+    // Update rollup tiers
+    rollup_.add(s);
   }
 
-  return s;
-}
+  /// Write buffered data to the log file and optionally sync it to disk. The
+  /// index is written afterwards, such that its entries never point beyond
+  /// the end of the log.
+  void flush(bool sync) {
+    if (!(sync ? log_file_.sync() : log_file_.flush())) {
+      std::cerr << "error: could not write to log file '" << log_file_name_
+                << "'" << std::endl;
+      std::exit(1);
+    }
+    if (index_.is_open() && !index_.flush()) {
+      std::cerr << "error: could not write to index file '"
+                << sss::index_path(log_file_name_) << "'" << std::endl;
+      std::exit(1);
+    }
+  }
 
+  /// Flush everything, including incomplete blocks and rollup windows
+  void finish(bool sync) {
+    finish_block();
+    flush(sync);
+    rollup_.flush();
+  }
 
-/// Parse string through std::strftime using the current system time
-static std::string time_formatted(const std::string& s) {
-  // Return early if string is empty
-  if (s.empty()) {
-    return std::string();
+ private:
+  /// Encode buffered samples of compressed format as a block
+  void finish_block() {
+    if (encoder_.empty()) {
+      return;
+    }
+    if (index_.is_open()) {
+      index_.add(block_timestamp_, log_file_.position());
+    }
+    block_.clear();
+    encoder_.finish(block_);
+    log_file_.append(block_.data(), block_.size());
   }
 
-  // Parse string through strftime
-  std::array<char, max_log_file_name_length + 1> buffer;
-  const auto now = std::time(nullptr);
-  const auto status = std::strftime(
-      &buffer[0], max_log_file_name_length + 1, s.c_str(),
-      std::localtime(&now));
+  /// Add index entry for every `index_interval`-th record
+  void add_index_entry(const Sample& s) {
+    if (index_.is_open()
+        && records_since_index_entry_++ % args_.index_interval == 0) {
+      index_.add(s.timestamp, log_file_.position());
+    }
+  }
 
-  // If there was an error, return empty string
-  if (status == 0) {
-    return std::string();
+  /// Check if log file needs to be (re-)opened
+  void open(const Sample& s) {
+    // The name can only change once the sample time leaves the span of the
+    // current one
+    if (!rotation_.due(s.timestamp)) {
+      return;
+    }
+    rotation_.update(s.timestamp);
+
+    // Determine name for next log file from the sample time
+    const auto new_name =
+        has_time_in_log_file_name_
+        ? time_formatted(args_.log_file,
+                         static_cast<std::time_t>(s.timestamp / 1000))
+        : args_.log_file;
+
+    // An empty new name implies an error in the time_formatted function
+    if (new_name.empty()) {
+      std::cerr << "error: log file name after applying time format is too "
+                << "long (must be < " << max_log_file_name_length << ")"
+                << std::endl;
+      std::exit(1);
+    }
+    if (new_name == log_file_name_) {
+      return;
+    }
+
+    // Write remaining data to the previous file
+    if (log_file_.is_open()) {
+      finish_block();
+      flush(false);
+    }
+    const auto previous_name = log_file_name_;
+    log_file_name_ = new_name;
+
+    if (args_.max_records > 0) {
+      std::string error;
+      if (!ring_file_.open(log_file_name_, layout_,
+                           static_cast<std::uint64_t>(args_.max_records),
+                           error)) {
+        std::cerr << "error: " << error << std::endl;
+        std::exit(1);
+      }
+    } else {
+      if (!log_file_.open(log_file_name_)) {
+        std::cerr << "error: could not open log file '" << log_file_name_
+                  << "' for writing" << std::endl;
+        std::exit(1);
+      }
+
+      // Binary log files start with a header and may only be appended to if
+      // the existing header matches
+      if (args_.format == Format::binary
+          && !prepare_binary_log_file(log_file_name_, binary_header_)) {
+        std::cerr << "error: existing log file '" << log_file_name_
+                  << "' is not a binary log file with matching fields"
+                  << std::endl;
+        std::exit(1);
+      }
+      if (args_.format == Format::compressed
+          && !prepare_binary_log_file(
+              log_file_name_, std::string(sss::block_magic,
+                                          sizeof(sss::block_magic)))) {
+        std::cerr << "error: existing log file '" << log_file_name_
+                  << "' is not a compressed log file" << std::endl;
+        std::exit(1);
+      }
+      if (args_.format == Format::binary
+          && log_file_size(log_file_name_) == 0) {
+        log_file_.append(binary_header_.data(), binary_header_.size());
+      }
+
+      // Open index file of the new log file
+      records_since_index_entry_ = 0;
+      if (args_.index_interval > 0
+          && !index_.open(sss::index_path(log_file_name_),
+                          static_cast<std::uint64_t>(
+                              log_file_size(log_file_name_)))) {
+        std::cerr << "error: could not open index file '"
+                  << sss::index_path(log_file_name_) << "' for writing"
+                  << std::endl;
+        std::exit(1);
+      }
+    }
+    std::cout << "Writing to '" << log_file_name_ << "'..." << std::endl;
+
+    // The previous file and its index are closed by now
+    if (compactor_ && !previous_name.empty()) {
+      compactor_->submit([this, previous_name] {
+        std::string error;
+        if (!sss::compact_log_file(
+                previous_name, layout_,
+                static_cast<std::size_t>(args_.block_size), error)) {
+          std::cerr << "error: could not compact log file: " << error
+                    << std::endl;
+        }
+      });
+    }
   }
 
-  return std::string(&buffer[0]);
+  const CommandLineArguments& args_;
+  const bool has_time_in_log_file_name_;
+  sss::RotationSchedule rotation_;
+  const sss::BinaryLayout layout_;
+  const std::string binary_header_;
+  std::vector<char> record_;
+  std::ostringstream text_;
+  Sample previous_;
+  bool has_previous_ = false;
+  bool has_written_ = false;
+  Int last_steady_ = 0;
+  std::string log_file_name_;
+  OutputFile log_file_;
+  sss::BlockEncoder encoder_;
+  std::string block_;
+  Int block_timestamp_ = 0;
+  sss::IndexWriter index_;
+  Int records_since_index_entry_ = 0;
+  sss::RingFile ring_file_;
+  sss::Rollup rollup_;
+
+  // Declared last, such that pending compactions finish before any other
+  // member is destroyed
+  std::unique_ptr<sss::ThreadPool> compactor_;
+};
+
+
+/// Writes the per-CPU, per-interface, per-device, per-path, per-process, and
+/// per-cgroup tables to their files on the writer thread. The sampler updates
+/// the tables while holding `mutex()` and marks them as pending afterwards.
+/// The writer formats pending tables into memory under the same lock, which
+/// involves no I/O, and writes them to their files after releasing it, such
+/// that slow disks never delay sampling. If the writer has not taken the
+/// tables of a sample when the sampler updates them again, the lines of that
+/// sample are dropped.
+class TableWriter {
+ public:
+  /// Function that appends the lines of a table for a timestamp to a stream
+  using Format = std::function<bool(std::FILE*, Int)>;
+
+  TableWriter() = default;
+
+  ~TableWriter() {
+    for (auto& t : tables_) {
+      std::fclose(t->memory);
+      std::free(t->buffer);
+      std::fclose(t->file);
+    }
+  }
+
+  TableWriter(const TableWriter&) = delete;
+  TableWriter& operator=(const TableWriter&) = delete;
+
+  /// Add table that is written to `file`, which is closed by the writer.
+  /// Errors are reported with the description of the file.
+  void add(const std::string& description, std::FILE* file, Format format) {
+    tables_.emplace_back(new Table());
+    auto& t = *tables_.back();
+    t.description = description;
+    t.file = file;
+    t.format = std::move(format);
+    t.memory = open_memstream(&t.buffer, &t.size);
+    if (t.memory == nullptr) {
+      std::cerr << "error: could not allocate buffer for " << description
+                << std::endl;
+      std::exit(1);
+    }
+  }
+
+  /// Lock that the sampler holds while updating the tables
+  std::mutex& mutex() { return mutex_; }
+
+  /// Start updating the tables for a new sample (with the lock held), which
+  /// drops the lines of the previous sample if they have not been taken yet
+  void begin_update() {
+    dropped_ += pending_ ? 1 : 0;
+    pending_ = false;
+  }
+
+  /// Mark the tables as updated for the sample at `timestamp` (with the lock
+  /// held)
+  void end_update(Int timestamp) {
+    timestamp_ = timestamp;
+    pending_ = true;
+  }
+
+  /// Write the lines of the pending tables and optionally flush the files
+  /// (writer thread only)
+  void write(bool flush) {
+    bool taken = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_) {
+        for (auto& t : tables_) {
+          std::rewind(t->memory);
+          if (!t->format(t->memory, timestamp_)
+              || std::fflush(t->memory) != 0) {
+            fail(*t);
+          }
+        }
+        pending_ = false;
+        taken = true;
+      }
+    }
+    for (auto& t : tables_) {
+      if ((taken && std::fwrite(t->buffer, 1, t->size, t->file) != t->size)
+          || (flush && std::fflush(t->file) != 0)) {
+        fail(*t);
+      }
+    }
+  }
+
+  /// Number of samples whose lines were dropped
+  Int dropped() const { return dropped_; }
+
+ private:
+  struct Table {
+    std::string description;
+    std::FILE* file = nullptr;
+    Format format;
+    std::FILE* memory = nullptr;
+    char* buffer = nullptr;
+    std::size_t size = 0;
+  };
+
+  static void fail(const Table& t) {
+    std::cerr << "error: could not write to " << t.description << std::endl;
+    std::exit(1);
+  }
+
+  // Tables are not moved, since their memory streams refer to their buffers
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::mutex mutex_;
+  Int timestamp_ = 0;
+  bool pending_ = false;
+  Int dropped_ = 0;
+};
+
+
+/// Return nanoseconds elapsed since the given time
+static Int nanoseconds_since(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin).count();
+}
+
+
+/// Append line to self statistics file
+static void write_self_stats(sss::SelfStats& self_stats, std::FILE* file,
+                             Int timestamp, const std::string& name) {
+  if (!self_stats.write_line(file, timestamp)) {
+    std::cerr << "error: could not write to self statistics file '" << name
+              << "'" << std::endl;
+    std::exit(1);
+  }
+}
+
+
+/// Set by SIGINT/SIGTERM to stop sampling and write all pending data
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+  stop_requested = 1;
 }
 
 
@@ -507,87 +1629,409 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  // Check if log file is specified and whether its name is time-encoded
-  const bool use_log_file = (!args.log_file.empty());
-  const bool has_time_in_log_file_name =
-      (time_formatted(args.log_file) != args.log_file);
+  // Set up per-CPU statistics, which are appended to their own file
+  std::unique_ptr<sss::CpuTable> cpus;
+  std::FILE* cpu_file = nullptr;
+  if (!args.cpu_file.empty()) {
+    cpus.reset(new sss::CpuTable("/sys/devices/system", args.numa));
+    cpu_file = std::fopen(args.cpu_file.c_str(), "a");
+    if (cpu_file == nullptr) {
+      std::cerr << "error: could not open CPU file '" << args.cpu_file
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.cpu_file) == 0) {
+      std::fputs(sss::CpuTable::header(), cpu_file);
+    }
+  }
 
-  // Set output stream to use
-  std::ofstream log_file;
-  std::string log_file_name;
-  std::ostream os(use_log_file ? log_file.rdbuf() : std::cout.rdbuf());
+  // Set up per-interface statistics, which are appended to their own file
+  std::unique_ptr<sss::NetworkTable> networks;
+  std::FILE* network_file = nullptr;
+  if (!args.network_file.empty()) {
+    networks.reset(new sss::NetworkTable(args.network_interfaces));
+    network_file = std::fopen(args.network_file.c_str(), "a");
+    if (network_file == nullptr) {
+      std::cerr << "error: could not open network file '"
+                << args.network_file << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.network_file) == 0) {
+      std::fputs(sss::NetworkTable::header(), network_file);
+    }
+  }
 
-  // Begin main loop
-  const auto sleep_time = std::chrono::seconds(args.period);
-  Int previous_steady = 0;
-  for (Int iteration = 0;;) {
-    // Obtain sample
-    const Sample s = sample(args.network_interface, args.stat_path);
-
-    // Check if log file needs to be (re-)opened
-    if (use_log_file) {
-      // Determine name for next log file
-      const auto new_name =
-          has_time_in_log_file_name
-          ? time_formatted(args.log_file)
-          : args.log_file;
-
-      // An empty new name implies an error in the time_formatted function
-      if (new_name.empty()) {
-        std::cerr << "error: log file name after applying time format is too "
-                  << "long (must be < " << max_log_file_name_length << ")"
-                  << std::endl;
-        std::exit(1);
+  // Set up per-device I/O statistics, which are appended to their own file
+  std::unique_ptr<sss::DiskTable> disks;
+  std::FILE* disk_file = nullptr;
+  if (!args.disk_file.empty()) {
+    disks.reset(new sss::DiskTable(args.disk_devices,
+                                   sss::block_root(args.proc_root)));
+    disk_file = std::fopen(args.disk_file.c_str(), "a");
+    if (disk_file == nullptr) {
+      std::cerr << "error: could not open disk file '" << args.disk_file
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.disk_file) == 0) {
+      std::fputs(sss::DiskTable::header(), disk_file);
+    }
+  }
+
+  // Set up per-path disk usage, which is appended to its own file
+  std::unique_ptr<sss::MountTable> mounts;
+  std::FILE* mount_file = nullptr;
+  if (!args.mount_file.empty()) {
+    mounts.reset(new sss::MountTable(args.stat_paths));
+    mount_file = std::fopen(args.mount_file.c_str(), "a");
+    if (mount_file == nullptr) {
+      std::cerr << "error: could not open mount file '" << args.mount_file
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.mount_file) == 0) {
+      std::fputs(sss::MountTable::header(), mount_file);
+    }
+  }
+
+  // Open data sources of the selected collectors once
+  sss::CollectorContext context;
+  context.proc_root = args.proc_root;
+  context.network_interfaces = args.network_interfaces;
+  context.stat_paths = args.stat_paths;
+  context.disk_devices = args.disk_devices;
+  context.cpus = cpus.get();
+  context.networks = networks.get();
+  context.disks = disks.get();
+  context.mounts = mounts.get();
+  context.batch_reads = args.io_uring;
+  sss::Sampler sampler(context, args.selection);
+  {
+    std::string error;
+    if (!sampler.open(error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+  }
+  for (const auto& warning : sampler.warnings()) {
+    std::cerr << "warning: " << warning << std::endl;
+  }
+
+  // Per-process and per-cgroup statistics keep their files open between
+  // samples, for which the limit of open files is raised as far as possible
+  // and shared between both
+  std::size_t max_open_files = 0;
+  if (!args.process_file.empty() || !args.cgroup_file.empty()) {
+    max_open_files = sss::raise_open_file_limit(256);
+    if (!args.process_file.empty() && !args.cgroup_file.empty()) {
+      max_open_files /= 2;
+    }
+  }
+
+  // Set up per-process statistics, which are appended to their own file
+  std::unique_ptr<sss::ProcessTable> processes;
+  std::FILE* process_file = nullptr;
+  if (!args.process_file.empty()) {
+    processes.reset(new sss::ProcessTable(static_cast<std::size_t>(args.top),
+                                          max_open_files));
+    std::string error;
+    if (!processes->open(args.proc_root, error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    process_file = std::fopen(args.process_file.c_str(), "a");
+    if (process_file == nullptr) {
+      std::cerr << "error: could not open process file '"
+                << args.process_file << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.process_file) == 0) {
+      std::fputs(sss::ProcessTable::header(), process_file);
+    }
+  }
+
+  // Set up per-cgroup statistics, which are appended to their own file
+  std::unique_ptr<sss::CgroupTable> cgroups;
+  std::FILE* cgroup_file = nullptr;
+  if (!args.cgroup_file.empty()) {
+    cgroups.reset(new sss::CgroupTable(args.cgroup_root, max_open_files,
+                                       args.io_uring));
+    std::string error;
+    if (!cgroups->open(error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    cgroup_file = std::fopen(args.cgroup_file.c_str(), "a");
+    if (cgroup_file == nullptr) {
+      std::cerr << "error: could not open cgroup file '"
+                << args.cgroup_file << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.cgroup_file) == 0) {
+      std::fputs(sss::CgroupTable::header(), cgroup_file);
+    }
+  }
+
+  // All tables are written by the writer thread. Per-CPU statistics are only
+  // written if the sample has utilization since the previous one.
+  bool has_cpu_data = false;
+  TableWriter tables;
+  if (cpus) {
+    tables.add("CPU file '" + args.cpu_file + "'", cpu_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return !has_cpu_data || cpus->write(file, timestamp, false);
+               });
+  }
+  if (networks) {
+    tables.add("network file '" + args.network_file + "'", network_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return networks->write(file, timestamp, false);
+               });
+  }
+  if (disks) {
+    tables.add("disk file '" + args.disk_file + "'", disk_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return disks->write(file, timestamp, false);
+               });
+  }
+  if (mounts) {
+    tables.add("mount file '" + args.mount_file + "'", mount_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return mounts->write(file, timestamp, false);
+               });
+  }
+  if (processes) {
+    tables.add("process file '" + args.process_file + "'", process_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return processes->write(file, timestamp, false);
+               });
+  }
+  if (cgroups) {
+    tables.add("cgroup file '" + args.cgroup_file + "'", cgroup_file,
+               [&](std::FILE* file, Int timestamp) {
+                 return cgroups->write(file, timestamp, false);
+               });
+  }
+
+  // Set up measurement of the overhead of sss-mon itself
+  std::unique_ptr<sss::SelfStats> self_stats;
+  std::FILE* self_stats_file = nullptr;
+  if (!args.self_stats.empty()) {
+    auto names = sampler.names();
+    if (processes) {
+      names.push_back("processes");
+    }
+    if (cgroups) {
+      names.push_back("cgroups");
+    }
+    self_stats.reset(new sss::SelfStats(names));
+    std::string error;
+    if (!self_stats->open(error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+    self_stats_file = std::fopen(args.self_stats.c_str(), "a");
+    if (self_stats_file == nullptr) {
+      std::cerr << "error: could not open self statistics file '"
+                << args.self_stats << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (log_file_size(args.self_stats) == 0) {
+      std::fputs(self_stats->header().c_str(), self_stats_file);
+    }
+  }
+
+  // Set up publication of samples in shared memory
+  std::unique_ptr<sss::ShmWriter> shm;
+  if (!args.shm.empty()) {
+    shm.reset(new sss::ShmWriter());
+    std::string error;
+    if (!shm->open(args.shm, static_cast<std::size_t>(args.shm_samples),
+                   error)) {
+      std::cerr << "error: " << error << std::endl;
+      std::exit(1);
+    }
+  }
+
+  // Samples are passed to the writer thread through a lock-free queue, such
+  // that slow disks do not delay sampling. The mutex and condition variable
+  // are only used to wake up the writer.
+  LogWriter log_writer(args);
+  sss::SpscQueue<Sample> queue(static_cast<std::size_t>(args.queue_size));
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool done = false;
+  const auto flush_interval = std::chrono::milliseconds(args.flush_interval);
+  const auto sync_interval = std::chrono::milliseconds(args.sync_interval);
+  std::thread writer([&] {
+    auto last_flush = std::chrono::steady_clock::now();
+    auto last_sync = last_flush;
+    Int last_self_stats = std::chrono::duration_cast<
+        std::chrono::milliseconds>(last_flush.time_since_epoch()).count();
+    for (bool finished = false; !finished;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [&] { return done || !queue.empty(); });
+        finished = done;
       }
 
-      // Check if log file needs to be (re-)opened
-      if (new_name != log_file_name) {
-        // Close log file if it was already open
-        if (log_file.is_open()) {
-          log_file.close();
-          log_file.clear();
+      // Write all available samples as one batch
+      Sample s;
+      bool written = false;
+      while (queue.pop(s)) {
+        const auto begin = std::chrono::steady_clock::now();
+        log_writer.write(s);
+        if (self_stats) {
+          self_stats->write.record(nanoseconds_since(begin));
         }
+        written = true;
+      }
+
+      // Write tables of the latest sample, which are flushed together with
+      // the log file at the configured intervals
+      const auto now = std::chrono::steady_clock::now();
+      const bool sync = args.sync_interval > 0
+                        && now - last_sync >= sync_interval;
+      const bool flush = sync || now - last_flush >= flush_interval;
+      tables.write(flush);
+
+      // Write self statistics
+      if (self_stats && written
+          && s.steady - last_self_stats >= args.self_stats_interval) {
+        write_self_stats(*self_stats, self_stats_file, s.timestamp,
+                         args.self_stats);
+        last_self_stats = s.steady;
+      }
 
-        log_file_name = new_name;
-        log_file.open(log_file_name, std::ios::out | std::ios::app);
-        if (!log_file.good()) {
-          std::cerr << "error: could not open log file '" << log_file_name
-                    << "' for writing" << std::endl;
-          std::exit(1);
+      // Flush/sync at the configured intervals
+      if (flush) {
+        log_writer.flush(sync);
+        if (self_stats) {
+          self_stats->flush.record(nanoseconds_since(now));
         }
-        std::cout << "Writing to '" << log_file_name << "'..." << std::endl;
+        last_flush = now;
+        last_sync = sync ? now : last_sync;
       }
     }
+    log_writer.finish(args.sync_interval > 0);
+    tables.write(true);
+  });
+
+  // Stop gracefully on SIGINT/SIGTERM
+  struct sigaction action{};
+  action.sa_handler = request_stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  // Samples are taken at the ticks of a periodic timer, such that the time
+  // needed for sampling does not shift the schedule
+  sss::PeriodicTimer timer;
+  if (!timer.start(args.period)) {
+    std::cerr << "error: could not create sampling timer" << std::endl;
+    std::exit(1);
+  }
+
+  // Adaptive sampling switches between the base and the burst period
+  sss::BurstControl burst(args.period, args.burst_period, args.burst_cooldown,
+                          args.burst_conditions);
+
+  // Begin main loop
+  Int previous_steady = 0;
+  Int overruns = 0;
+  Int dropped = 0;
+  bool dropping = false;
+  for (Int iteration = 0; !stop_requested;) {
+    // Wait for next sample time
+    if (!timer.wait()) {
+      continue;
+    }
 
-    // Calculate time delta since last sample
-    const Int time_delta = (iteration == 0) ? 0 : s.steady - previous_steady;
-
-    // Print all data to stdout
-    os << s.timestamp
-       << " " << time_delta
-       << " " << s.cpu_load_1m
-       << " " << s.cpu_load_5m
-       << " " << s.cpu_load_15m
-       << " " << s.cpu_time_user
-       << " " << s.cpu_time_nice
-       << " " << s.cpu_time_system
-       << " " << s.cpu_time_idle
-       << " " << s.cpu_time_iowait
-       << " " << s.cpu_time_irq
-       << " " << s.cpu_time_softirq
-       << " " << s.cpu_time_steal
-       << " " << s.cpu_time_guest
-       << " " << s.cpu_time_guest_nice
-       << " " << s.memory_total
-       << " " << s.memory_used
-       << " " << s.swap_total
-       << " " << s.swap_used
-       << " " << s.disk_total
-       << " " << s.disk_used
-       << " " << s.disk_available
-       << " " << s.network_received
-       << " " << s.network_sent
-       << std::endl;
+    // Report if samples were skipped since the previous one took too long
+    if (timer.overruns() > overruns) {
+      std::cerr << "warning: sampling cannot keep up with the period, "
+                << "skipped " << timer.overruns() - overruns << " samples"
+                << std::endl;
+      overruns = timer.overruns();
+    }
+
+    // Obtain sample. The collectors update the per-CPU, per-interface,
+    // per-device, and per-path tables, thus the lock of the tables is held.
+    std::unique_lock<std::mutex> table_lock(tables.mutex());
+    tables.begin_update();
+    const auto begin = std::chrono::steady_clock::now();
+    Sample s = sampler.sample(self_stats ? self_stats->collectors()
+                                         : nullptr);
+    has_cpu_data = sampler.has_cpu_data();
+    table_lock.unlock();
+    if (self_stats) {
+      self_stats->sample.record(nanoseconds_since(begin));
+      self_stats->wakeup.record(timer.lateness());
+    }
+
+    // Calculate time delta since last sample (for local readers and burst
+    // conditions, the writer recalculates it for the samples it writes)
+    s.time_delta = (iteration == 0) ? 0 : s.steady - previous_steady;
+
+    // Record period of this sample and switch to the burst period (or back)
+    // for the next one. Rates remain correct across switches, since the time
+    // delta is measured on the steady clock.
+    s.period = burst.period();
+    if (args.burst_period > 0 && burst.update(s)
+        && !timer.start(burst.period())) {
+      std::cerr << "error: could not change sampling period" << std::endl;
+      std::exit(1);
+    }
+
+    // Publish sample to local readers first, they need no disk I/O
+    if (shm) {
+      shm->publish(s);
+    }
+
+    // Hand sample over to the writer thread, report if it cannot keep up
+    if (queue.push(s)) {
+      dropping = false;
+    } else {
+      dropped++;
+      if (!dropping) {
+        std::cerr << "warning: writer cannot keep up, dropping samples ("
+                  << dropped << " so far)" << std::endl;
+      }
+      dropping = true;
+    }
+    // Update per-process and per-cgroup statistics without the lock, since
+    // the scans take much longer than the other tables (e.g., about 0.2 s
+    // for 50000 processes), then publish them and let the writer thread
+    // write the sample and all tables
+    if (processes) {
+      const auto scan_begin = std::chrono::steady_clock::now();
+      processes->update();
+      if (self_stats) {
+        self_stats->collectors()[sampler.names().size()].record(
+            nanoseconds_since(scan_begin));
+      }
+    }
+    if (cgroups) {
+      const auto scan_begin = std::chrono::steady_clock::now();
+      cgroups->update();
+      if (self_stats) {
+        self_stats->collectors()[sampler.names().size()
+                                 + (processes ? 1 : 0)].record(
+            nanoseconds_since(scan_begin));
+      }
+    }
+    table_lock.lock();
+    if (processes) {
+      processes->publish();
+    }
+    if (cgroups) {
+      cgroups->publish();
+    }
+    tables.end_update(s.timestamp);
+    table_lock.unlock();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+    }
+    wakeup.notify_one();
 
     // Increment interation counter
     iteration++;
@@ -599,10 +2043,32 @@ int main(int argc, char* argv[]) {
     if (args.iterations > 0 && iteration >= args.iterations) {
       break;
     }
+  }
 
-    // Sleep until next sample time
-    const auto sleep_until = std::chrono::steady_clock::time_point(
-        std::chrono::milliseconds(s.steady) + sleep_time);
-    std::this_thread::sleep_until(sleep_until);
+  // Let the writer thread write all pending samples
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  wakeup.notify_one();
+  writer.join();
+  if (dropped > 0) {
+    std::cerr << "warning: dropped " << dropped << " samples because the "
+              << "writer could not keep up" << std::endl;
+  }
+  if (tables.dropped() > 0) {
+    std::cerr << "warning: dropped the per-CPU/interface/device/path/"
+              << "process/cgroup lines of " << tables.dropped()
+              << " samples because the writer could not keep up"
+              << std::endl;
+  }
+  if (self_stats) {
+    write_self_stats(*self_stats, self_stats_file,
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                     .count(),
+                     args.self_stats);
+    std::fclose(self_stats_file);
+    self_stats->print_summary(std::cerr);
   }
 }
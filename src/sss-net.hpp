@@ -0,0 +1,196 @@
+#ifndef SSS_NET_HPP
+#define SSS_NET_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fnmatch.h>
+
+#include "sss-format.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Counters of all network interfaces from /proc/net/dev that match one of a
+/// list of patterns (shell wildcards, e.g., 'veth*', or 'all'), gathered in a
+/// single pass over the file. Which lines of the file belong to which
+/// interface is cached, such that the patterns are only matched again when
+/// the set of interfaces changes.
+class NetworkTable {
+ public:
+  /// Number of counters per interface
+  static constexpr int num_counters = 8;
+
+  /// Indices of counters
+  enum Counter {
+    rx_bytes, rx_packets, rx_errors, rx_dropped,
+    tx_bytes, tx_packets, tx_errors, tx_dropped
+  };
+
+  explicit NetworkTable(const std::vector<std::string>& patterns)
+    : patterns_(patterns) {}
+
+  /// Parse contents of /proc/net/dev
+  void update(const char* begin, const char* end) {
+    std::size_t line = 0;
+    std::size_t slot = 0;
+    bool changed = false;
+    for (const char* p = begin; p < end; line++) {
+      const char* eol = static_cast<const char*>(
+          std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+      eol = (eol == nullptr) ? end : eol;
+
+      // Interface lines have the form 'NAME: COUNTERS' (the first two lines
+      // are column headers without a colon)
+      while (p < eol && *p == ' ') {
+        p++;
+      }
+      const char* colon = static_cast<const char*>(
+          std::memchr(p, ':', static_cast<std::size_t>(eol - p)));
+      const auto length =
+          (colon == nullptr) ? 0 : static_cast<std::size_t>(colon - p);
+
+      // Look up line in the cache, and match name if it is not the same
+      // as in the previous update
+      if (changed || line >= line_names_.size()
+          || line_names_[line].size() != length
+          || std::memcmp(line_names_[line].data(), p, length) != 0) {
+        changed = true;
+        line_names_.resize(line);
+        line_names_.emplace_back(p, length);
+        const bool selected = length > 0 && matches(line_names_.back());
+        line_selected_.resize(line);
+        line_selected_.push_back(selected);
+        if (selected) {
+          names_.resize(slot);
+          names_.push_back(line_names_.back());
+          counters_.resize(num_counters * (slot + 1));
+        }
+      }
+
+      // Parse counters: bytes, packets, errs, drop, fifo, frame, compressed,
+      // multicast for receive, then bytes, packets, errs, drop, fifo, colls,
+      // carrier, compressed for transmit
+      if (line_selected_[line]) {
+        Scanner l(colon + 1, eol);
+        Int* const c = &counters_[num_counters * slot];
+        for (int k = 0; k < 4; k++) {
+          c[k] = l.parse_int();
+        }
+        for (int k = 0; k < 4; k++) {
+          l.parse_int();
+        }
+        for (int k = 4; k < 8; k++) {
+          c[k] = l.parse_int();
+        }
+        slot++;
+      }
+      p = eol + 1;
+    }
+
+    // Interfaces at the end may have disappeared
+    if (changed || line != line_names_.size()) {
+      line_names_.resize(line);
+      line_selected_.resize(line);
+      names_.resize(slot);
+      counters_.resize(num_counters * slot);
+    }
+  }
+
+  /// Number of matching interfaces
+  std::size_t size() const { return names_.size(); }
+
+  /// Name of the i-th matching interface (in the order of /proc/net/dev)
+  const std::string& name(std::size_t i) const { return names_[i]; }
+
+  /// Counter of the i-th matching interface
+  Int counter(std::size_t i, Counter c) const {
+    return counters_[num_counters * i + c];
+  }
+
+  /// Sum of a counter over all matching interfaces
+  Int total(Counter c) const {
+    Int sum = 0;
+    for (std::size_t i = 0; i < size(); i++) {
+      sum += counter(i, c);
+    }
+    return sum;
+  }
+
+  /// Patterns that do not match any interface
+  std::vector<std::string> unmatched() const {
+    std::vector<std::string> result;
+    for (const auto& pattern : patterns_) {
+      bool found = false;
+      for (const auto& name : names_) {
+        found = found || matches(pattern, name);
+      }
+      if (!found) {
+        result.push_back(pattern);
+      }
+    }
+    return result;
+  }
+
+  /// Write one line per matching interface with its counters and optionally
+  /// flush the file. Return false on write errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) {
+    output_.resize(size() * max_line_length);
+    char* p = &output_[0];
+    for (std::size_t i = 0; i < size(); i++) {
+      p = append_int(p, timestamp);
+      *p++ = ' ';
+      std::memcpy(p, names_[i].data(), names_[i].size());
+      p += names_[i].size();
+      for (int k = 0; k < num_counters; k++) {
+        *p++ = ' ';
+        p = append_int(p, counters_[num_counters * i + k]);
+      }
+      *p++ = '\n';
+    }
+    const auto size = static_cast<std::size_t>(p - output_.data());
+    return std::fwrite(output_.data(), 1, size, file) == size
+           && (!flush || std::fflush(file) == 0);
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp interface rx_bytes rx_packets rx_errors rx_dropped "
+           "tx_bytes tx_packets tx_errors tx_dropped\n";
+  }
+
+ private:
+  /// Interface names are limited to 15 characters, counters to 20 digits
+  static constexpr std::size_t max_line_length = 256;
+
+  static bool matches(const std::string& pattern, const std::string& name) {
+    return pattern == "all" || fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+  }
+
+  bool matches(const std::string& name) const {
+    for (const auto& pattern : patterns_) {
+      if (matches(pattern, name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const std::vector<std::string> patterns_;
+
+  // Interface name and whether it matches for each line of the file
+  std::vector<std::string> line_names_;
+  std::vector<char> line_selected_;
+
+  // Names and counters of matching interfaces
+  std::vector<std::string> names_;
+  std::vector<Int> counters_;
+
+  // Output buffer
+  std::string output_;
+};
+
+} // namespace sss
+
+#endif // SSS_NET_HPP
@@ -0,0 +1,372 @@
+#ifndef SSS_PROC_HPP
+#define SSS_PROC_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sss-collect.hpp"
+#include "sss-format.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Counters of a single process from /proc/[pid]/stat
+struct ProcessInfo {
+  Int pid = 0;
+  Int start_time = 0;   // in clock ticks since boot, detects pid reuse
+  Int cpu_time = 0;     // user plus system time (in clock ticks)
+  Int cpu_delta = 0;    // CPU time since the previous scan (in clock ticks)
+  Int rss = 0;          // resident set size (in pages)
+  int fd = -1;          // open handle to /proc/[pid]/stat or -1
+  unsigned generation = 0;
+  char comm[16] = {};
+};
+
+
+/// Open-addressing hash map from pid to process with linear probing. Entries
+/// are only valid if they belong to the current generation, such that the
+/// map is cleared in constant time.
+class ProcessMap {
+ public:
+  explicit ProcessMap(std::size_t capacity = 1024) : slots_(capacity) {}
+
+  /// Remove all entries
+  void clear() {
+    generation_++;
+    size_ = 0;
+  }
+
+  std::size_t size() const { return size_; }
+
+  /// Return entry of pid or nullptr if there is none
+  ProcessInfo* find(Int pid) {
+    for (auto i = slot(pid);; i = (i + 1) & (slots_.size() - 1)) {
+      auto& p = slots_[i];
+      if (p.generation != generation_) {
+        return nullptr;
+      }
+      if (p.pid == pid) {
+        return &p;
+      }
+    }
+  }
+
+  /// Insert new entry for pid (which must not be in the map yet)
+  ProcessInfo& insert(Int pid) {
+    if (2 * (size_ + 1) > slots_.size()) {
+      grow();
+    }
+    auto i = slot(pid);
+    while (slots_[i].generation == generation_) {
+      i = (i + 1) & (slots_.size() - 1);
+    }
+    size_++;
+    auto& p = slots_[i];
+    p = ProcessInfo();
+    p.pid = pid;
+    p.generation = generation_;
+    return p;
+  }
+
+  /// Call `f` for each entry
+  template <typename F>
+  void for_each(F f) {
+    for (auto& p : slots_) {
+      if (p.generation == generation_) {
+        f(p);
+      }
+    }
+  }
+
+ private:
+  std::size_t slot(Int pid) const {
+    // Fibonacci hashing spreads consecutive pids
+    return static_cast<std::size_t>(
+        (static_cast<unsigned long long>(pid) * 11400714819323198485ull)
+        >> 20) & (slots_.size() - 1);
+  }
+
+  /// Double capacity and re-insert all entries
+  void grow() {
+    std::vector<ProcessInfo> old(2 * slots_.size());
+    old.swap(slots_);
+    const auto generation = generation_;
+    generation_++;
+    size_ = 0;
+    for (auto& p : old) {
+      if (p.generation == generation) {
+        auto& q = insert(p.pid);
+        q = p;
+        q.generation = generation_;
+      }
+    }
+  }
+
+  std::vector<ProcessInfo> slots_;
+  unsigned generation_ = 1;
+  std::size_t size_ = 0;
+};
+
+
+/// Top processes by CPU time and by resident memory from /proc/[pid]/stat,
+/// which also contains the resident set size of /proc/[pid]/statm. The proc
+/// directory stays open, and the stat files of up to `max_open_files`
+/// processes stay open between scans, such that known processes only need a
+/// single pread() per scan. The counters of the previous scan are kept in a
+/// second map, and the top processes are selected with a partial sort.
+///
+/// The top processes are only written once they have been copied by
+/// `publish()`, such that another thread can write them while the next scan
+/// is in progress (as long as `publish()` and `write()` are serialized).
+class ProcessTable {
+ public:
+  ProcessTable(std::size_t top, std::size_t max_open_files)
+    : top_(top), max_open_files_(max_open_files), buffer_(4096) {}
+
+  ~ProcessTable() {
+    close_files(previous_);
+    close_files(current_);
+    if (dir_ != nullptr) {
+      closedir(dir_);
+    }
+  }
+
+  ProcessTable(const ProcessTable&) = delete;
+  ProcessTable& operator=(const ProcessTable&) = delete;
+
+  /// Open proc directory, return false on error
+  bool open(const std::string& proc_root, std::string& error) {
+    dir_ = opendir(proc_root.c_str());
+    if (dir_ == nullptr) {
+      error = "could not open directory '" + proc_root + "'";
+      return false;
+    }
+    page_size_ = sysconf(_SC_PAGESIZE);
+    ticks_per_second_ = sysconf(_SC_CLK_TCK);
+    return true;
+  }
+
+  /// Scan all processes and select the top ones
+  void update() {
+    std::swap(previous_, current_);
+    current_.clear();
+    rewinddir(dir_);
+    while (const dirent* entry = readdir(dir_)) {
+      if (entry->d_name[0] < '1' || entry->d_name[0] > '9') {
+        continue;
+      }
+      Int pid = 0;
+      for (const char* c = entry->d_name; *c != '\0'; c++) {
+        pid = 10 * pid + (*c - '0');
+      }
+      scan(pid, entry->d_name);
+    }
+
+    // Stat files of processes that have exited are still open
+    close_files(previous_);
+    previous_.clear();
+    scans_++;
+
+    // Select top processes, which are written in descending order
+    candidates_.clear();
+    current_.for_each([this](ProcessInfo& p) { candidates_.push_back(&p); });
+    const auto n = std::min(top_, candidates_.size());
+    top_cpu_.assign(candidates_.begin(), candidates_.end());
+    std::partial_sort(top_cpu_.begin(), top_cpu_.begin() + n, top_cpu_.end(),
+                      [](const ProcessInfo* a, const ProcessInfo* b) {
+                        return a->cpu_delta > b->cpu_delta
+                               || (a->cpu_delta == b->cpu_delta
+                                   && a->pid < b->pid);
+                      });
+    top_cpu_.resize(n);
+    top_rss_.swap(candidates_);
+    std::partial_sort(top_rss_.begin(), top_rss_.begin() + n, top_rss_.end(),
+                      [](const ProcessInfo* a, const ProcessInfo* b) {
+                        return a->rss > b->rss
+                               || (a->rss == b->rss && a->pid < b->pid);
+                      });
+    top_rss_.resize(n);
+  }
+
+  /// Number of processes found by the last scan
+  std::size_t size() const { return current_.size(); }
+
+  /// Copy the top processes of the last scan for `write()`
+  void publish() {
+    published_cpu_.clear();
+    for (const auto* p : top_cpu_) {
+      published_cpu_.push_back(*p);
+    }
+    published_rss_.clear();
+    for (const auto* p : top_rss_) {
+      published_rss_.push_back(*p);
+    }
+    published_scans_ = scans_;
+  }
+
+  /// Write the published top processes by CPU time and by resident memory,
+  /// one line each, and optionally flush the file. The first scan has no CPU
+  /// time deltas, thus only processes by memory are written. Return false on
+  /// write errors.
+  bool write(std::FILE* file, Int timestamp, bool flush = true) const {
+    if (published_scans_ > 1
+        && !write_lines(file, timestamp, "cpu", published_cpu_)) {
+      return false;
+    }
+    return write_lines(file, timestamp, "rss", published_rss_)
+           && (!flush || std::fflush(file) == 0);
+  }
+
+  /// Header line with column names
+  static const char* header() {
+    return "# timestamp order rank pid cpu_ms rss_bytes command\n";
+  }
+
+ private:
+  using entry_name_type = decltype(dirent::d_name);
+
+  /// Read stat file of process and add it to the current map
+  void scan(Int pid, const char* name) {
+    ProcessInfo* const previous = previous_.find(pid);
+    int fd = -1;
+    if (previous != nullptr) {
+      std::swap(fd, previous->fd);
+    }
+
+    // A handle of a process that has exited (and whose pid may have been
+    // reused) fails to read
+    ssize_t n = -1;
+    if (fd >= 0) {
+      n = pread(fd, buffer_.data(), buffer_.size(), 0);
+      if (n <= 0) {
+        ::close(fd);
+        open_files_--;
+        fd = -1;
+      }
+    }
+    if (fd < 0) {
+      char path[sizeof(entry_name_type) + 8];
+      std::snprintf(path, sizeof(path), "%s/stat", name);
+      fd = openat(dirfd(dir_), path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        return;
+      }
+      n = pread(fd, buffer_.data(), buffer_.size(), 0);
+      if (open_files_ < max_open_files_ && n > 0) {
+        open_files_++;
+      } else {
+        ::close(fd);
+        fd = -1;
+      }
+      if (n <= 0) {
+        return;
+      }
+    }
+
+    // The command name (2nd field) is in parentheses and may contain spaces
+    // and parentheses, thus continue after the last closing parenthesis with
+    // the state (3rd field)
+    const char* const begin = buffer_.data();
+    const char* const end = begin + n;
+    const char* comm_end = end;
+    while (comm_end > begin && *(comm_end - 1) != ')') {
+      comm_end--;
+    }
+    const char* const comm_begin = static_cast<const char*>(
+        std::memchr(begin, '(', static_cast<std::size_t>(end - begin)));
+    if (comm_begin == nullptr || comm_end - 1 <= comm_begin) {
+      if (fd >= 0) {
+        ::close(fd);
+        open_files_--;
+      }
+      return;
+    }
+    Scanner l(comm_end, end);
+    l.skip_word();
+    for (int field = 4; field < 14; field++) {
+      l.parse_int();
+    }
+    const Int utime = l.parse_int();
+    const Int stime = l.parse_int();
+    for (int field = 16; field < 22; field++) {
+      l.parse_int();
+    }
+    const Int start_time = l.parse_int();
+    l.parse_int();
+    const Int rss = l.parse_int();
+
+    auto& p = current_.insert(pid);
+    p.fd = fd;
+    p.start_time = start_time;
+    p.cpu_time = utime + stime;
+    p.rss = rss;
+    const auto length = std::min(
+        static_cast<std::size_t>(comm_end - 1 - (comm_begin + 1)),
+        sizeof(p.comm) - 1);
+    std::memcpy(p.comm, comm_begin + 1, length);
+    p.comm[length] = '\0';
+
+    // Processes that started since the previous scan used all of their CPU
+    // time in the meantime, nothing is known for the first scan
+    if (previous != nullptr && previous->start_time == start_time) {
+      p.cpu_delta = p.cpu_time - previous->cpu_time;
+    } else {
+      p.cpu_delta = (scans_ > 0) ? p.cpu_time : 0;
+    }
+  }
+
+  /// Close stat files of all processes in the map
+  void close_files(ProcessMap& map) {
+    map.for_each([this](ProcessInfo& p) {
+      if (p.fd >= 0) {
+        ::close(p.fd);
+        p.fd = -1;
+        open_files_--;
+      }
+    });
+  }
+
+  bool write_lines(std::FILE* file, Int timestamp, const char* order,
+                   const std::vector<ProcessInfo>& processes) const {
+    for (std::size_t i = 0; i < processes.size(); i++) {
+      const auto& p = processes[i];
+      if (std::fprintf(file, "%lld %s %zu %lld %lld %lld %s\n", timestamp,
+                       order, i + 1, p.pid,
+                       p.cpu_delta * 1000 / ticks_per_second_,
+                       p.rss * page_size_, p.comm) < 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const std::size_t top_;
+  const std::size_t max_open_files_;
+  std::size_t open_files_ = 0;
+  DIR* dir_ = nullptr;
+  Int page_size_ = 4096;
+  Int ticks_per_second_ = 100;
+  Int scans_ = 0;
+  std::vector<char> buffer_;
+  ProcessMap current_;
+  ProcessMap previous_;
+  std::vector<ProcessInfo*> candidates_;
+  std::vector<ProcessInfo*> top_cpu_;
+  std::vector<ProcessInfo*> top_rss_;
+
+  // Top processes as of the last `publish()`
+  std::vector<ProcessInfo> published_cpu_;
+  std::vector<ProcessInfo> published_rss_;
+  Int published_scans_ = 0;
+};
+
+} // namespace sss
+
+#endif // SSS_PROC_HPP
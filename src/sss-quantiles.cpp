@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <getopt.h>
+
+#include "sss-format.hpp"
+#include "sss-sketch.hpp"
+#include "sss-time.hpp"
+
+using sss::Int;
+
+namespace {
+  /// Values for long options without a short equivalent
+  enum LongOption {
+    OPT_FROM = 256,
+    OPT_UNTIL,
+  };
+
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    std::vector<std::string> files;
+    std::string output_file;
+    Int bucket = 0;
+    std::set<std::string> fields;
+    Int from = std::numeric_limits<Int>::min();
+    Int until = std::numeric_limits<Int>::max();
+  };
+
+  /// Merged sketch of a field in a bucket, and the time span of its windows
+  struct Bucket {
+    Int begin = std::numeric_limits<Int>::max();
+    Int end = std::numeric_limits<Int>::min();
+    sss::QuantileSketch sketch;
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-quantiles [-h] [-b BUCKET] [-f FIELDS] [-o OUTPUT]\n"
+     << "                     [--from TIME] [--until TIME] FILE [FILE...]\n"
+     << "\n"
+     << "sss-quantiles merges the quantile sketches written by sss-mon with\n"
+     << "'--rollup-sketches' across time windows and files (e.g., of many\n"
+     << "hosts), without access to the raw samples. For each bucket and\n"
+     << "field, one line with the bucket start, its width, the field name,\n"
+     << "the number of values, the exact minimum and maximum, the estimated\n"
+     << "50th/90th/99th percentile (within 1% of the true value), and the\n"
+     << "merged sketch is written. The output has the same format as the\n"
+     << "input and can be merged again.\n"
+     << "\n"
+     << "positional arguments:\n"
+     << "  FILE                  Sketch file ('ROLLUP_FILE.WIDTH.sketch') or\n"
+     << "                        output of sss-quantiles.\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  -b, --bucket BUCKET   Width of time buckets, which are aligned to\n"
+     << "                        multiples of their width since the Unix\n"
+     << "                        epoch and should be a multiple of the window\n"
+     << "                        width (e.g., '1d'; units: ms, s, m, h, d).\n"
+     << "                        Each window is merged into the bucket of its\n"
+     << "                        start. By default, all windows of a field\n"
+     << "                        are merged into one.\n"
+     << "  -f, --fields FIELDS   Comma-separated list of fields to merge\n"
+     << "                        (default: all).\n"
+     << "  --from TIME           Only merge windows that start at or after\n"
+     << "                        TIME, either a Unix timestamp in\n"
+     << "                        milliseconds or a duration before now\n"
+     << "                        (e.g., '-30d'; units: ms, s, m, h, d).\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  -o, --output OUTPUT   Write to OUTPUT instead of stdout.\n"
+     << "  --until TIME          Only merge windows that start before TIME\n"
+     << "                        (same format as for '--from').\n";
+  os.flush();
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+  const Int now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"bucket", required_argument, nullptr, 'b'},
+      {"fields", required_argument, nullptr, 'f'},
+      {"from", required_argument, nullptr, OPT_FROM},
+      {"help", no_argument, nullptr, 'h'},
+      {"output", required_argument, nullptr, 'o'},
+      {"until", required_argument, nullptr, OPT_UNTIL},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "b:f:ho:", long_options, nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Set bucket width
+      case 'b':
+        {
+          if (!sss::parse_duration(optarg, args.bucket)) {
+            std::cerr << "error: argument to '-b|--bucket' (" << optarg
+                      << ") is not a valid duration" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // Set fields
+      case 'f':
+        {
+          std::istringstream arg(optarg);
+          std::string name;
+          while (std::getline(arg, name, ',')) {
+            args.fields.insert(name);
+          }
+          break;
+        }
+
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Set output file
+      case 'o':
+        {
+          args.output_file = optarg;
+          break;
+        }
+
+      // Set time range
+      case OPT_FROM:
+      case OPT_UNTIL:
+        {
+          auto& timestamp = (c == OPT_FROM) ? args.from : args.until;
+          if (!sss::parse_time_point(optarg, now, timestamp)) {
+            std::cerr << "error: argument to '"
+                      << (c == OPT_FROM ? "--from" : "--until") << "' ("
+                      << optarg << ") is not a valid time" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // Remaining arguments are sketch files
+  for (int i = optind; i < argc; i++) {
+    args.files.push_back(argv[i]);
+  }
+  if (args.files.empty()) {
+    std::cerr << "error: at least one file is required" << std::endl;
+    print_usage();
+    exit(2);
+  }
+
+  return args;
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  const auto args = parse_arguments(argc, argv);
+
+  // Merge the windows of all files into buckets, ordered by bucket start
+  // and field name
+  std::map<std::pair<Int, std::string>, Bucket> buckets;
+  sss::QuantileSketch sketch;
+  for (const auto& path : args.files) {
+    std::ifstream in(path);
+    if (!in.good()) {
+      std::cerr << "error: could not open '" << path << "' for reading"
+                << std::endl;
+      exit(1);
+    }
+    Int number = 0;
+    for (std::string line; std::getline(in, line); ) {
+      number++;
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      Int timestamp = 0;
+      Int duration = 0;
+      std::string field;
+      if (!sss::parse_sketch(line, timestamp, duration, field, sketch)) {
+        std::cerr << "error: malformed sketch in '" << path << "' (line "
+                  << number << ")" << std::endl;
+        exit(1);
+      }
+      if (timestamp < args.from || timestamp >= args.until
+          || (!args.fields.empty() && args.fields.count(field) == 0)) {
+        continue;
+      }
+
+      // Bucket index of window start (aligned to multiples of the width
+      // since the Unix epoch)
+      Int start = 0;
+      if (args.bucket > 0) {
+        start = ((timestamp >= 0)
+                 ? timestamp / args.bucket
+                 : (timestamp - args.bucket + 1) / args.bucket) * args.bucket;
+      }
+      auto& b = buckets[std::make_pair(start, field)];
+      b.begin = std::min(b.begin, timestamp);
+      b.end = std::max(b.end, timestamp + duration);
+      b.sketch.merge(sketch);
+    }
+  }
+
+  // Open output file
+  std::FILE* output = stdout;
+  if (!args.output_file.empty()) {
+    output = std::fopen(args.output_file.c_str(), "w");
+    if (output == nullptr) {
+      std::cerr << "error: could not open output file '" << args.output_file
+                << "' for writing" << std::endl;
+      exit(1);
+    }
+  }
+
+  // Write merged sketches, which span their bucket or, without buckets, all
+  // merged windows
+  bool good = std::fputs(sss::sketch_header(), output) >= 0;
+  for (const auto& entry : buckets) {
+    const auto& b = entry.second;
+    if (b.sketch.count() == 0) {
+      continue;
+    }
+    const auto line = (args.bucket > 0)
+      ? sss::format_sketch(entry.first.first, args.bucket,
+                           entry.first.second, b.sketch)
+      : sss::format_sketch(b.begin, b.end - b.begin, entry.first.second,
+                           b.sketch);
+    good = good && std::fputs(line.c_str(), output) >= 0;
+  }
+
+  // Close output file
+  good = (std::fflush(output) == 0) && good;
+  if (output != stdout) {
+    good = (std::fclose(output) == 0) && good;
+  }
+  if (!good) {
+    std::cerr << "error: could not write output" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "sss-columnar.hpp"
+#include "sss-format.hpp"
+#include "sss-time.hpp"
+
+using sss::Float;
+using sss::Int;
+
+namespace {
+  /// Values for long options without a short equivalent
+  enum LongOption {
+    OPT_FROM = 256,
+    OPT_UNTIL,
+  };
+
+  /// Internal data structure for command line arguments
+  struct CommandLineArguments {
+    std::string archive;
+    std::vector<std::string> conditions;
+    std::vector<std::string> aggregates;
+    bool verbose = false;
+    Int from = std::numeric_limits<Int>::min();
+    Int until = std::numeric_limits<Int>::max();
+  };
+
+  /// Value of a column ('FIELD') or its increase since the previous row
+  /// ('+FIELD')
+  struct Expression {
+    int column = -1;
+    bool increase = false;
+  };
+
+  /// Comparison of an expression with a constant
+  enum class Op { less, less_equal, greater, greater_equal };
+
+  struct Condition {
+    Expression expression;
+    Op op = Op::greater;
+    double value = 0.0;
+  };
+
+  /// Reduction over all rows that satisfy the conditions
+  enum class Reduction { count, min, max, sum, mean };
+
+  struct Aggregate {
+    std::string text;
+    Reduction reduction = Reduction::count;
+    Expression expression;
+    double count = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0.0;
+  };
+}
+
+
+/// Print usage information
+static void print_usage(std::ostream& os = std::cerr) {
+  os << "usage: sss-query [-h] [-v] [--from TIME] [--until TIME]\n"
+     << "                 [-w CONDITION] ARCHIVE AGGREGATE [AGGREGATE...]\n"
+     << "\n"
+     << "sss-query computes aggregates over the records of a columnar\n"
+     << "archive (see 'sss-convert -t columnar') that satisfy all\n"
+     << "conditions. Only the columns used by the query are read, and blocks\n"
+     << "of records are skipped or aggregated as a whole using their zone\n"
+     << "maps where possible. One line per aggregate is written with the\n"
+     << "aggregate and its value.\n"
+     << "\n"
+     << "Expressions are either a field name (see 'sss-mon -f'), or a field\n"
+     << "name with a leading '+' for the increase since the previous record\n"
+     << "(e.g., '+cpu_time_iowait'). Records without a valid predecessor\n"
+     << "(time_delta of zero) are skipped if an increase is used.\n"
+     << "\n"
+     << "positional arguments:\n"
+     << "  ARCHIVE               Directory with a columnar archive.\n"
+     << "  AGGREGATE             'count' for the number of records, or\n"
+     << "                        'min:EXPR', 'max:EXPR', 'sum:EXPR', or\n"
+     << "                        'mean:EXPR' (e.g., 'max:memory_used').\n"
+     << "\n"
+     << "optional arguments:\n"
+     << "  --from TIME           Only use records with a timestamp at or\n"
+     << "                        after TIME, either a Unix timestamp in\n"
+     << "                        milliseconds or a duration before now\n"
+     << "                        (e.g., '-7d'; units: ms, s, m, h, d).\n"
+     << "  -h, --help            Show this help message and exit.\n"
+     << "  --until TIME          Only use records with a timestamp before\n"
+     << "                        TIME (same format as for '--from').\n"
+     << "  -v, --verbose         Write the number of blocks that were\n"
+     << "                        skipped, aggregated from their zone maps,\n"
+     << "                        and scanned to stderr.\n"
+     << "  -w, --where CONDITION\n"
+     << "                        Only use records for which CONDITION holds,\n"
+     << "                        given as 'EXPR>VALUE', 'EXPR>=VALUE',\n"
+     << "                        'EXPR<VALUE', or 'EXPR<=VALUE' (e.g.,\n"
+     << "                        '+cpu_time_iowait>50'). May be given\n"
+     << "                        multiple times.\n";
+  os.flush();
+}
+
+
+/// Parse command line options
+static CommandLineArguments parse_arguments(int argc, char* argv[]) {
+  CommandLineArguments args;
+  const Int now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+  // Parse option arguments
+  while (true) {
+    // Create structure with long options
+    static struct option long_options[] = {
+      {"from", required_argument, nullptr, OPT_FROM},
+      {"help", no_argument, nullptr, 'h'},
+      {"until", required_argument, nullptr, OPT_UNTIL},
+      {"verbose", no_argument, nullptr, 'v'},
+      {"where", required_argument, nullptr, 'w'},
+      {nullptr, 0, nullptr, 0}
+    };
+
+    // Get next argument
+    const auto c = getopt_long(argc, argv, "hvw:", long_options, nullptr);
+
+    // Exit loop if end of options is reached
+    if (c == -1) {
+      break;
+    }
+
+    // Handle argument
+    switch (c) {
+      // Show usage information and quit
+      case 'h':
+        {
+          print_usage(std::cout);
+          exit(0);
+        }
+
+      // Report block statistics
+      case 'v':
+        {
+          args.verbose = true;
+          break;
+        }
+
+      // Add condition
+      case 'w':
+        {
+          args.conditions.push_back(optarg);
+          break;
+        }
+
+      // Set time range
+      case OPT_FROM:
+      case OPT_UNTIL:
+        {
+          auto& timestamp = (c == OPT_FROM) ? args.from : args.until;
+          if (!sss::parse_time_point(optarg, now, timestamp)) {
+            std::cerr << "error: argument to '"
+                      << (c == OPT_FROM ? "--from" : "--until") << "' ("
+                      << optarg << ") is not a valid time" << std::endl;
+            exit(2);
+          }
+          break;
+        }
+
+      // If an unknown/bad argument was encountered, show usage and quit
+      case '?':
+        {
+          print_usage();
+          exit(2);
+          break;
+        }
+
+      // The default should never be reached and signifies an unknown problem
+      default:
+        {
+          std::cerr << "error: unknown error while parsing command line "
+                    << "arguments" << std::endl;
+          exit(1);
+        }
+    }
+  }
+
+  // Remaining arguments are the archive and the aggregates
+  if (argc - optind < 2) {
+    std::cerr << "error: an archive and at least one aggregate are required"
+              << std::endl;
+    print_usage();
+    exit(2);
+  }
+  args.archive = argv[optind];
+  for (int i = optind + 1; i < argc; i++) {
+    args.aggregates.push_back(argv[i]);
+  }
+
+  return args;
+}
+
+
+/// Parse expression, return false if the field does not exist
+static bool parse_expression(const std::string& text,
+                             const sss::ColumnarArchive& archive,
+                             Expression& expression) {
+  expression.increase = !text.empty() && text[0] == '+';
+  expression.column = archive.find(text.substr(expression.increase ? 1 : 0));
+  return expression.column >= 0;
+}
+
+
+/// Parse condition, return false if it is invalid
+static bool parse_condition(const std::string& text,
+                            const sss::ColumnarArchive& archive,
+                            Condition& condition) {
+  const auto op = text.find_first_of("<>");
+  if (op == std::string::npos
+      || !parse_expression(text.substr(0, op), archive,
+                           condition.expression)) {
+    return false;
+  }
+  const bool equal = (op + 1 < text.size() && text[op + 1] == '=');
+  if (text[op] == '<') {
+    condition.op = equal ? Op::less_equal : Op::less;
+  } else {
+    condition.op = equal ? Op::greater_equal : Op::greater;
+  }
+  std::istringstream in(text.substr(op + (equal ? 2 : 1)));
+  in >> condition.value;
+  return !in.fail() && in.get() == std::istringstream::traits_type::eof();
+}
+
+
+/// Parse aggregate, return false if it is invalid
+static bool parse_aggregate(const std::string& text,
+                            const sss::ColumnarArchive& archive,
+                            Aggregate& aggregate) {
+  aggregate.text = text;
+  if (text == "count") {
+    aggregate.reduction = Reduction::count;
+    return true;
+  }
+  const auto colon = text.find(':');
+  const auto name = text.substr(0, colon);
+  if (name == "min") {
+    aggregate.reduction = Reduction::min;
+  } else if (name == "max") {
+    aggregate.reduction = Reduction::max;
+  } else if (name == "sum") {
+    aggregate.reduction = Reduction::sum;
+  } else if (name == "mean") {
+    aggregate.reduction = Reduction::mean;
+  } else {
+    return false;
+  }
+  return colon != std::string::npos
+         && parse_expression(text.substr(colon + 1), archive,
+                             aggregate.expression);
+}
+
+
+/// Return the values of an expression for the rows [begin, begin + n),
+/// either in place or converted to `buffer`. The increase of the first row
+/// of the archive is NaN.
+static const double* evaluate(const sss::ColumnarArchive& archive,
+                              const Expression& e, std::uint64_t begin,
+                              std::size_t n, std::vector<double>& buffer) {
+  if (archive.type(e.column) == 'f') {
+    const Float* x = archive.floats(e.column) + begin;
+    if (!e.increase) {
+      return x;
+    }
+    buffer[0] = (begin > 0) ? x[0] - x[-1]
+                            : std::numeric_limits<double>::quiet_NaN();
+    for (std::size_t i = 1; i < n; i++) {
+      buffer[i] = x[i] - x[i - 1];
+    }
+    return buffer.data();
+  }
+  const Int* x = archive.ints(e.column) + begin;
+  if (!e.increase) {
+    for (std::size_t i = 0; i < n; i++) {
+      buffer[i] = static_cast<double>(x[i]);
+    }
+    return buffer.data();
+  }
+  buffer[0] = (begin > 0) ? static_cast<double>(x[0] - x[-1])
+                          : std::numeric_limits<double>::quiet_NaN();
+  for (std::size_t i = 1; i < n; i++) {
+    buffer[i] = static_cast<double>(x[i] - x[i - 1]);
+  }
+  return buffer.data();
+}
+
+
+/// Clear mask of all rows whose value does not satisfy the comparison. The
+/// loop has no branches, such that the compiler can vectorize it.
+template <typename Compare>
+static void filter(const double* x, std::size_t n, double value,
+                   unsigned char* mask, Compare compare) {
+  for (std::size_t i = 0; i < n; i++) {
+    mask[i] &= static_cast<unsigned char>(compare(x[i], value));
+  }
+}
+
+static void filter(const double* x, std::size_t n, Op op, double value,
+                   unsigned char* mask) {
+  switch (op) {
+    case Op::less:
+      filter(x, n, value, mask, [](double a, double b) { return a < b; });
+      break;
+    case Op::less_equal:
+      filter(x, n, value, mask, [](double a, double b) { return a <= b; });
+      break;
+    case Op::greater:
+      filter(x, n, value, mask, [](double a, double b) { return a > b; });
+      break;
+    case Op::greater_equal:
+      filter(x, n, value, mask, [](double a, double b) { return a >= b; });
+      break;
+  }
+}
+
+
+/// Add count, minimum, maximum, and sum of the values with a non-zero mask
+/// to the aggregate. Four independent accumulators allow the compiler to
+/// vectorize the loop without reordering floating point additions.
+static void reduce(const double* x, const unsigned char* mask, std::size_t n,
+                   Aggregate& a) {
+  constexpr std::size_t lanes = 4;
+  const double inf = std::numeric_limits<double>::infinity();
+  double count[lanes] = {0.0, 0.0, 0.0, 0.0};
+  double low[lanes] = {inf, inf, inf, inf};
+  double high[lanes] = {-inf, -inf, -inf, -inf};
+  double sum[lanes] = {0.0, 0.0, 0.0, 0.0};
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes) {
+    for (std::size_t k = 0; k < lanes; k++) {
+      const bool m = mask[i + k] != 0;
+      const double v = x[i + k];
+      count[k] += m ? 1.0 : 0.0;
+      low[k] = (m && v < low[k]) ? v : low[k];
+      high[k] = (m && v > high[k]) ? v : high[k];
+      sum[k] += m ? v : 0.0;
+    }
+  }
+  for (; i < n; i++) {
+    if (mask[i] != 0) {
+      count[0] += 1.0;
+      low[0] = (x[i] < low[0]) ? x[i] : low[0];
+      high[0] = (x[i] > high[0]) ? x[i] : high[0];
+      sum[0] += x[i];
+    }
+  }
+  for (std::size_t k = 0; k < lanes; k++) {
+    a.count += count[k];
+    a.min = (low[k] < a.min) ? low[k] : a.min;
+    a.max = (high[k] > a.max) ? high[k] : a.max;
+    a.sum += sum[k];
+  }
+}
+
+
+/// Return number of rows with a non-zero mask
+static double count_rows(const unsigned char* mask, std::size_t n) {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    count += mask[i];
+  }
+  return static_cast<double>(count);
+}
+
+
+/// Decide from the zone of a block whether all (1), none (-1), or some (0)
+/// of its values satisfy a comparison
+static int decide(const sss::Zone& z, Op op, double value) {
+  switch (op) {
+    case Op::less:
+      return (z.max < value) ? 1 : (z.min >= value) ? -1 : 0;
+    case Op::less_equal:
+      return (z.max <= value) ? 1 : (z.min > value) ? -1 : 0;
+    case Op::greater:
+      return (z.min > value) ? 1 : (z.max <= value) ? -1 : 0;
+    case Op::greater_equal:
+      return (z.min >= value) ? 1 : (z.max < value) ? -1 : 0;
+  }
+  return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+  // Parse command line arguments
+  const auto args = parse_arguments(argc, argv);
+
+  // Open archive and parse query
+  sss::ColumnarArchive archive;
+  std::string error;
+  if (!archive.open(args.archive, error)) {
+    std::cerr << "error: " << error << std::endl;
+    exit(1);
+  }
+  std::vector<Condition> conditions(args.conditions.size());
+  for (std::size_t i = 0; i < conditions.size(); i++) {
+    if (!parse_condition(args.conditions[i], archive, conditions[i])) {
+      std::cerr << "error: argument to '-w|--where' (" << args.conditions[i]
+                << ") is not a valid condition" << std::endl;
+      exit(2);
+    }
+  }
+  std::vector<Aggregate> aggregates(args.aggregates.size());
+  for (std::size_t i = 0; i < aggregates.size(); i++) {
+    if (!parse_aggregate(args.aggregates[i], archive, aggregates[i])) {
+      std::cerr << "error: '" << args.aggregates[i] << "' is not a valid "
+                << "aggregate" << std::endl;
+      exit(2);
+    }
+  }
+
+  // Map the columns used by the query
+  const int timestamp = archive.find("timestamp");
+  const int time_delta = archive.find("time_delta");
+  bool increase = false;
+  std::vector<int> columns = {timestamp, time_delta};
+  for (const auto& c : conditions) {
+    columns.push_back(c.expression.column);
+    increase = increase || c.expression.increase;
+  }
+  for (const auto& a : aggregates) {
+    columns.push_back(a.expression.column);
+    increase = increase || a.expression.increase;
+  }
+  for (const auto column : columns) {
+    if (column == time_delta && !increase) {
+      continue;
+    }
+    if (column < 0 && column == timestamp) {
+      std::cerr << "error: archive '" << args.archive << "' has no "
+                << "timestamp" << std::endl;
+      exit(1);
+    }
+    if (column >= 0 && !archive.map(column, error)) {
+      std::cerr << "error: " << error << std::endl;
+      exit(1);
+    }
+  }
+  if (increase && time_delta < 0) {
+    std::cerr << "error: archive '" << args.archive << "' has no time_delta"
+              << std::endl;
+    exit(1);
+  }
+
+  // Process one block at a time
+  const auto block_rows = static_cast<std::size_t>(archive.block_rows());
+  std::vector<unsigned char> mask(block_rows);
+  std::vector<double> buffer(block_rows);
+  const double from = static_cast<double>(args.from);
+  const double until = static_cast<double>(args.until);
+  std::uint64_t skipped = 0;
+  std::uint64_t zoned = 0;
+  for (std::uint64_t b = 0; b < archive.blocks(); b++) {
+    const std::uint64_t begin = b * block_rows;
+    const auto n = static_cast<std::size_t>(
+        std::min<std::uint64_t>(block_rows, archive.rows() - begin));
+
+    // Restrict to the time range unless the block is entirely inside
+    bool masked = false;
+    const auto start_mask = [&]() {
+      if (!masked) {
+        std::fill(mask.begin(), mask.begin() + n, 1);
+        masked = true;
+      }
+    };
+    const auto t = archive.zone(timestamp, b);
+    if (t.max < from || t.min >= until) {
+      skipped++;
+      continue;
+    }
+    if (t.min < from || t.max >= until) {
+      start_mask();
+      Expression e;
+      e.column = timestamp;
+      const double* x = evaluate(archive, e, begin, n, buffer);
+      filter(x, n, Op::greater_equal, from, &mask[0]);
+      filter(x, n, Op::less, until, &mask[0]);
+    }
+
+    // Apply conditions, using the zone maps to decide for whole blocks
+    bool none = false;
+    for (const auto& c : conditions) {
+      const int decision = c.expression.increase
+                           ? 0
+                           : decide(archive.zone(c.expression.column, b),
+                                    c.op, c.value);
+      if (decision < 0) {
+        none = true;
+        break;
+      }
+      if (decision == 0) {
+        start_mask();
+        const double* x = evaluate(archive, c.expression, begin, n, buffer);
+        filter(x, n, c.op, c.value, &mask[0]);
+      }
+    }
+    if (none) {
+      skipped++;
+      continue;
+    }
+
+    // Increases require a predecessor
+    if (increase) {
+      start_mask();
+      Expression e;
+      e.column = time_delta;
+      const double* x = evaluate(archive, e, begin, n, buffer);
+      filter(x, n, Op::greater, 0.0, &mask[0]);
+      if (begin == 0) {
+        mask[0] = 0;
+      }
+    }
+
+    // Aggregate whole blocks from their zone maps, others from their values
+    // (increases are always masked)
+    const double rows = masked ? count_rows(&mask[0], n)
+                               : static_cast<double>(n);
+    zoned += masked ? 0 : 1;
+    for (auto& a : aggregates) {
+      if (a.expression.column < 0) {
+        a.count += rows;
+      } else if (!masked) {
+        const auto z = archive.zone(a.expression.column, b);
+        a.count += rows;
+        a.min = (z.min < a.min) ? z.min : a.min;
+        a.max = (z.max > a.max) ? z.max : a.max;
+        a.sum += z.sum;
+      } else if (rows > 0) {
+        const double* x = evaluate(archive, a.expression, begin, n, buffer);
+        reduce(x, &mask[0], n, a);
+      }
+    }
+  }
+  if (args.verbose) {
+    std::cerr << archive.blocks() << " blocks: " << skipped << " skipped, "
+              << zoned << " from zone maps, "
+              << archive.blocks() - skipped - zoned << " scanned"
+              << std::endl;
+  }
+
+  // Write results
+  for (const auto& a : aggregates) {
+    double value = a.count;
+    switch (a.reduction) {
+      case Reduction::count: break;
+      case Reduction::min: value = a.min; break;
+      case Reduction::max: value = a.max; break;
+      case Reduction::sum: value = a.sum; break;
+      case Reduction::mean: value = a.sum / a.count; break;
+    }
+    if (a.count == 0 && a.reduction != Reduction::count
+        && a.reduction != Reduction::sum) {
+      value = std::numeric_limits<double>::quiet_NaN();
+    }
+    const bool integral = a.reduction == Reduction::count
+                          || (a.reduction != Reduction::mean
+                              && archive.type(a.expression.column) == 'i');
+    std::printf(integral && std::isfinite(value) ? "%s %.0f\n" : "%s %.6g\n",
+                a.text.c_str(), value);
+  }
+
+  return 0;
+}
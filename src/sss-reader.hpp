@@ -0,0 +1,329 @@
+#ifndef SSS_READER_HPP
+#define SSS_READER_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sss-block.hpp"
+#include "sss-format.hpp"
+#include "sss-index.hpp"
+#include "sss-mmap.hpp"
+#include "sss-ring.hpp"
+
+namespace sss {
+
+/// Sequential reader for log files in any supported format (text, binary,
+/// compressed, or ring files). The format is detected from the beginning of
+/// the file. Compressed files are decoded one block at a time.
+class LogReader {
+ public:
+  /// Open log file for reading, "-" denotes stdin
+  bool open(const std::string& path) {
+    path_ = path;
+    line_number_ = 0;
+    ring_.reset();
+    block_records_.clear();
+    block_position_ = 0;
+    if (path == "-") {
+      file_.reset();
+      in_ = &std::cin;
+    } else {
+      file_.reset(new std::ifstream(path, std::ios::in | std::ios::binary));
+      if (!file_->good()) {
+        error_ = "could not open '" + path + "' for reading";
+        return false;
+      }
+      in_ = file_.get();
+    }
+
+    // Detect binary files by their magic bytes
+    std::string header(binary_fixed_header_size, '\0');
+    const auto n = in_->rdbuf()->sgetn(&header[0], header.size());
+    header.resize(static_cast<std::size_t>(n));
+    if (is_ring_file(header.data(), header.size())) {
+      return open_ring();
+    }
+    if (is_block_file(header.data(), header.size())) {
+      format_ = Format::compressed;
+      pending_ = header;
+      return true;
+    }
+    if (header.size() < binary_fixed_header_size
+        || header.compare(0, sizeof(binary_magic),
+                          binary_magic, sizeof(binary_magic)) != 0) {
+      // Not binary: put back what was read by prepending it to the first line
+      format_ = Format::text;
+      pending_ = header;
+      return true;
+    }
+
+    // Read remainder of binary header
+    format_ = Format::binary;
+    const auto header_size = BinaryLayout::header_size(
+        header.data(), header.size());
+    if (header_size > header.size()) {
+      header.resize(header_size);
+      const auto remaining = static_cast<std::streamsize>(
+          header_size - binary_fixed_header_size);
+      if (in_->rdbuf()->sgetn(&header[binary_fixed_header_size], remaining)
+          != remaining) {
+        error_ = "'" + path + "': truncated binary log file header";
+        return false;
+      }
+    }
+    std::string error;
+    if (!layout_.parse(header.data(), header.size(), error)) {
+      error_ = "'" + path + "': " + error;
+      return false;
+    }
+    record_.resize(layout_.record_size());
+    return true;
+  }
+
+  /// Read next sample, return false at the end of the file or on error (in
+  /// which case `error()` is non-empty)
+  bool next(Sample& s) {
+    error_.clear();
+    s = Sample{};
+
+    // Ring files are mapped and read in time order
+    if (ring_) {
+      if (!(ring_position_ != ring_->end())) {
+        return false;
+      }
+      layout_.decode(*ring_position_, s);
+      ++ring_position_;
+      return true;
+    }
+
+    if (format_ == Format::compressed) {
+      if (block_position_ >= block_records_.size() && !next_block()) {
+        return false;
+      }
+      layout_.decode(&block_records_[block_position_], s);
+      block_position_ += layout_.record_size();
+      return true;
+    }
+
+    if (format_ == Format::binary) {
+      const auto n = static_cast<std::streamsize>(record_.size());
+      const auto read = in_->rdbuf()->sgetn(&record_[0], n);
+      if (read != n) {
+        if (read != 0) {
+          error_ = "'" + path_ + "': truncated record at end of file";
+        }
+        return false;
+      }
+      layout_.decode(record_.data(), s);
+      return true;
+    }
+
+    // Text: skip empty lines and comments
+    while (next_line()) {
+      line_number_++;
+      const auto begin = line_.find_first_not_of(" \t\r");
+      if (begin == std::string::npos || line_[begin] == '#') {
+        continue;
+      }
+      if (!parse_text(line_.data() + begin, line_.data() + line_.size(), s)) {
+        error_ = "'" + path_ + "': malformed record in line "
+                 + std::to_string(line_number_);
+        return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /// Skip ahead towards the first record with a timestamp not before `from`.
+  /// Binary and ring files are searched directly, text and compressed files
+  /// only if they have a matching index file. Records before `from` may still
+  /// be returned afterwards. Must be called right after `open()`.
+  void seek(Int from) {
+    if (!file_) {
+      return;
+    }
+    const auto rs = layout_.record_size();
+    Sample s;
+
+    // Ring files are mapped
+    if (ring_) {
+      ring_position_ = ring_->at(lower_bound_timestamp(
+          ring_->size(), from, [&](std::uint64_t i) {
+            layout_.decode(*ring_->at(i), s);
+            return s.timestamp;
+          }));
+      return;
+    }
+
+    // Binary files have fixed-size records
+    auto buffer = file_->rdbuf();
+    if (format_ == Format::binary) {
+      const auto data_begin = buffer->pubseekoff(0, std::ios::cur);
+      const auto size = buffer->pubseekoff(0, std::ios::end);
+      const auto count = static_cast<std::uint64_t>(size - data_begin) / rs;
+      const auto first = lower_bound_timestamp(
+          count, from, [&](std::uint64_t i) {
+            buffer->pubseekpos(
+                data_begin + static_cast<std::streamoff>(i * rs));
+            buffer->sgetn(&record_[0], static_cast<std::streamsize>(rs));
+            layout_.decode(record_.data(), s);
+            return s.timestamp;
+          });
+      buffer->pubseekpos(data_begin + static_cast<std::streamoff>(first * rs));
+      return;
+    }
+
+    // Text and compressed files need an index
+    LogIndex index;
+    if (!index.open(index_path(path_))) {
+      return;
+    }
+    const auto i = index.last_before(from);
+    if (i == index.size()) {
+      return;
+    }
+    const auto offset = static_cast<std::streamoff>(index.offset(i));
+    if (offset == 0) {
+      return;
+    }
+
+    // Verify that the entry matches the log file, otherwise read from the
+    // beginning
+    bool valid = false;
+    in_->clear();
+    pending_.clear();
+    if (format_ == Format::compressed) {
+      buffer->pubseekpos(offset);
+      valid = next_block() && !block_records_.empty();
+      if (valid) {
+        layout_.decode(block_records_.data(), s);
+      }
+    } else {
+      buffer->pubseekpos(offset - 1);
+      valid = buffer->sbumpc() == '\n' && next_line()
+              && parse_text(line_.data(), line_.data() + line_.size(), s);
+      pending_ = line_ + '\n';
+    }
+    if (!valid || s.timestamp != index.timestamp(i)) {
+      error_.clear();
+      in_->clear();
+      pending_.clear();
+      block_records_.clear();
+      buffer->pubseekpos(0);
+    }
+  }
+
+  Format format() const { return format_; }
+  const BinaryLayout& layout() const { return layout_; }
+  const std::string& error() const { return error_; }
+
+ private:
+  /// Map ring file, since its records are not stored in time order
+  bool open_ring() {
+    format_ = Format::binary;
+    if (!file_) {
+      error_ = "ring files cannot be read from stdin";
+      return false;
+    }
+    if (!map_.open(path_)) {
+      error_ = "could not open '" + path_ + "' for reading";
+      return false;
+    }
+    RingInfo info;
+    std::string error;
+    if (!parse_ring_header(map_.data(), map_.size(), info, layout_, error)) {
+      error_ = "'" + path_ + "': " + error;
+      return false;
+    }
+    if (info.data_begin + info.capacity * info.record_size > map_.size()) {
+      error_ = "'" + path_ + "': truncated ring file";
+      return false;
+    }
+    ring_.reset(new RingRecords(map_.data(), info));
+    ring_position_ = ring_->begin();
+    return true;
+  }
+
+  /// Read and decode next block of a compressed file (the fixed header of the
+  /// first block was already read into pending_)
+  bool next_block() {
+    std::string block;
+    block.swap(pending_);
+    const auto missing = static_cast<std::streamsize>(
+        block_fixed_header_size - block.size());
+    block.resize(block_fixed_header_size);
+    const auto read = in_->rdbuf()->sgetn(
+        &block[block_fixed_header_size - missing], missing);
+    if (read == 0 && missing == block_fixed_header_size) {
+      return false;
+    }
+    const auto size = block_size(block.data(), block.size());
+    if (read != missing || size < block_fixed_header_size) {
+      error_ = "'" + path_ + "': corrupt block header";
+      return false;
+    }
+    block.resize(size);
+    const auto remaining = static_cast<std::streamsize>(
+        size - block_fixed_header_size);
+    if (in_->rdbuf()->sgetn(&block[block_fixed_header_size], remaining)
+        != remaining) {
+      error_ = "'" + path_ + "': truncated block at end of file";
+      return false;
+    }
+    std::string error;
+    if (!decode_block(block.data(), block.size(), layout_, block_records_,
+                      error)) {
+      error_ = "'" + path_ + "': " + error;
+      return false;
+    }
+    block_position_ = 0;
+    return !block_records_.empty() || next_block();
+  }
+
+  /// Read next text line into line_, prepending any pending data
+  bool next_line() {
+    line_.swap(pending_);
+    pending_.clear();
+    const auto eol = line_.find('\n');
+    if (eol != std::string::npos) {
+      pending_.assign(line_, eol + 1, std::string::npos);
+      line_.resize(eol);
+      return true;
+    }
+    std::string rest;
+    if (!std::getline(*in_, rest)) {
+      return !line_.empty();
+    }
+    line_ += rest;
+    return true;
+  }
+
+  std::string path_;
+  std::unique_ptr<std::ifstream> file_;
+  std::istream* in_ = nullptr;
+  Format format_ = Format::text;
+  BinaryLayout layout_;
+  std::vector<char> record_;
+  std::string line_;
+  std::string pending_;
+  std::string error_;
+  Int line_number_ = 0;
+
+  // Compressed files
+  std::vector<char> block_records_;
+  std::size_t block_position_ = 0;
+
+  // Ring files
+  MappedFile map_;
+  std::unique_ptr<RingRecords> ring_;
+  RingRecords::iterator ring_position_;
+};
+
+} // namespace sss
+
+#endif // SSS_READER_HPP
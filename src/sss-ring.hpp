@@ -0,0 +1,289 @@
+#ifndef SSS_RING_HPP
+#define SSS_RING_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Ring files hold at most a fixed number of binary records in preallocated
+/// slots. Once all slots are used, each new record overwrites the oldest one.
+///
+///   offset  size  content
+///        0     8  magic bytes "SSS-RING"
+///        8     4  format version
+///       12     4  reserved (zero)
+///       16     8  capacity (number of slots)
+///       24     8  head (slot index of oldest record)
+///       32     8  count (number of valid records)
+///       40     -  binary log file header (see BinaryLayout)
+///
+/// The slots follow directly after the binary log file header. Record i (in
+/// time order) is stored in slot `(head + i) % capacity`.
+constexpr char ring_magic[8] = {'S', 'S', 'S', '-', 'R', 'I', 'N', 'G'};
+constexpr std::uint32_t ring_version = 1;
+constexpr std::size_t ring_fixed_header_size = 40;
+
+/// Position of the records in a ring file
+struct RingInfo {
+  std::uint64_t capacity = 0;
+  std::uint64_t head = 0;
+  std::uint64_t count = 0;
+  std::size_t data_begin = 0;
+  std::size_t record_size = 0;
+
+  /// Byte offset of the i-th record in time order
+  std::size_t offset(std::uint64_t i) const {
+    return data_begin + static_cast<std::size_t>((head + i) % capacity)
+                        * record_size;
+  }
+};
+
+/// Return true if the data starts with the ring file magic bytes
+inline bool is_ring_file(const char* data, std::size_t size) {
+  return size >= sizeof(ring_magic)
+         && std::memcmp(data, ring_magic, sizeof(ring_magic)) == 0;
+}
+
+/// Return the size of the complete ring file header (including the binary
+/// log file header) or zero if the data is too short
+inline std::size_t ring_header_size(const char* data, std::size_t size) {
+  if (size < ring_fixed_header_size + binary_fixed_header_size) {
+    return 0;
+  }
+  return ring_fixed_header_size + BinaryLayout::header_size(
+      data + ring_fixed_header_size, size - ring_fixed_header_size);
+}
+
+/// Parse ring file header, which must be completely contained in the data
+inline bool parse_ring_header(const char* data, std::size_t size,
+                              RingInfo& info, BinaryLayout& layout,
+                              std::string& error) {
+  if (!is_ring_file(data, size) || ring_header_size(data, size) == 0) {
+    error = "not a ring file";
+    return false;
+  }
+  if (load_le32(data + 8) != ring_version) {
+    error = "unsupported ring file version "
+            + std::to_string(load_le32(data + 8));
+    return false;
+  }
+  if (!layout.parse(data + ring_fixed_header_size,
+                    size - ring_fixed_header_size, error)) {
+    return false;
+  }
+  info.capacity = load_le64(data + 16);
+  info.head = load_le64(data + 24);
+  info.count = load_le64(data + 32);
+  info.data_begin = ring_header_size(data, size);
+  info.record_size = layout.record_size();
+  if (info.capacity == 0 || info.head >= info.capacity
+      || info.count > info.capacity) {
+    error = "corrupt ring file header";
+    return false;
+  }
+  return true;
+}
+
+
+/// Forward iteration over the records of a ring file in memory (e.g., a
+/// mapped file) in time order, i.e., from the oldest to the newest record
+class RingRecords {
+ public:
+  class iterator {
+   public:
+    iterator() = default;
+
+    iterator(const char* data, const RingInfo& info, std::uint64_t index)
+      : data_(data), info_(&info), index_(index) {}
+
+    /// Pointer to the current record
+    const char* operator*() const { return data_ + info_->offset(index_); }
+
+    iterator& operator++() {
+      index_++;
+      return *this;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    const char* data_ = nullptr;
+    const RingInfo* info_ = nullptr;
+    std::uint64_t index_ = 0;
+  };
+
+  /// The data must contain the entire ring file
+  RingRecords(const char* data, const RingInfo& info)
+    : data_(data), info_(info) {}
+
+  iterator begin() const { return iterator(data_, info_, 0); }
+  iterator at(std::uint64_t i) const { return iterator(data_, info_, i); }
+  iterator end() const { return iterator(data_, info_, info_.count); }
+  std::uint64_t size() const { return info_.count; }
+
+ private:
+  const char* data_;
+  RingInfo info_;
+};
+
+
+/// Writer for ring files. Appending a record costs one write for the record
+/// and one for the updated head/count (two once the file is full),
+/// independent of the file size.
+class RingFile {
+ public:
+  RingFile() = default;
+
+  ~RingFile() { close(); }
+
+  RingFile(const RingFile&) = delete;
+  RingFile& operator=(const RingFile&) = delete;
+
+  /// Open existing ring file or create a new one with the given capacity. An
+  /// existing file must have the same layout and capacity.
+  bool open(const std::string& path, const BinaryLayout& layout,
+            std::uint64_t capacity, std::string& error) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      error = "could not open '" + path + "' for writing";
+      return false;
+    }
+    struct stat sb;
+    if (fstat(fd_, &sb) != 0) {
+      error = "could not stat '" + path + "'";
+      close();
+      return false;
+    }
+
+    const auto binary_header = layout.header();
+    info_.capacity = capacity;
+    info_.head = 0;
+    info_.count = 0;
+    info_.data_begin = ring_fixed_header_size + binary_header.size();
+    info_.record_size = layout.record_size();
+
+    if (sb.st_size == 0) {
+      // Write header of new file and preallocate all slots
+      std::string header(ring_fixed_header_size, '\0');
+      std::memcpy(&header[0], ring_magic, sizeof(ring_magic));
+      store_le32(ring_version, &header[8]);
+      store_le64(capacity, &header[16]);
+      header += binary_header;
+      if (!write_at(header.data(), header.size(), 0)) {
+        error = "could not write to '" + path + "'";
+        close();
+        return false;
+      }
+      const auto size = static_cast<off_t>(
+          info_.data_begin + capacity * info_.record_size);
+      if (posix_fallocate(fd_, 0, size) != 0 && ftruncate(fd_, size) != 0) {
+        error = "could not allocate space for '" + path + "'";
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    // Check header of existing file
+    std::vector<char> header(info_.data_begin);
+    RingInfo existing;
+    BinaryLayout existing_layout;
+    if (::pread(fd_, header.data(), header.size(), 0)
+        != static_cast<ssize_t>(header.size())
+        || !parse_ring_header(header.data(), header.size(), existing,
+                              existing_layout, error)
+        || std::string(header.data() + ring_fixed_header_size,
+                       binary_header.size()) != binary_header) {
+      error = "'" + path + "' is not a ring file with matching fields";
+      close();
+      return false;
+    }
+    if (existing.capacity != capacity) {
+      error = "'" + path + "' is a ring file with a capacity of "
+              + std::to_string(existing.capacity) + " records";
+      close();
+      return false;
+    }
+    info_ = existing;
+    return true;
+  }
+
+  /// Append a record of `record_size` bytes, overwriting the oldest record if
+  /// the file is full
+  bool append(const char* record) {
+    const auto slot = (info_.head + info_.count) % info_.capacity;
+
+    // The oldest record is removed from the header before its slot is
+    // overwritten, such that readers of a live file never see the newest
+    // record in its place
+    if (info_.count == info_.capacity) {
+      info_.head = (info_.head + 1) % info_.capacity;
+      info_.count--;
+      if (!write_position()) {
+        return false;
+      }
+    }
+    if (!write_at(record, info_.record_size,
+                  info_.data_begin + slot * info_.record_size)) {
+      return false;
+    }
+    info_.count++;
+    return write_position();
+  }
+
+  /// Close file
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  const RingInfo& info() const { return info_; }
+
+ private:
+  /// Write head and count to the header
+  bool write_position() {
+    char position[16];
+    store_le64(info_.head, position);
+    store_le64(info_.count, position + 8);
+    return write_at(position, sizeof(position), 24);
+  }
+
+  /// Write complete buffer at the given offset
+  bool write_at(const char* data, std::size_t size, std::size_t offset) {
+    while (size > 0) {
+      const auto n = ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<std::size_t>(n);
+      offset += static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+  RingInfo info_;
+};
+
+} // namespace sss
+
+#endif // SSS_RING_HPP
@@ -0,0 +1,374 @@
+#ifndef SSS_ROLLUP_HPP
+#define SSS_ROLLUP_HPP
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sss-derive.hpp"
+#include "sss-format.hpp"
+#include "sss-sketch.hpp"
+#include "sss-time.hpp"
+
+namespace sss {
+
+/// Return value of a sample field as floating point number
+inline Float field_value(const Sample& s, const FieldInfo& f) {
+  const auto p = reinterpret_cast<const char*>(&s) + f.offset;
+  if (f.type == 'f') {
+    Float value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+  Int value;
+  std::memcpy(&value, p, sizeof(value));
+  return static_cast<Float>(value);
+}
+
+/// Return value of an integer sample field
+inline Int int_field_value(const Sample& s, const FieldInfo& f) {
+  Int value;
+  std::memcpy(&value, reinterpret_cast<const char*>(&s) + f.offset,
+              sizeof(value));
+  return value;
+}
+
+/// Return true if the field is a cumulative counter (as opposed to a gauge)
+inline bool is_counter(const FieldInfo& f) {
+  const std::string name = f.name;
+  return name.compare(0, 9, "cpu_time_") == 0
+         || name.compare(0, 8, "network_") == 0
+         || name.compare(0, 3, "io_") == 0;
+}
+
+
+/// Aggregates samples into fixed, wall-clock aligned time windows of one
+/// resolution (tier). For each window, one line is written to the tier file
+/// with the window start (Unix timestamp in milliseconds), the window width
+/// (in milliseconds), the number of samples, min/max/mean/last for each gauge
+/// and the rate per second for each counter. Counter increases are added up
+/// from sample to sample with `counter_delta()`, i.e., resets count as zero
+/// as for '--derived'. The tier file is bounded: once
+/// it contains `max_records` windows, it is renamed to '<file>.old' and a new
+/// file is started.
+///
+/// Optionally, the distribution of selected derived values within each
+/// window is kept as a quantile sketch, written as one line per window and
+/// field to '<file>.sketch' (see `format_sketch()`). The sketch file is
+/// renamed together with the tier file.
+class RollupTier {
+ public:
+  RollupTier(Int width, const std::string& path, Int max_records,
+             const std::vector<std::size_t>& sketch_fields)
+    : width_(width), path_(path), max_records_(max_records),
+      sketch_fields_(sketch_fields), sketches_(sketch_fields.size()) {
+    for (const auto& f : sample_fields()) {
+      const std::string field_name = f.name;
+      if (field_name == "timestamp" || field_name == "time_delta") {
+        continue;
+      }
+      if (is_counter(f)) {
+        counters_.push_back(&f);
+      } else {
+        gauges_.push_back(&f);
+      }
+    }
+    gauge_stats_.resize(gauges_.size());
+    increase_.resize(counters_.size());
+    last_.resize(counters_.size());
+    open();
+  }
+
+  /// Add sample to current window, together with the values derived from it
+  /// and its predecessor (if any). If the sample belongs to a new window, the
+  /// current window is written first.
+  void add(const Sample& s, const Derived* d) {
+    // Samples with a time delta of zero have no valid predecessor
+    if (s.time_delta == 0) {
+      has_baseline_ = false;
+    }
+
+    // Window index of sample (aligned to multiples of the width since the
+    // Unix epoch)
+    const Int window = (s.timestamp >= 0)
+                       ? s.timestamp / width_
+                       : (s.timestamp - width_ + 1) / width_;
+    if (count_ > 0 && window != window_) {
+      write();
+    }
+
+    // Start new window
+    if (count_ == 0) {
+      window_ = window;
+      for (auto& g : gauge_stats_) {
+        g.min = std::numeric_limits<Float>::infinity();
+        g.max = -std::numeric_limits<Float>::infinity();
+        g.sum = 0.0;
+      }
+
+      for (auto& increase : increase_) {
+        increase = 0;
+      }
+
+      // Without previous sample, counter rates are relative to the first
+      // sample in the window
+      if (!has_baseline_) {
+        baseline_steady_ = s.steady;
+      }
+    }
+
+    // Update statistics
+    for (std::size_t i = 0; i < gauges_.size(); i++) {
+      const auto value = field_value(s, *gauges_[i]);
+      auto& g = gauge_stats_[i];
+      g.min = (value < g.min) ? value : g.min;
+      g.max = (value > g.max) ? value : g.max;
+      g.sum += value;
+      g.last = value;
+    }
+    for (std::size_t i = 0; i < counters_.size(); i++) {
+      const auto value = int_field_value(s, *counters_[i]);
+      if (has_baseline_) {
+        increase_[i] += counter_delta(last_[i], value);
+      }
+      last_[i] = value;
+    }
+    has_baseline_ = true;
+    if (d != nullptr) {
+      for (std::size_t k = 0; k < sketches_.size(); k++) {
+        sketches_[k].add(derived_value(*d, sketch_fields_[k]));
+      }
+    }
+    last_steady_ = s.steady;
+    count_++;
+  }
+
+  /// Write current window even if it is incomplete
+  void flush() {
+    if (count_ > 0) {
+      write();
+    }
+  }
+
+ private:
+  struct GaugeStats {
+    Float min = 0.0;
+    Float max = 0.0;
+    Float sum = 0.0;
+    Float last = 0.0;
+  };
+
+  /// Open tier file and count existing records
+  void open() {
+    records_ = 0;
+    {
+      std::ifstream in(path_);
+      for (std::string line; std::getline(in, line); ) {
+        records_ += (!line.empty() && line[0] != '#') ? 1 : 0;
+      }
+    }
+    file_.open(path_, std::ios::out | std::ios::app);
+    if (!file_.good()) {
+      std::cerr << "error: could not open rollup file '" << path_
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (records_ == 0) {
+      write_header();
+    }
+
+    if (sketches_.empty()) {
+      return;
+    }
+    const auto sketch_path = path_ + ".sketch";
+    const bool empty = std::ifstream(sketch_path).peek()
+                       == std::ifstream::traits_type::eof();
+    sketch_file_.open(sketch_path, std::ios::out | std::ios::app);
+    if (!sketch_file_.good()) {
+      std::cerr << "error: could not open sketch file '" << sketch_path
+                << "' for writing" << std::endl;
+      std::exit(1);
+    }
+    if (empty) {
+      sketch_file_ << sketch_header();
+    }
+  }
+
+  /// Write line with field names
+  void write_header() {
+    file_ << "# timestamp duration samples";
+    for (const auto g : gauges_) {
+      file_ << " " << g->name << "_min " << g->name << "_max "
+            << g->name << "_mean " << g->name << "_last";
+    }
+    for (const auto c : counters_) {
+      file_ << " " << c->name << "_rate";
+    }
+    file_ << "\n";
+  }
+
+  /// Write record for current window and reset it
+  void write() {
+    // Start new file if the maximum number of records is reached
+    if (max_records_ > 0 && records_ >= max_records_) {
+      file_.close();
+      file_.clear();
+      std::rename(path_.c_str(), (path_ + ".old").c_str());
+      if (!sketches_.empty()) {
+        sketch_file_.close();
+        sketch_file_.clear();
+        std::rename((path_ + ".sketch").c_str(),
+                    (path_ + ".sketch.old").c_str());
+      }
+      open();
+    }
+
+    char buffer[64];
+    file_ << window_ * width_ << " " << width_ << " " << count_;
+    for (std::size_t i = 0; i < gauges_.size(); i++) {
+      const auto& g = gauge_stats_[i];
+      std::snprintf(buffer, sizeof(buffer), " %.3f",
+                    g.sum / static_cast<Float>(count_));
+      if (gauges_[i]->type == 'f') {
+        file_ << " " << g.min << " " << g.max << buffer << " " << g.last;
+      } else {
+        file_ << " " << static_cast<Int>(g.min)
+              << " " << static_cast<Int>(g.max) << buffer
+              << " " << static_cast<Int>(g.last);
+      }
+    }
+    const auto elapsed = static_cast<Float>(last_steady_ - baseline_steady_)
+                         / 1000;
+    for (std::size_t i = 0; i < counters_.size(); i++) {
+      if (elapsed > 0) {
+        std::snprintf(buffer, sizeof(buffer), " %.3f",
+                      static_cast<Float>(increase_[i]) / elapsed);
+      } else {
+        std::snprintf(buffer, sizeof(buffer), " nan");
+      }
+      file_ << buffer;
+    }
+    file_ << std::endl;
+    records_++;
+
+    // Sketches of fields without any derived value in this window are empty
+    const auto& fields = derived_fields();
+    for (std::size_t k = 0; k < sketches_.size(); k++) {
+      if (sketches_[k].count() > 0) {
+        sketch_file_ << format_sketch(window_ * width_, width_,
+                                      fields[sketch_fields_[k]].name,
+                                      sketches_[k]);
+        sketches_[k].clear();
+      }
+    }
+    if (!sketches_.empty()) {
+      sketch_file_.flush();
+    }
+
+    // The last sample of this window is the baseline for the next one
+    baseline_steady_ = last_steady_;
+    count_ = 0;
+  }
+
+  const Int width_;
+  const std::string path_;
+  const Int max_records_;
+  std::ofstream file_;
+  Int records_ = 0;
+
+  std::vector<const FieldInfo*> gauges_;
+  std::vector<const FieldInfo*> counters_;
+
+  // Current window
+  Int window_ = 0;
+  Int count_ = 0;
+  std::vector<GaugeStats> gauge_stats_;
+  std::vector<Int> increase_;
+  Int last_steady_ = 0;
+
+  // Counter values of the most recent sample, which is the baseline for the
+  // increases of the next one
+  bool has_baseline_ = false;
+  std::vector<Int> last_;
+  Int baseline_steady_ = 0;
+
+  // Quantile sketches of the current window (one per field)
+  const std::vector<std::size_t> sketch_fields_;
+  std::vector<QuantileSketch> sketches_;
+  std::ofstream sketch_file_;
+};
+
+
+/// Set of rollup tiers that are all fed with the same samples
+class Rollup {
+ public:
+  /// Create tiers from colon-separated list of durations (e.g., '1m:1h'),
+  /// with quantile sketches of the given derived fields, return false if a
+  /// duration is invalid
+  bool configure(const std::string& tiers, const std::string& prefix,
+                 Int max_records,
+                 const std::vector<std::size_t>& sketch_fields) {
+    sketching_ = !sketch_fields.empty();
+    std::size_t begin = 0;
+    while (true) {
+      const auto end = tiers.find(':', begin);
+      const auto name = tiers.substr(begin, end - begin);
+      Int width = 0;
+      if (!parse_duration(name, width)) {
+        return false;
+      }
+      tiers_.emplace_back(new RollupTier(width, prefix + "." + name,
+                                         max_records, sketch_fields));
+      if (end == std::string::npos) {
+        break;
+      }
+      begin = end + 1;
+    }
+    return true;
+  }
+
+  /// Add sample to all tiers, deriving values for the sketches only once.
+  /// Rates refer to the previously added sample (as with '--derived'), which
+  /// is not the previously taken one if samples were dropped.
+  void add(const Sample& s) {
+    const bool derived = sketching_ && has_previous_
+                         && s.steady > previous_.steady;
+    if (derived) {
+      derived_ = derive(previous_, s, s.steady - previous_.steady);
+    }
+    for (auto& t : tiers_) {
+      t->add(s, derived ? &derived_ : nullptr);
+    }
+    if (sketching_) {
+      previous_ = s;
+      has_previous_ = true;
+    }
+  }
+
+  /// Write incomplete windows of all tiers
+  void flush() {
+    for (auto& t : tiers_) {
+      t->flush();
+    }
+  }
+
+  bool empty() const { return tiers_.empty(); }
+
+ private:
+  std::vector<std::unique_ptr<RollupTier>> tiers_;
+  bool sketching_ = false;
+  Sample previous_;
+  bool has_previous_ = false;
+  Derived derived_;
+};
+
+} // namespace sss
+
+#endif // SSS_ROLLUP_HPP
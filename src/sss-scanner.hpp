@@ -0,0 +1,159 @@
+#ifndef SSS_SCANNER_HPP
+#define SSS_SCANNER_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+namespace sss {
+
+// Define types for statistic data - use 64 bit values (signed) for maximum
+// range and ease-of-use
+using Int = long long int;
+using Float = double;
+
+
+/// Minimal scanner for whitespace-separated text as found in the proc
+/// filesystem and in text log files. It works directly on a character range
+/// and never allocates memory. If a number is requested but none is found at
+/// the current position, zero is returned and the scanner is marked as failed.
+class Scanner {
+ public:
+  Scanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  /// Return true if the entire range has been consumed
+  bool at_end() const { return p_ >= end_; }
+
+  /// Return false if any number could not be parsed
+  bool good() const { return good_; }
+
+  /// Current position
+  const char* position() const { return p_; }
+
+  /// Skip spaces and tabs (but not newlines)
+  void skip_spaces() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) {
+      p_++;
+    }
+  }
+
+  /// Skip the next word including leading spaces
+  void skip_word() {
+    skip_spaces();
+    while (p_ < end_ && *p_ != ' ' && *p_ != '\t' && *p_ != '\n') {
+      p_++;
+    }
+  }
+
+  /// Advance to the beginning of the next line
+  void skip_line() {
+    const auto eol = static_cast<const char*>(
+        std::memchr(p_, '\n', static_cast<std::size_t>(end_ - p_)));
+    p_ = (eol == nullptr) ? end_ : eol + 1;
+  }
+
+  /// Consume the given word if it is found at the current position
+  bool consume(const char* word, std::size_t length) {
+    if (static_cast<std::size_t>(end_ - p_) < length
+        || std::memcmp(p_, word, length) != 0) {
+      return false;
+    }
+    p_ += length;
+    return true;
+  }
+
+  /// Parse the next (optionally signed) decimal integer. Leading spaces are
+  /// skipped.
+  Int parse_int() {
+    skip_spaces();
+    bool negative = false;
+    if (p_ < end_ && (*p_ == '-' || *p_ == '+')) {
+      negative = (*p_ == '-');
+      p_++;
+    }
+    const char* const digits = p_;
+    unsigned long long value = 0;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+      value = value * 10 + static_cast<unsigned long long>(*p_ - '0');
+      p_++;
+    }
+    good_ = good_ && (p_ != digits);
+    return negative ? -static_cast<Int>(value) : static_cast<Int>(value);
+  }
+
+  /// Parse the next decimal number in fixed-point notation (e.g., '0.28').
+  /// All digits are accumulated as an integer mantissa that is divided by an
+  /// exact power of ten, which yields the same result as std::strtod for the
+  /// short numbers found in the proc filesystem. Numbers with an exponent are
+  /// handed over to std::strtod.
+  Float parse_float() {
+    static constexpr Float powers_of_ten[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    skip_spaces();
+    const char* const start = p_;
+    bool negative = false;
+    if (p_ < end_ && (*p_ == '-' || *p_ == '+')) {
+      negative = (*p_ == '-');
+      p_++;
+    }
+    const char* const digits_begin = p_;
+    unsigned long long mantissa = 0;
+    std::size_t digits = 0;
+    std::size_t decimals = 0;
+    std::size_t excess = 0;
+    bool fraction = false;
+    for (; p_ < end_; p_++) {
+      if (*p_ >= '0' && *p_ <= '9') {
+        // Digits beyond the precision of the mantissa are dropped
+        if (digits < 18) {
+          mantissa = mantissa * 10 + static_cast<unsigned long long>(*p_ - '0');
+          digits += (mantissa > 0) ? 1 : 0;
+          decimals += fraction ? 1 : 0;
+        } else if (!fraction) {
+          excess++;
+        }
+      } else if (*p_ == '.' && !fraction) {
+        fraction = true;
+      } else {
+        break;
+      }
+    }
+    if (p_ == digits_begin) {
+      good_ = false;
+      return 0.0;
+    }
+
+    // Let the standard library deal with exponents (on a terminated copy,
+    // since the range does not need to be null-terminated)
+    if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+      char token[64];
+      std::size_t length = 0;
+      for (const char* q = start; q < end_ && length < sizeof(token) - 1
+           && *q != ' ' && *q != '\t' && *q != '\n'; q++) {
+        token[length++] = *q;
+      }
+      token[length] = '\0';
+      char* stop = nullptr;
+      const Float value = std::strtod(token, &stop);
+      p_ = start + (stop - token);
+      return value;
+    }
+
+    decimals = (decimals < 18) ? decimals : 18;
+    Float value = static_cast<Float>(mantissa) / powers_of_ten[decimals];
+    for (; excess > 0; excess--) {
+      value *= 10;
+    }
+    return negative ? -value : value;
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool good_ = true;
+};
+
+} // namespace sss
+
+#endif // SSS_SCANNER_HPP
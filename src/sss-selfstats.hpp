@@ -0,0 +1,193 @@
+#ifndef SSS_SELFSTATS_HPP
+#define SSS_SELFSTATS_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+#include "sss-collect.hpp"
+#include "sss-histogram.hpp"
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Overhead of sss-mon itself: latency histograms of the individual steps of
+/// sampling and writing, plus CPU time of the process
+/// (CLOCK_PROCESS_CPUTIME_ID, which is more precise than the clock ticks in
+/// '/proc/self/stat') and its resident memory from '/proc/self/stat'.
+/// Histograms may be recorded from different threads, but each histogram
+/// from one thread only.
+class SelfStats {
+ public:
+  /// Create histograms for the given collectors (see `Sampler::names()`)
+  explicit SelfStats(const std::vector<std::string>& collectors)
+    : collectors_(new LatencyHistogram[collectors.size()]) {
+    histograms_.emplace_back("wakeup", &wakeup);
+    histograms_.emplace_back("sample", &sample);
+    for (std::size_t i = 0; i < collectors.size(); i++) {
+      histograms_.emplace_back("collect_" + collectors[i], &collectors_[i]);
+    }
+    histograms_.emplace_back("write", &write);
+    histograms_.emplace_back("flush", &flush);
+    previous_.resize(histograms_.size());
+  }
+
+  /// Open '/proc/self/stat' and start measuring, return false on error
+  bool open(std::string& error) {
+    if (!stat_.open("/proc/self/stat", 1024)) {
+      error = "could not open '/proc/self/stat' for reading";
+      return false;
+    }
+    start_ = std::chrono::steady_clock::now();
+    previous_time_ = start_;
+    Int rss_bytes = 0;
+    read_usage(previous_cpu_time_, rss_bytes);
+    start_cpu_time_ = previous_cpu_time_;
+    return true;
+  }
+
+  /// Lateness of the sampling timer
+  LatencyHistogram wakeup;
+
+  /// Time for gathering a sample (all collectors)
+  LatencyHistogram sample;
+
+  /// Time for writing a single sample, including log file rotation
+  LatencyHistogram write;
+
+  /// Time for flushing (and syncing) the log file
+  LatencyHistogram flush;
+
+  /// Histograms for the collectors, in the order given to the constructor
+  LatencyHistogram* collectors() { return collectors_.get(); }
+
+  /// Column names of the lines written by `write_line()`
+  std::string header() const {
+    std::string columns = "# timestamp interval_ms samples cpu_time_us "
+                          "cpu_util rss_bytes";
+    for (const auto& h : histograms_) {
+      columns += " " + h.first + "_mean_us " + h.first + "_p99_us "
+                 + h.first + "_max_us";
+    }
+    return columns + "\n";
+  }
+
+  /// Append line with the statistics since the previous line (or since
+  /// `open()`), return false on error. Latencies are given in microseconds,
+  /// quantiles and maxima as the upper bounds of the histogram buckets.
+  bool write_line(std::FILE* file, Int timestamp) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto interval_ms = std::chrono::duration_cast<
+        std::chrono::milliseconds>(now - previous_time_).count();
+    Int cpu_time_us = 0;
+    Int rss_bytes = 0;
+    read_usage(cpu_time_us, rss_bytes);
+    const auto samples =
+        sample.snapshot().count() - previous_[1].count();
+
+    std::fprintf(file, "%lld %lld %llu %lld %.6f %lld", timestamp,
+                 static_cast<long long>(interval_ms),
+                 static_cast<unsigned long long>(samples),
+                 cpu_time_us - previous_cpu_time_,
+                 (interval_ms > 0)
+                 ? static_cast<double>(cpu_time_us - previous_cpu_time_)
+                   / (1000.0 * interval_ms)
+                 : 0.0,
+                 rss_bytes);
+    for (std::size_t i = 0; i < histograms_.size(); i++) {
+      const auto current = histograms_[i].second->snapshot();
+      const auto d = current - previous_[i];
+      std::fprintf(file, " %.3f %llu %llu", d.mean_us(),
+                   static_cast<unsigned long long>(d.quantile_us(0.99)),
+                   static_cast<unsigned long long>(d.quantile_us(1.0)));
+      previous_[i] = current;
+    }
+    std::fputc('\n', file);
+
+    previous_time_ = now;
+    previous_cpu_time_ = cpu_time_us;
+    return std::fflush(file) == 0;
+  }
+
+  /// Print summary of the whole run
+  void print_summary(std::ostream& os) {
+    const auto elapsed_ms = std::chrono::duration_cast<
+        std::chrono::milliseconds>(std::chrono::steady_clock::now()
+                                   - start_).count();
+    Int cpu_time_us = 0;
+    Int rss_bytes = 0;
+    read_usage(cpu_time_us, rss_bytes);
+    cpu_time_us -= start_cpu_time_;
+
+    const auto flags = os.flags();
+    os << std::fixed << std::setprecision(3)
+       << "sss-mon overhead: " << sample.snapshot().count() << " samples in "
+       << elapsed_ms / 1000.0 << " s, CPU time " << cpu_time_us / 1e6
+       << " s (" << std::setprecision(4)
+       << ((elapsed_ms > 0) ? 0.1 * cpu_time_us / elapsed_ms : 0.0)
+       << "% of a core), RSS " << rss_bytes / 1024 << " KiB\n"
+       << std::setprecision(1)
+       << "  latency (us)              count      mean    p50    p99    max\n";
+    for (const auto& h : histograms_) {
+      const auto s = h.second->snapshot();
+      os << "  " << std::left << std::setw(22) << h.first << std::right
+         << std::setw(10) << s.count() << std::setw(10) << s.mean_us()
+         << std::setw(7) << s.quantile_us(0.5)
+         << std::setw(7) << s.quantile_us(0.99)
+         << std::setw(7) << s.quantile_us(1.0) << "\n";
+    }
+    os.flags(flags);
+    os.flush();
+  }
+
+ private:
+  /// Read CPU time (user and system, in us) and resident set size of the
+  /// process
+  void read_usage(Int& cpu_time_us, Int& rss_bytes) {
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+      cpu_time_us = static_cast<Int>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+    if (!stat_.read()) {
+      return;
+    }
+
+    // The command name (2nd field) may contain spaces, thus start after its
+    // closing parenthesis with the 3rd field and skip to the 24th (rss)
+    const char* p = stat_.end();
+    while (p > stat_.begin() && *(p - 1) != ')') {
+      p--;
+    }
+    Scanner l(p, stat_.end());
+    l.skip_spaces();
+    l.skip_word();
+    for (int field = 4; field < 24; field++) {
+      l.parse_int();
+    }
+    const Int pages = l.parse_int();
+    if (l.good()) {
+      rss_bytes = pages * sysconf(_SC_PAGESIZE);
+    }
+  }
+
+  std::unique_ptr<LatencyHistogram[]> collectors_;
+  std::vector<std::pair<std::string, LatencyHistogram*>> histograms_;
+  std::vector<LatencySnapshot> previous_;
+  ProcFile stat_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point previous_time_;
+  Int start_cpu_time_ = 0;
+  Int previous_cpu_time_ = 0;
+};
+
+} // namespace sss
+
+#endif // SSS_SELFSTATS_HPP
@@ -0,0 +1,337 @@
+#ifndef SSS_SHM_HPP
+#define SSS_SHM_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Shared-memory rings hold the most recent samples of sss-mon in a POSIX
+/// shared memory object (see shm_open(3)), such that local processes can
+/// read the current values without syscalls and without parsing log files.
+///
+///   offset  size  content
+///        0     8  magic bytes "SSS-SHM1" (written last by the writer)
+///        8     4  number of fields per sample
+///       12     4  capacity (number of slots)
+///       16     8  count (number of samples published so far)
+///       24     4  writer state (1 while sss-mon is running, 0 after exit)
+///       28     4  process ID of the writer
+///       32     -  field names, 32 bytes each (null-terminated)
+///
+/// The slots follow after the field names, aligned to 64 bytes. Each slot
+/// has a sequence number followed by one 8 byte value per field (integers
+/// or IEEE 754 doubles in host byte order), padded to a multiple of 64
+/// bytes. Sample i (counting from zero) is stored in slot `i % capacity`.
+/// All words are accessed atomically. Each slot is a seqlock whose sequence
+/// number also identifies the sample: it is 2 * i + 1 while sample i is
+/// written and 2 * i + 2 once it is complete. Readers check that the number
+/// is the same before and after copying the values.
+constexpr char shm_magic[8] = {'S', 'S', 'S', '-', 'S', 'H', 'M', '1'};
+constexpr std::size_t shm_fixed_header_size = 32;
+constexpr std::size_t shm_field_name_size = 32;
+constexpr std::size_t shm_alignment = 64;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory rings need lock-free atomics");
+
+/// Fixed part of the shared memory header
+struct ShmHeader {
+  std::atomic<std::uint64_t> magic;
+  std::uint32_t num_fields;
+  std::uint32_t capacity;
+  std::atomic<std::uint64_t> count;
+  std::atomic<std::uint32_t> alive;
+  std::int32_t pid;
+};
+static_assert(sizeof(ShmHeader) == shm_fixed_header_size,
+              "unexpected size of shared memory header");
+
+/// Offsets within a shared memory ring of a given shape
+struct ShmGeometry {
+  ShmGeometry(std::size_t num_fields, std::size_t capacity)
+    : names_begin(shm_fixed_header_size),
+      slots_begin(round_up(names_begin + num_fields * shm_field_name_size)),
+      slot_size(round_up(8 * (1 + num_fields))),
+      size(slots_begin + capacity * slot_size) {}
+
+  static std::size_t round_up(std::size_t n) {
+    return (n + shm_alignment - 1) / shm_alignment * shm_alignment;
+  }
+
+  std::size_t names_begin;
+  std::size_t slots_begin;
+  std::size_t slot_size;
+  std::size_t size;
+};
+
+inline std::uint64_t shm_magic_word() {
+  std::uint64_t word;
+  std::memcpy(&word, shm_magic, sizeof(word));
+  return word;
+}
+
+
+/// Publishes samples to a shared memory ring (single writer)
+class ShmWriter {
+ public:
+  ShmWriter() = default;
+
+  ~ShmWriter() { close(); }
+
+  ShmWriter(const ShmWriter&) = delete;
+  ShmWriter& operator=(const ShmWriter&) = delete;
+
+  /// Create shared memory object `name` (e.g., '/sss-mon') with room for the
+  /// given number of samples, return false on error. An existing object of
+  /// the same name is replaced, readers that still map it see it as no
+  /// longer alive.
+  bool open(const std::string& name, std::size_t capacity,
+            std::string& error) {
+    const auto& fields = sample_fields();
+    const ShmGeometry geometry(fields.size(), capacity);
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+      error = "could not create shared memory object '" + name + "': "
+              + std::strerror(errno);
+      return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(geometry.size)) != 0) {
+      error = "could not resize shared memory object '" + name + "': "
+              + std::strerror(errno);
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    void* const data = mmap(nullptr, geometry.size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      error = "could not map shared memory object '" + name + "': "
+              + std::strerror(errno);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+    size_ = geometry.size;
+    slots_ = data_ + geometry.slots_begin;
+    slot_size_ = geometry.slot_size;
+    capacity_ = capacity;
+
+    // The new object is zero-filled, i.e., no slot holds a sample yet
+    header_ = new (data_) ShmHeader;
+    header_->num_fields = static_cast<std::uint32_t>(fields.size());
+    header_->capacity = static_cast<std::uint32_t>(capacity);
+    header_->count.store(0, std::memory_order_relaxed);
+    header_->alive.store(1, std::memory_order_relaxed);
+    header_->pid = static_cast<std::int32_t>(getpid());
+    for (std::size_t i = 0; i < fields.size(); i++) {
+      std::strncpy(data_ + geometry.names_begin + i * shm_field_name_size,
+                   fields[i].name, shm_field_name_size - 1);
+      offsets_.push_back(fields[i].offset);
+    }
+    header_->magic.store(shm_magic_word(), std::memory_order_release);
+    return true;
+  }
+
+  /// Mark ring as no longer alive and unmap it (the object is kept, such
+  /// that readers can still see the last samples)
+  void close() {
+    if (data_ == nullptr) {
+      return;
+    }
+    header_->alive.store(0, std::memory_order_release);
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+
+  /// Publish sample, overwriting the oldest one if the ring is full
+  void publish(const Sample& s) {
+    const auto count = header_->count.load(std::memory_order_relaxed);
+    auto* const slot = reinterpret_cast<std::atomic<std::uint64_t>*>(
+        slots_ + (count % capacity_) * slot_size_);
+    slot[0].store(2 * count + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const auto base = reinterpret_cast<const char*>(&s);
+    for (std::size_t i = 0; i < offsets_.size(); i++) {
+      std::uint64_t raw;
+      std::memcpy(&raw, base + offsets_[i], 8);
+      slot[1 + i].store(raw, std::memory_order_relaxed);
+    }
+    slot[0].store(2 * count + 2, std::memory_order_release);
+    header_->count.store(count + 1, std::memory_order_release);
+  }
+
+ private:
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+  ShmHeader* header_ = nullptr;
+  char* slots_ = nullptr;
+  std::size_t slot_size_ = 0;
+  std::size_t capacity_ = 0;
+  std::vector<std::size_t> offsets_;
+};
+
+
+/// Reads samples from a shared memory ring written by 'sss-mon --shm'. After
+/// `open()`, no syscalls are made. Fields are matched by name, i.e., the ring
+/// may have been written by a different version of sss-mon; fields that it
+/// does not provide are zero.
+class ShmReader {
+ public:
+  ShmReader() = default;
+
+  ~ShmReader() { close(); }
+
+  ShmReader(const ShmReader&) = delete;
+  ShmReader& operator=(const ShmReader&) = delete;
+
+  /// Map shared memory object `name` read-only, return false on error
+  bool open(const std::string& name, std::string& error) {
+    close();
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      error = "could not open shared memory object '" + name + "': "
+              + std::strerror(errno);
+      return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0
+        || static_cast<std::size_t>(sb.st_size) < shm_fixed_header_size) {
+      error = "shared memory object '" + name + "' is not initialized";
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<std::size_t>(sb.st_size);
+    void* const data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      error = "could not map shared memory object '" + name + "': "
+              + std::strerror(errno);
+      return false;
+    }
+    data_ = static_cast<const char*>(data);
+    header_ = reinterpret_cast<const ShmHeader*>(data_);
+
+    // Check magic bytes and size before trusting the header
+    const ShmGeometry geometry(header_->num_fields, header_->capacity);
+    if (header_->magic.load(std::memory_order_acquire) != shm_magic_word()
+        || header_->capacity == 0 || geometry.size > size_) {
+      error = "shared memory object '" + name + "' is not an sss-mon ring";
+      close();
+      return false;
+    }
+    slots_ = data_ + geometry.slots_begin;
+    slot_size_ = geometry.slot_size;
+    capacity_ = header_->capacity;
+
+    // Map fields of the ring to members of Sample
+    offsets_.assign(header_->num_fields, -1);
+    for (std::size_t i = 0; i < offsets_.size(); i++) {
+      const char* const field_name =
+          data_ + geometry.names_begin + i * shm_field_name_size;
+      for (const auto& f : sample_fields()) {
+        if (std::strncmp(f.name, field_name, shm_field_name_size) == 0) {
+          offsets_[i] = static_cast<long>(f.offset);
+        }
+      }
+    }
+    return true;
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    header_ = nullptr;
+  }
+
+  /// Number of samples published so far
+  std::uint64_t count() const {
+    return header_->count.load(std::memory_order_acquire);
+  }
+
+  /// Number of samples that the ring can hold
+  std::size_t capacity() const { return capacity_; }
+
+  /// Return true while the writer is running. If it is not, a new instance
+  /// of sss-mon may have replaced the ring and the reader should re-open it.
+  bool alive() const {
+    return header_->alive.load(std::memory_order_acquire) != 0;
+  }
+
+  /// Process ID of the writer
+  int pid() const { return header_->pid; }
+
+  /// Read most recent sample, return false if there is none yet or if it
+  /// cannot be read (e.g., since the writer was killed while publishing into
+  /// a ring with only one slot)
+  bool latest(Sample& s) const {
+    auto n = count();
+    for (std::size_t attempt = 0; attempt <= capacity_; attempt++) {
+      if (n == 0) {
+        return false;
+      }
+
+      // With at least two slots, this fails only if the writer has wrapped
+      // around in the meantime, i.e., if the count has changed
+      if (read(n - 1, s)) {
+        return true;
+      }
+      const auto previous = n;
+      n = count();
+      if (n == previous) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  /// Read the i-th sample (counting from zero), return false if it has not
+  /// been published yet or has already been overwritten
+  bool read(std::uint64_t i, Sample& s) const {
+    const auto* const slot =
+        reinterpret_cast<const std::atomic<std::uint64_t>*>(
+            slots_ + (i % capacity_) * slot_size_);
+    const auto expected = 2 * i + 2;
+    if (slot[0].load(std::memory_order_acquire) != expected) {
+      return false;
+    }
+    s = Sample{};
+    const auto base = reinterpret_cast<char*>(&s);
+    for (std::size_t k = 0; k < offsets_.size(); k++) {
+      const auto raw = slot[1 + k].load(std::memory_order_relaxed);
+      if (offsets_[k] >= 0) {
+        std::memcpy(base + offsets_[k], &raw, 8);
+      }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot[0].load(std::memory_order_relaxed) == expected;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+  const ShmHeader* header_ = nullptr;
+  const char* slots_ = nullptr;
+  std::size_t slot_size_ = 0;
+  std::size_t capacity_ = 0;
+  std::vector<long> offsets_;
+};
+
+} // namespace sss
+
+#endif // SSS_SHM_HPP
@@ -0,0 +1,273 @@
+#ifndef SSS_SKETCH_HPP
+#define SSS_SKETCH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sss-format.hpp"
+
+namespace sss {
+
+/// Mergeable quantile sketch with relative accuracy (DDSketch, see Masson et
+/// al., "DDSketch: A Fast and Fully-Mergeable Quantile Sketch with
+/// Relative-Error Guarantees", VLDB 2019). Positive values are counted in
+/// logarithmic bins, such that every quantile is returned with a relative
+/// error of at most `relative_accuracy`. Values up to `min_value` (including
+/// zero and negative values) share a separate bin. Memory is bounded by
+/// `max_bins` bins; if the values span more, the lowest bins are merged,
+/// which only affects the accuracy of the lowest quantiles. Two sketches are
+/// merged by adding up their bins, which yields the same sketch as adding all
+/// values to one.
+class QuantileSketch {
+ public:
+  static constexpr double relative_accuracy = 0.01;
+  static constexpr double min_value = 1e-9;
+  static constexpr std::size_t max_bins = 2048;
+
+  /// Add value
+  void add(Float value) {
+    extend(value, value, 1);
+    if (value > min_value) {
+      insert(index(value), 1);
+    } else {
+      zeros_++;
+    }
+  }
+
+  /// Add all values of another sketch
+  void merge(const QuantileSketch& other) {
+    if (other.count_ == 0) {
+      return;
+    }
+    extend(other.min_, other.max_, other.count_);
+    zeros_ += other.zeros_;
+    for (std::size_t i = 0; i < other.bins_.size(); i++) {
+      if (other.bins_[i] > 0) {
+        insert(other.offset_ + static_cast<int>(i), other.bins_[i]);
+      }
+    }
+  }
+
+  /// Remove all values, but keep the memory for the bins
+  void clear() {
+    count_ = 0;
+    zeros_ = 0;
+    bins_.clear();
+    offset_ = 0;
+  }
+
+  std::uint64_t count() const { return count_; }
+  Float min() const { return min_; }
+  Float max() const { return max_; }
+
+  /// Value at quantile q (between 0 and 1), or NaN if the sketch is empty.
+  /// The minimum and maximum are exact.
+  Float quantile(double q) const {
+    if (count_ == 0) {
+      return std::numeric_limits<Float>::quiet_NaN();
+    }
+    if (q <= 0.0) {
+      return min_;
+    }
+    if (q >= 1.0) {
+      return max_;
+    }
+    const auto rank = static_cast<std::uint64_t>(
+        q * static_cast<double>(count_ - 1));
+    std::uint64_t seen = zeros_;
+    if (rank < seen) {
+      return min_;
+    }
+    for (std::size_t i = 0; i < bins_.size(); i++) {
+      seen += bins_[i];
+      if (rank < seen) {
+        return std::min(max_, std::max(min_, value(offset_
+                                                   + static_cast<int>(i))));
+      }
+    }
+    return max_;
+  }
+
+  /// Encode as a single word 'MIN:MAX:ZEROS:OFFSET:COUNT,COUNT,...' with the
+  /// counts of consecutive bins
+  std::string encode() const {
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%.17g:%.17g:%llu:%d:", min_,
+                  max_, static_cast<unsigned long long>(zeros_), offset_);
+    std::string word = buffer;
+    for (std::size_t i = 0; i < bins_.size(); i++) {
+      std::snprintf(buffer, sizeof(buffer), (i == 0) ? "%llu" : ",%llu",
+                    static_cast<unsigned long long>(bins_[i]));
+      word += buffer;
+    }
+    return word;
+  }
+
+  /// Decode word written by `encode()`, return false if it is malformed
+  bool decode(const std::string& word) {
+    clear();
+    const char* p = word.c_str();
+    char* end = nullptr;
+    const Float min = std::strtod(p, &end);
+    if (*end != ':') {
+      return false;
+    }
+    const Float max = std::strtod(end + 1, &end);
+    if (*end != ':') {
+      return false;
+    }
+    const auto zeros = std::strtoull(end + 1, &end, 10);
+    if (*end != ':') {
+      return false;
+    }
+    const auto offset = std::strtol(end + 1, &end, 10);
+    if (*end != ':') {
+      return false;
+    }
+    std::uint64_t count = zeros;
+    offset_ = static_cast<int>(offset);
+    for (p = end + 1; *p != '\0'; p = end + 1) {
+      bins_.push_back(std::strtoull(p, &end, 10));
+      count += bins_.back();
+      if (end == p || (*end != ',' && *end != '\0')
+          || bins_.size() > max_bins) {
+        return false;
+      }
+      if (*end == '\0') {
+        break;
+      }
+    }
+    if (count == 0) {
+      clear();
+      return true;
+    }
+    zeros_ = zeros;
+    count_ = count;
+    min_ = min;
+    max_ = max;
+    return true;
+  }
+
+ private:
+  /// Update count and exact extremes
+  void extend(Float min, Float max, std::uint64_t count) {
+    min_ = (count_ == 0 || min < min_) ? min : min_;
+    max_ = (count_ == 0 || max > max_) ? max : max_;
+    count_ += count;
+  }
+
+  static double gamma() {
+    return (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  }
+
+  /// Bin of a positive value, where bin i holds (gamma^(i-1), gamma^i]
+  static int index(Float value) {
+    static const double log_gamma = std::log(gamma());
+    return static_cast<int>(std::ceil(std::log(value) / log_gamma));
+  }
+
+  /// Representative value of a bin with a relative error of at most the
+  /// relative accuracy for all values in the bin
+  static Float value(int index) {
+    return 2.0 * std::pow(gamma(), index) / (gamma() + 1.0);
+  }
+
+  /// Add count to bin, growing the range of bins or merging the lowest bins
+  void insert(int index, std::uint64_t count) {
+    if (bins_.empty()) {
+      offset_ = index;
+      bins_.assign(1, 0);
+    }
+    const int last = offset_ + static_cast<int>(bins_.size()) - 1;
+    const int limit = static_cast<int>(max_bins);
+    if (index > last) {
+      // Merge lowest bins if the range becomes too large
+      const int first = std::max(offset_, index - limit + 1);
+      if (first > offset_) {
+        std::uint64_t lowest = 0;
+        const auto merged = static_cast<std::size_t>(
+            std::min(first - offset_, static_cast<int>(bins_.size())));
+        for (std::size_t i = 0; i < merged; i++) {
+          lowest += bins_[i];
+        }
+        bins_.erase(bins_.begin(), bins_.begin() + merged);
+        offset_ = first;
+        if (bins_.empty()) {
+          bins_.assign(1, 0);
+        }
+        bins_[0] += lowest;
+      }
+      bins_.resize(static_cast<std::size_t>(index - offset_ + 1), 0);
+    } else if (index < offset_) {
+      // Values below the range of bins go to the lowest bin if the range
+      // cannot be extended
+      const int first = std::max(index, last - limit + 1);
+      bins_.insert(bins_.begin(), static_cast<std::size_t>(offset_ - first),
+                   0);
+      offset_ = first;
+      index = std::max(index, first);
+    }
+    bins_[static_cast<std::size_t>(index - offset_)] += count;
+  }
+
+  std::uint64_t count_ = 0;
+  std::uint64_t zeros_ = 0;
+  Float min_ = 0.0;
+  Float max_ = 0.0;
+  int offset_ = 0;
+  std::vector<std::uint64_t> bins_;
+};
+
+
+
+/// Header line of sketch files (with newline)
+inline const char* sketch_header() {
+  return "# timestamp duration field count min max p50 p90 p99 sketch\n";
+}
+
+
+/// Write sketch of a field in a time window as a single line of
+/// space-separated text (with newline): window start (Unix timestamp in
+/// milliseconds), window width (in milliseconds), field name, number of
+/// values, exact minimum and maximum, estimated p50/p90/p99, and the encoded
+/// sketch, from which the line can be read back (see `parse_sketch()`)
+inline std::string format_sketch(Int timestamp, Int duration,
+                                 const std::string& field,
+                                 const QuantileSketch& sketch) {
+  char buffer[192];
+  std::snprintf(buffer, sizeof(buffer), "%lld %lld %s %llu %g %g %g %g %g ",
+                static_cast<long long>(timestamp),
+                static_cast<long long>(duration), field.c_str(),
+                static_cast<unsigned long long>(sketch.count()),
+                sketch.min(), sketch.max(), sketch.quantile(0.5),
+                sketch.quantile(0.9), sketch.quantile(0.99));
+  return buffer + sketch.encode() + "\n";
+}
+
+
+/// Read line written by `format_sketch()` (without newline), return false if
+/// it is malformed. Only the window, field name, and encoded sketch are used.
+inline bool parse_sketch(const std::string& line, Int& timestamp,
+                         Int& duration, std::string& field,
+                         QuantileSketch& sketch) {
+  std::istringstream in(line);
+  std::string skip;
+  std::string word;
+  in >> timestamp >> duration >> field;
+  for (int i = 0; i < 6; i++) {
+    in >> skip;
+  }
+  in >> word;
+  return !in.fail() && sketch.decode(word);
+}
+
+} // namespace sss
+
+#endif // SSS_SKETCH_HPP
@@ -0,0 +1,70 @@
+#ifndef SSS_SPSC_HPP
+#define SSS_SPSC_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace sss {
+
+/// Bounded lock-free queue for exactly one producer and one consumer thread.
+/// Neither side ever blocks: `push` fails if the queue is full and `pop` fails
+/// if it is empty.
+template <typename T>
+class SpscQueue {
+ public:
+  /// The capacity is rounded up to the next power of two
+  explicit SpscQueue(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /// Append element (producer only), return false if the queue is full
+  bool push(const T& value) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Remove oldest element (consumer only), return false if the queue is empty
+  bool pop(T& value) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Return true if the queue is empty (exact only for the consumer)
+  bool empty() const {
+    return head_.load(std::memory_order_acquire)
+           == tail_.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const { return slots_.size(); }
+
+ private:
+  std::vector<T> slots_;
+  std::size_t mask_ = 0;
+
+  // Producer and consumer positions on separate cache lines
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+} // namespace sss
+
+#endif // SSS_SPSC_HPP
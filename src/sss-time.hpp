@@ -0,0 +1,303 @@
+#ifndef SSS_TIME_HPP
+#define SSS_TIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <string>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sss-scanner.hpp"
+
+namespace sss {
+
+/// Units for durations (in milliseconds)
+struct DurationUnit {
+  const char* name;
+  Int milliseconds;
+};
+
+constexpr DurationUnit duration_units[] = {
+  {"ms", 1},
+  {"s", 1000},
+  {"m", 60 * 1000},
+  {"h", 3600 * 1000},
+  {"d", 24 * 3600 * 1000},
+};
+
+
+/// Parse duration given as a positive integer followed by a unit ('ms', 's',
+/// 'm', 'h', or 'd'), e.g., '10s'. If `default_unit` is not null, a plain
+/// integer is interpreted in this unit. Return false if the duration is
+/// invalid or does not fit into an Int in milliseconds.
+inline bool parse_duration(const std::string& text, Int& milliseconds,
+                           const char* default_unit = nullptr) {
+  const auto unit_begin = text.find_first_not_of("0123456789");
+  const auto digits = (unit_begin == std::string::npos) ? text.size()
+                                                        : unit_begin;
+  if (digits == 0 || digits > 18) {
+    return false;
+  }
+  const auto unit = (unit_begin == std::string::npos)
+                    ? std::string(default_unit ? default_unit : "")
+                    : text.substr(unit_begin);
+  const Int value = std::stoll(text.substr(0, unit_begin));
+  for (const auto& u : duration_units) {
+    if (unit == u.name) {
+      if (value > std::numeric_limits<Int>::max() / u.milliseconds) {
+        return false;
+      }
+      milliseconds = value * u.milliseconds;
+      return milliseconds > 0;
+    }
+  }
+  return false;
+}
+
+
+/// Parse point in time given either as Unix timestamp in milliseconds or as
+/// '-' followed by a duration before `now` (e.g., '-1h'). Return false if the
+/// time is invalid.
+inline bool parse_time_point(const std::string& text, Int now,
+                             Int& timestamp) {
+  if (!text.empty() && text[0] == '-') {
+    Int ago = 0;
+    if (!parse_duration(text.substr(1), ago)) {
+      return false;
+    }
+    timestamp = now - ago;
+    return true;
+  }
+  if (text.empty() || text.size() > 18
+      || text.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  timestamp = std::stoll(text);
+  return true;
+}
+
+
+/// Periodic timer on CLOCK_MONOTONIC (via timerfd) whose ticks are aligned to
+/// multiples of the period since the Unix epoch, e.g., to every full second.
+/// If the wall clock drifts or is set relative to the monotonic clock, the
+/// timer is re-aligned.
+class PeriodicTimer {
+ public:
+  PeriodicTimer() = default;
+
+  ~PeriodicTimer() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  PeriodicTimer(const PeriodicTimer&) = delete;
+  PeriodicTimer& operator=(const PeriodicTimer&) = delete;
+
+  /// Start timer with the given period, return false on error (including
+  /// periods that do not fit into an Int in nanoseconds)
+  bool start(Int period_ms) {
+    if (period_ms > std::numeric_limits<Int>::max() / 1000000) {
+      return false;
+    }
+    if (fd_ < 0) {
+      fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    }
+    period_ = period_ms * 1000000;
+    return fd_ >= 0 && period_ > 0 && arm();
+  }
+
+  /// Block until the next tick. Return false if interrupted (e.g., by a
+  /// signal). Ticks that were missed since the previous call are counted as
+  /// overruns.
+  bool wait() {
+    std::uint64_t expirations = 0;
+    if (::read(fd_, &expirations, sizeof(expirations))
+        != static_cast<ssize_t>(sizeof(expirations))) {
+      return false;
+    }
+    if (expirations > 1) {
+      overruns_ += static_cast<Int>(expirations - 1);
+    }
+
+    // Ticks are at multiples of the period in wall clock time
+    lateness_ = (nanoseconds(CLOCK_MONOTONIC) + offset_) % period_;
+
+    // Re-align if the offset between wall clock and monotonic clock changed
+    // by more than a millisecond
+    const Int drift = clock_offset() - offset_;
+    if (drift > max_drift || drift < -max_drift) {
+      arm();
+    }
+    return true;
+  }
+
+  /// Total number of missed ticks
+  Int overruns() const { return overruns_; }
+
+  /// Time between the most recent tick and the return of `wait()` (in ns)
+  Int lateness() const { return lateness_; }
+
+ private:
+  static constexpr Int max_drift = 1000000;
+
+  static Int nanoseconds(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<Int>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  /// Offset between wall clock and monotonic clock
+  static Int clock_offset() {
+    return nanoseconds(CLOCK_REALTIME) - nanoseconds(CLOCK_MONOTONIC);
+  }
+
+  /// Arm timer such that it expires at the next multiple of the period
+  bool arm() {
+    offset_ = clock_offset();
+    const Int now = nanoseconds(CLOCK_MONOTONIC);
+    const Int next = (((now + offset_) / period_) + 1) * period_ - offset_;
+    itimerspec spec;
+    spec.it_value.tv_sec = static_cast<time_t>(next / 1000000000);
+    spec.it_value.tv_nsec = static_cast<long>(next % 1000000000);
+    spec.it_interval.tv_sec = static_cast<time_t>(period_ / 1000000000);
+    spec.it_interval.tv_nsec = static_cast<long>(period_ % 1000000000);
+    return timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == 0;
+  }
+
+  int fd_ = -1;
+  Int period_ = 0;
+  Int offset_ = 0;
+  Int overruns_ = 0;
+  Int lateness_ = 0;
+};
+
+
+/// Time span in which a file name with std::strftime conversions (e.g.,
+/// 'server-%Y%m%d.log') cannot change, such that it only needs to be
+/// formatted again for timestamps outside of it. The span is the local
+/// calendar second, minute, hour, day, month, or year around a timestamp,
+/// depending on the finest conversion in the name. Conversions of unknown
+/// granularity count as seconds, and week-based ones as days. Spans are
+/// conservative: the name may still be the same after a span ends.
+class RotationSchedule {
+ public:
+  explicit RotationSchedule(const std::string& format)
+    : unit_(finest_unit(format)) {}
+
+  /// Return true if the name may differ from the one at the last `update()`
+  bool due(Int timestamp) const {
+    return timestamp < begin_ || timestamp >= end_;
+  }
+
+  /// Set span to the one around the given timestamp (in milliseconds)
+  void update(Int timestamp) {
+    if (unit_ == Unit::never) {
+      begin_ = std::numeric_limits<Int>::min();
+      end_ = std::numeric_limits<Int>::max();
+      return;
+    }
+    const Int seconds = (timestamp >= 0) ? timestamp / 1000
+                                         : (timestamp - 999) / 1000;
+    begin_ = seconds * 1000;
+    end_ = begin_ + 1000;
+    if (unit_ == Unit::second) {
+      return;
+    }
+    if (unit_ == Unit::minute) {
+      const Int minutes = (seconds >= 0) ? seconds / 60 : (seconds - 59) / 60;
+      begin_ = minutes * 60000;
+      end_ = begin_ + 60000;
+      return;
+    }
+
+    // Calendar spans in local time, which mktime() adjusts for daylight
+    // saving time. Hours may repeat when the clock is set back, so the start
+    // of an hour keeps the daylight saving flag of the timestamp and hourly
+    // spans never exceed an hour.
+    const auto when = static_cast<std::time_t>(seconds);
+    std::tm begin;
+    localtime_r(&when, &begin);
+    begin.tm_sec = 0;
+    begin.tm_min = 0;
+    if (unit_ >= Unit::day) {
+      begin.tm_hour = 0;
+      begin.tm_isdst = -1;
+    }
+    if (unit_ >= Unit::month) {
+      begin.tm_mday = 1;
+    }
+    if (unit_ >= Unit::year) {
+      begin.tm_mon = 0;
+    }
+    std::tm end = begin;
+    end.tm_isdst = -1;
+    switch (unit_) {
+      case Unit::hour: end.tm_hour++; break;
+      case Unit::day: end.tm_mday++; break;
+      case Unit::month: end.tm_mon++; break;
+      default: end.tm_year++; break;
+    }
+    const auto first = static_cast<Int>(std::mktime(&begin));
+    auto last = static_cast<Int>(std::mktime(&end));
+    if (unit_ == Unit::hour && last > first + 3600) {
+      last = first + 3600;
+    }
+
+    // Fall back to the second around the timestamp if the span does not
+    // contain it (e.g., if mktime() failed)
+    if (first <= seconds && seconds < last) {
+      begin_ = first * 1000;
+      end_ = last * 1000;
+    }
+  }
+
+ private:
+  enum class Unit { second, minute, hour, day, month, year, never };
+
+  /// Return the unit of the finest conversion in a strftime format
+  static Unit finest_unit(const std::string& format) {
+    Unit unit = Unit::never;
+    for (std::size_t i = 0; i < format.size(); i++) {
+      if (format[i] != '%') {
+        continue;
+      }
+
+      // Skip flags, field width, and modifiers (as in '%-d' or '%Ey')
+      i++;
+      while (i < format.size()
+             && std::strchr("_-0^#EO123456789", format[i]) != nullptr) {
+        i++;
+      }
+      if (i == format.size() || std::strchr("%nt", format[i]) != nullptr) {
+        continue;
+      }
+      Unit u = Unit::second;
+      if (std::strchr("YyC", format[i]) != nullptr) {
+        u = Unit::year;
+      } else if (std::strchr("mbBh", format[i]) != nullptr) {
+        u = Unit::month;
+      } else if (std::strchr("deajAuwDFxUWVGg", format[i]) != nullptr) {
+        u = Unit::day;
+      } else if (std::strchr("HIklpPzZ", format[i]) != nullptr) {
+        u = Unit::hour;
+      } else if (std::strchr("MR", format[i]) != nullptr) {
+        u = Unit::minute;
+      }
+      unit = (u < unit) ? u : unit;
+    }
+    return unit;
+  }
+
+  const Unit unit_;
+  Int begin_ = 0;
+  Int end_ = 0;
+};
+
+} // namespace sss
+
+#endif // SSS_TIME_HPP
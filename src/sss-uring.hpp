@@ -0,0 +1,302 @@
+#ifndef SSS_URING_HPP
+#define SSS_URING_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sss {
+
+/// Batch of reads from the beginning of many files (e.g., in the proc and
+/// cgroup file systems) that are submitted to the kernel at once with
+/// io_uring. A ring is set up once and reused for all batches, and the files
+/// that are read in every batch can be registered with the ring, such that
+/// the kernel does not have to look up their descriptors for each read.
+///
+/// The ring is driven with raw system calls, i.e., there is no dependency on
+/// liburing. If io_uring is not available (kernels before 5.6, or disabled,
+/// e.g., by seccomp in containers), `open()` fails and the reads of a batch
+/// are done one by one with pread(), such that callers do not need to
+/// distinguish the two cases.
+class ReadBatch {
+ public:
+  ReadBatch() = default;
+
+  ~ReadBatch() { close(); }
+
+  ReadBatch(const ReadBatch&) = delete;
+  ReadBatch& operator=(const ReadBatch&) = delete;
+
+  /// Set up a ring for up to `entries` reads in flight, return false and set
+  /// error message if io_uring is not available
+  bool open(unsigned entries, std::string& error) {
+    close();
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+      error = std::string("io_uring is not available (")
+              + std::strerror(errno) + ")";
+      return false;
+    }
+    ring_ = static_cast<int>(fd);
+
+    // Map submission queue, completion queue (which share one mapping on
+    // kernels that support it), and submission queue entries
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes
+               + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+    cq_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+          ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    if (sq_ == nullptr || cq_ == nullptr || sqes_ == nullptr) {
+      error = "could not map io_uring queues";
+      close();
+      return false;
+    }
+    auto sq = static_cast<char*>(sq_);
+    auto cq = static_cast<char*>(cq_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    sq_entries_ = params.sq_entries;
+    cq_entries_ = params.cq_entries;
+
+    // Plain reads (without an iovec) were added after io_uring itself
+    if (!supports(IORING_OP_READ)) {
+      error = "io_uring does not support reads without iovec (kernels "
+              "before 5.6)";
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ != nullptr && cq_ != sq_) {
+      ::munmap(cq_, cq_size_);
+    }
+    if (sq_ != nullptr) {
+      ::munmap(sq_, sq_size_);
+    }
+    if (ring_ >= 0) {
+      ::close(ring_);
+    }
+    ring_ = -1;
+    sq_ = cq_ = nullptr;
+    sqes_ = nullptr;
+    slots_.clear();
+  }
+
+  /// Return true if reads are submitted with io_uring
+  bool is_open() const { return ring_ >= 0; }
+
+  /// Register file descriptors with the ring, replacing the previously
+  /// registered ones. Reads of other files still work, but have to look up
+  /// their descriptor. Return false if they could not be registered (e.g.,
+  /// since registered files count against the limit of open files).
+  bool register_files(const std::vector<int>& fds) {
+    if (!is_open()) {
+      return false;
+    }
+    if (!slots_.empty()) {
+      ::syscall(__NR_io_uring_register, ring_, IORING_UNREGISTER_FILES,
+                nullptr, 0);
+      slots_.clear();
+    }
+    if (fds.empty()
+        || ::syscall(__NR_io_uring_register, ring_, IORING_REGISTER_FILES,
+                     fds.data(), static_cast<unsigned>(fds.size())) != 0) {
+      return false;
+    }
+    for (std::size_t i = 0; i < fds.size(); i++) {
+      const auto fd = static_cast<std::size_t>(fds[i]);
+      if (fd >= slots_.size()) {
+        slots_.resize(fd + 1, -1);
+      }
+      slots_[fd] = static_cast<int>(i);
+    }
+    return true;
+  }
+
+  /// Queue a read of up to `size` bytes from the beginning of a file into
+  /// `buffer`, which must stay valid until the batch is run. The tag is
+  /// passed back on completion and must not be all ones.
+  void add(int fd, char* buffer, std::size_t size, std::uint64_t tag) {
+    reads_.push_back(Read{fd, buffer, size, tag});
+  }
+
+  /// Number of queued reads
+  std::size_t size() const { return reads_.size(); }
+
+  /// Submit all queued reads and call `f(tag, result)` for each read as soon
+  /// as it completes (in any order), where the result is the number of bytes
+  /// read or a negated error number. Reads are submitted with as few system
+  /// calls as the size of the ring allows.
+  template <typename F>
+  void run(F f) {
+    if (is_open()) {
+      submit(f);
+    }
+
+    // Reads that were not done with io_uring (e.g., since the ring failed)
+    for (const auto& r : reads_) {
+      if (r.tag == done_tag) {
+        continue;
+      }
+      ssize_t n;
+      do {
+        n = ::pread(r.fd, r.buffer, r.size, 0);
+      } while (n < 0 && errno == EINTR);
+      f(r.tag, (n < 0) ? -static_cast<long>(errno) : static_cast<long>(n));
+    }
+    reads_.clear();
+  }
+
+ private:
+  struct Read {
+    int fd;
+    char* buffer;
+    std::size_t size;
+    std::uint64_t tag;
+  };
+
+  /// Tag of reads whose completion has been reported
+  static constexpr std::uint64_t done_tag = ~std::uint64_t(0);
+
+  void* map(std::size_t size, off_t offset) {
+    void* const p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_, offset);
+    return (p == MAP_FAILED) ? nullptr : p;
+  }
+
+  /// Return true if the kernel supports an operation
+  bool supports(int op) {
+    const std::size_t size = sizeof(io_uring_probe)
+                             + 256 * sizeof(io_uring_probe_op);
+    std::vector<std::uint64_t> storage(size / sizeof(std::uint64_t) + 1, 0);
+    auto probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (::syscall(__NR_io_uring_register, ring_, IORING_REGISTER_PROBE,
+                  probe, 256) != 0) {
+      return false;
+    }
+    return op <= probe->last_op
+           && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  /// Submit all queued reads and reap their completions. The indices of the
+  /// reads are stored in the user data of their entries, and reported reads
+  /// are marked with `done_tag`. On errors of the ring itself, it is closed
+  /// and the remaining reads are left for pread().
+  template <typename F>
+  void submit(F f) {
+    std::size_t next = 0;
+    std::size_t in_flight = 0;
+    std::size_t pending = 0;
+    while (next < reads_.size() || in_flight > 0) {
+      // Fill submission queue, keeping room for all completions
+      unsigned tail = *sq_tail_;
+      while (next < reads_.size()
+             && tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)
+                < sq_entries_
+             && in_flight < cq_entries_) {
+        const auto& r = reads_[next];
+        const unsigned index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        const auto fd = static_cast<std::size_t>(r.fd);
+        if (fd < slots_.size() && slots_[fd] >= 0) {
+          sqe.fd = slots_[fd];
+          sqe.flags = IOSQE_FIXED_FILE;
+        } else {
+          sqe.fd = r.fd;
+        }
+        sqe.addr = reinterpret_cast<std::uint64_t>(r.buffer);
+        sqe.len = static_cast<std::uint32_t>(r.size);
+        sqe.off = 0;
+        sqe.user_data = next;
+        sq_array_[index] = index;
+        tail++;
+        next++;
+        in_flight++;
+        pending++;
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+      // Submit new entries and wait for at least one completion. Entries
+      // that the kernel has consumed are not submitted again if the call is
+      // interrupted.
+      const long n = ::syscall(__NR_io_uring_enter, ring_,
+                               static_cast<unsigned>(pending), 1u,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // Closing the ring cancels the reads in flight
+        close();
+        return;
+      }
+      pending = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+      // Reap completions
+      unsigned head = *cq_head_;
+      const unsigned end = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != end; head++) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        auto& r = reads_[static_cast<std::size_t>(cqe.user_data)];
+        const auto tag = r.tag;
+        r.tag = done_tag;
+        in_flight--;
+        f(tag, static_cast<long>(cqe.res));
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  int ring_ = -1;
+  void* sq_ = nullptr;
+  void* cq_ = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sq_size_ = 0;
+  std::size_t cq_size_ = 0;
+  std::size_t sqes_size_ = 0;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned cq_mask_ = 0;
+  unsigned cq_entries_ = 0;
+
+  // Registered slot of each file descriptor, or -1
+  std::vector<int> slots_;
+
+  // Queued reads
+  std::vector<Read> reads_;
+};
+
+} // namespace sss
+
+#endif // SSS_URING_HPP